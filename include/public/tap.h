@@ -1,5 +1,7 @@
 #ifndef __TAP_H__
 #define __TAP_H__
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 /**
@@ -18,8 +20,218 @@ typedef enum {
     TAP_OPTION_N_RUNNERS, /**< Set the number of test runners that libtap will
                                run tests with. The default is physical
                                cpu cores - 1. */
+    TAP_OPTION_THREADED,  /**< Run tests as threads of a single engine
+                               process instead of a process per test, takes
+                               an int that is non-zero to enable. Only for
+                               tests without side-effects on shared state.
+                               Output is captured per thread through stdout
+                               and stderr. If a test terminates the engine,
+                               e.g. via a fatal signal, the unfinished tests
+                               are re-run as processes. */
+    TAP_OPTION_JUNIT_FILE, /**< Also report test runs as JUnit XML written to
+                                the path given as a const char *, NULL
+                                disables. */
+    TAP_OPTION_JSONL_FILE, /**< Also report test run events as JSON Lines
+                                written to the path given as a
+                                const char *, NULL disables. */
+    TAP_OPTION_OUTPUT_MAX_BYTES, /**< Bytes of output each test may have
+                                      reported as comments, takes a size_t.
+                                      0, the default, is unlimited. */
+    TAP_OPTION_OUTPUT_MAX_LINES, /**< Lines of output each test may have
+                                      reported as comments, takes a size_t.
+                                      0, the default, is unlimited. */
+    TAP_OPTION_OUTPUT_SPILL_DIR, /**< Write output past the limits to
+                                      test-<id>.log in the directory given as
+                                      a const char *, instead of dropping
+                                      it. NULL disables. */
+    TAP_OPTION_COLLAPSE_REPEATS, /**< Report a run of identical output lines
+                                      once, followed by a "repeated N times"
+                                      comment. Takes an int, non-zero to
+                                      enable. */
+    TAP_OPTION_STATUS_FILE, /**< Keep a JSON snapshot of the running tests,
+                                 queue depth, completed, failed and skipped
+                                 counts and slot usage at the path given as
+                                 a const char *. Rewritten atomically at
+                                 most every 250ms. NULL disables. */
+    TAP_OPTION_TRACE_FILE, /**< Write the schedule of the run as Chrome trace
+                                event JSON, for Perfetto, to the path given
+                                as a const char *. Each runner slot has a
+                                track of fork and run phases. The scheduler
+                                track has wakeups and reporting. NULL
+                                disables. */
+    TAP_OPTION_STATS, /**< End the run with a block of comments summarising
+                           the runner's own overheads, see tap_get_stats().
+                           Takes an int, non-zero to enable. */
+    TAP_OPTION_SLOWEST, /**< End the run with the given number, a size_t, of
+                             slowest tests, the total test wall and CPU time
+                             against the suite's wall time, the parallel
+                             efficiency and the longest test as a lower
+                             bound of the suite's wall time. 0, the
+                             default, disables. */
+    TAP_OPTION_BASELINE_FILE, /**< Compare each test's duration with those
+                                   saved by an earlier run to the path given
+                                   as a const char *, commenting on tests
+                                   that got slower. NULL disables. */
+    TAP_OPTION_BASELINE_SAVE_FILE, /**< Save each test's duration to the path
+                                        given as a const char *, for later
+                                        runs to compare with. May be the
+                                        baseline file itself. NULL
+                                        disables. */
+    TAP_OPTION_BASELINE_THRESHOLD, /**< How much slower than its baseline, as
+                                        a double fraction, a test may get.
+                                        Defaults to 0.5, 50% slower. */
+    TAP_OPTION_BASELINE_NOISE_FLOOR, /**< Seconds, as a double, a test may get
+                                          slower by regardless of the
+                                          threshold. Defaults to 0.005. */
+    TAP_OPTION_BASELINE_TODO, /**< Fail passing tests that got slower than
+                                   their baseline as TODO, instead of only
+                                   commenting. Takes an int, non-zero to
+                                   enable. */
+    TAP_OPTION_REPEAT, /**< Run each test the given number, a size_t, of
+                            times. Repetitions of a test are started back to
+                            back to run side by side, and are reported as
+                            one testpoint with the pass rate and the min,
+                            median and max duration. The threaded engine is
+                            not used while repeating. */
+    TAP_OPTION_REPEAT_FILTER, /**< Only repeat tests whose description matches
+                                   the fnmatch(3) pattern given as a const
+                                   char *. NULL, the default, repeats every
+                                   test. */
+    TAP_OPTION_SCHEDULER, /**< Order in which tests are started, a TAP_SCHED
+                               passed as an int. TAP_SCHED_FIFO by default. */
+    TAP_OPTION_SCHEDULER_PICK, /**< Choose the next test to start with a
+                                    tap_pick_t callback, followed by a void *
+                                    passed on to it. Overrides
+                                    TAP_OPTION_SCHEDULER, NULL reverts to
+                                    it. */
+    TAP_OPTION_MEMORY_BUDGET, /**< Bytes of memory the tests running at once
+                                   may expect to use, a size_t. A test expects
+                                   the memory of tap_test_attrs, or else its
+                                   peak in the TAP_OPTION_BASELINE_FILE. Tests
+                                   expecting none fill the remaining slots. 0,
+                                   the default, has no budget. */
+    TAP_OPTION_TIME_BUDGET, /**< Seconds the run may take, a double. Tests
+                                 are chosen to run as many as fit, or as
+                                 much priority under TAP_SCHED_PRIORITY, by
+                                 their cost or else their duration in the
+                                 TAP_OPTION_BASELINE_FILE. The rest are
+                                 skipped, and tests still running once the
+                                 time is up are cancelled, both as SKIP
+                                 "time budget". 0, the default, has no
+                                 budget. */
+    TAP_OPTION_WRITER_THREAD, /**< Write the TAP stream from a thread of its
+                                   own, so a slow reader of stdout does not
+                                   hold up starting and reaping tests. A
+                                   size_t of the bytes of output that may be
+                                   queued before the runner waits on it. 0,
+                                   the default, writes from the runner. */
+    TAP_OPTION_LIMITS, /**< Resource limits of every test, a const struct
+                            tap_limits *. By default core dumps are not
+                            written and nothing else is limited. Tests with
+                            limits are not run by the threaded engine. */
+    TAP_OPTION_JOURNAL_FILE, /**< Path to append the result of each test to
+                                  as it finishes, so a run cut short by a
+                                  crash can be resumed. Started over unless
+                                  TAP_OPTION_RESUME is set. NULL, the
+                                  default, keeps no journal. */
+    TAP_OPTION_RESUME, /**< Resume from the TAP_OPTION_JOURNAL_FILE, an int.
+                            Tests with a result journaled by the same build
+                            of the program are reported from it, only the
+                            rest are run. False by default. */
+    TAP_OPTION_WORKER_LISTEN, /**< Address to lease the tests to workers on,
+                                   a path with a '/' for a UNIX socket or
+                                   else a TCP "host:port". Workers are the
+                                   same program, on this host or another,
+                                   run with UNITESTAP_WORKER set to the
+                                   address. Tests the workers did not run,
+                                   and tests with resources, are then run
+                                   by the runner itself. NULL, the default,
+                                   runs every test here. */
+    TAP_OPTION_WORKER_WAIT, /**< Seconds to wait without any worker
+                                 connected before running the remaining
+                                 tests here, a double. 10 by default. */
 } TAP_OPTION;
 
+/**
+ * @var TAP_SCHED
+ *
+ * Policies for the order tests are started in. Tests whose resources are in
+ * use are passed over whatever the policy, ties go to the first registered.
+ */
+typedef enum {
+    TAP_SCHED_FIFO,           /**< In the order the tests were registered */
+    TAP_SCHED_PRIORITY,       /**< Highest priority first */
+    TAP_SCHED_SHORTEST_FIRST, /**< Lowest cost first, for early results */
+    TAP_SCHED_LONGEST_FIRST,  /**< Highest cost first, so the run does not end
+                                   waiting on one long test */
+} TAP_SCHED;
+
+/**
+ * @var tap_sched_candidate
+ *
+ * A test that could be started next, as seen by a tap_pick_t.
+ */
+struct tap_sched_candidate {
+    size_t id;
+    const char *description;
+    int priority;
+    double cost;
+    const char *tags;
+};
+
+/**
+ * @var tap_pick_t
+ *
+ * Callback choosing the next test to start, see TAP_OPTION_SCHEDULER_PICK.
+ * Returns the index of a candidate, or n_candidates to leave the free slot
+ * empty until a test finishes. When no test is running the first candidate
+ * is started instead.
+ */
+typedef size_t (*tap_pick_t)(const struct tap_sched_candidate *candidates,
+                             size_t n_candidates, void *priv);
+
+/**
+ * @var TAP_HISTOGRAM_BUCKETS
+ *
+ * Number of buckets of a tap_histogram, bucket i counts values v where
+ * 2^(i-1) <= v < 2^i, bucket 0 counts zeros.
+ */
+#define TAP_HISTOGRAM_BUCKETS 65
+
+/**
+ * @var tap_histogram
+ *
+ * Distribution of a measurement, with power of two buckets.
+ */
+struct tap_histogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[TAP_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * @var tap_stats
+ *
+ * Measurements the runner takes of itself during tap_runall(). Durations are
+ * in nanoseconds.
+ */
+struct tap_stats {
+    /** From calling fork() until it returned in the runner */
+    struct tap_histogram fork_ns;
+    /** From a test closing its output until the runner reaped it */
+    struct tap_histogram reap_delay_ns;
+    /** Bytes of output read from each test */
+    struct tap_histogram output_bytes;
+    /** Times the runner woke up from waiting on tests */
+    uint64_t n_wakeups;
+    /** Wakeups that neither read output nor reaped a test */
+    uint64_t n_wasted_wakeups;
+    /** Time spent processing and formatting test output */
+    uint64_t format_ns;
+};
+
 /**
  * @var test_t
  *
@@ -74,6 +286,128 @@ void tap_cleanup(TAP *tap);
  */
 int tap_register(TAP *tap, test_t test, const char *description);
 
+/**
+ * @fn tap_register_concurrent
+ *
+ * Register a test to run in tap_runall() as n_instances processes, each pinned
+ * to a CPU of its own where there are enough. The processes wait on a shared
+ * barrier so they call test at the same moment. The test passes when every
+ * instance does and is reported as one testpoint.
+ *
+ * @param tap a tap handle allocated by tap_init().
+ * @param test the test function to register.
+ * @param n_instances the number of processes to run test in.
+ * @param description an optional description of the registered test.
+ *
+ * @return 0 on success, errno-like value otherwise.
+ */
+int tap_register_concurrent(TAP *tap, test_t test, size_t n_instances,
+                            const char *description);
+
+/**
+ * @fn tap_register_resources
+ *
+ * Register a test to run in tap_runall() holding a unit of each of the named
+ * resources while it runs. Tests are started out of order rather than wait on
+ * a resource in use, so only tests sharing a resource are serialised.
+ *
+ * @param tap a tap handle allocated by tap_init().
+ * @param test the test function to register.
+ * @param resources comma separated "name:capacity" pairs, e.g.
+ *        "port-8080:1,db:4". The capacity is how many tests may hold the
+ *        resource at once, 1 if left out, and must match between tests.
+ * @param description an optional description of the registered test.
+ *
+ * @return 0 on success, errno-like value otherwise. EINVAL for a malformed
+ *         resources or a mismatched capacity, ENOSPC past 64 resources.
+ */
+int tap_register_resources(TAP *tap, test_t test, const char *resources,
+                           const char *description);
+
+/**
+ * @var TAP_NO_LIMIT
+ *
+ * A tap_limits value lifting the limit up to the hard limit the runner was
+ * started with.
+ */
+#define TAP_NO_LIMIT ((size_t)-1)
+
+/**
+ * @var tap_limits
+ *
+ * Resource limits applied to a test's process before the test runs, see
+ * setrlimit(2). Fields left zero take the runner's limit, see
+ * TAP_OPTION_LIMITS. A test is not allowed past the runner's hard limits.
+ */
+struct tap_limits {
+    /** Seconds of CPU time, after which the test is terminated by SIGXCPU */
+    unsigned long cpu;
+    /** Bytes of address space, allocations past it fail */
+    size_t address_space;
+    /** Bytes a file may be written up to, past it the test is terminated by
+     *  SIGXFSZ */
+    size_t file_size;
+    /** Bytes of a core dump. Left zero in the runner's limits, none are
+     *  written */
+    size_t core;
+};
+
+/**
+ * @var tap_test_attrs
+ *
+ * Attributes of a test registered with tap_register_ex(). Fields left zero
+ * take their defaults, initialise it with designated initialisers so it keeps
+ * working as fields are added.
+ */
+struct tap_test_attrs {
+    /** An optional description of the test */
+    const char *description;
+    /** Tests with a higher priority start first under TAP_SCHED_PRIORITY */
+    int priority;
+    /** Expected run time in seconds, 0 if unknown, for
+     *  TAP_SCHED_SHORTEST_FIRST and TAP_SCHED_LONGEST_FIRST */
+    double cost;
+    /** Optional comma separated tags, passed on to a tap_pick_t and reported
+     *  in JSON Lines */
+    const char *tags;
+    /** Seconds after which the test is terminated as failed, 0 for no limit.
+     *  Enforced with SIGALRM, which the test must leave alone */
+    double timeout;
+    /** Resources held while running, see tap_register_resources() */
+    const char *resources;
+    /** Processes to run the test in, see tap_register_concurrent() */
+    size_t n_instances;
+    /** Peak memory in bytes expected of the test, 0 if unknown, see
+     *  TAP_OPTION_MEMORY_BUDGET */
+    size_t memory;
+    /** Resource limits of the test's process, overriding the runner's */
+    struct tap_limits limits;
+};
+
+/**
+ * @fn tap_register_ex
+ *
+ * Register a test to run in tap_runall() with the given attributes. Tests
+ * with a timeout, memory or limits are always run as processes.
+ *
+ * @param tap a tap handle allocated by tap_init().
+ * @param test the test function to register.
+ * @param attrs attributes of the test, see tap_test_attrs.
+ *
+ * @return 0 on success, errno-like value otherwise.
+ */
+int tap_register_ex(TAP *tap, test_t test, const struct tap_test_attrs *attrs);
+
+/**
+ * @fn tap_instance
+ *
+ * The index, from 0 to n_instances - 1, of the calling instance of a test
+ * registered with tap_register_concurrent(). 0 in any other test.
+ *
+ * @return the instance index.
+ */
+size_t tap_instance(void);
+
 /**
  * @fn tap_easy_register
  *
@@ -117,4 +451,88 @@ static inline int tap_easy_runall_and_cleanup(void) {
     return ret;
 }
 
+/**
+ * @fn tap_get_stats
+ *
+ * Get the runner's measurements of itself from the last tap_runall().
+ *
+ * @param tap a tap handle allocated by tap_init().
+ * @param stats filled in with the measurements.
+ *
+ * @return 0 on success, errno-like value otherwise.
+ */
+int tap_get_stats(TAP *tap, struct tap_stats *stats);
+
+/**
+ * @fn tap_histogram_percentile
+ *
+ * Estimate a percentile of a histogram, from the bucket it falls in.
+ *
+ * @param hist the histogram.
+ * @param percentile between 0 and 100.
+ *
+ * @return the upper bound of the bucket holding the percentile, capped to the
+ *         largest value seen. 0 for an empty histogram.
+ */
+uint64_t tap_histogram_percentile(const struct tap_histogram *hist,
+                                  double percentile);
+
+/**
+ * @fn tap_ok
+ *
+ * Report an assertion from inside a running test. Each assertion is reported
+ * as a TAP 14 subtest of the test's testpoint and any failed assertion fails
+ * the test. Unlike assert(), the test keeps running after a failure.
+ *
+ * @param pass whether the assertion passed.
+ * @param fmt printf-like format for the description of the assertion, may be
+ *            NULL.
+ *
+ * @return pass.
+ */
+bool tap_ok(bool pass, const char *fmt, ...);
+
+/**
+ * @fn tap_is
+ *
+ * Assert two integers are equal, see tap_ok().
+ *
+ * @param got the value produced by the code under test.
+ * @param expected the value the test expected.
+ * @param description an optional description of the assertion.
+ *
+ * @return true if got is equal to expected.
+ */
+bool tap_is(long long got, long long expected, const char *description);
+
+/**
+ * @fn tap_is_str
+ *
+ * Assert two strings are equal, see tap_ok(). NULL is only equal to NULL.
+ *
+ * @param got the string produced by the code under test.
+ * @param expected the string the test expected.
+ * @param description an optional description of the assertion.
+ *
+ * @return true if got is equal to expected.
+ */
+bool tap_is_str(const char *got, const char *expected,
+                const char *description);
+
+/**
+ * @fn tap_cmp
+ *
+ * Assert the comparison "lhs op rhs" holds, see tap_ok().
+ *
+ * @param lhs the left hand side of the comparison.
+ * @param op one of "==", "!=", "<", "<=", ">" or ">=".
+ * @param rhs the right hand side of the comparison.
+ * @param description an optional description of the assertion.
+ *
+ * @return true if the comparison holds, false if it does not or op is
+ *         unknown.
+ */
+bool tap_cmp(long long lhs, const char *op, long long rhs,
+             const char *description);
+
 #endif /* __TAP_H__ */
\ No newline at end of file
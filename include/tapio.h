@@ -1,8 +1,15 @@
 #ifndef __TAP_IO_H__
 #define __TAP_IO_H__
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <tapstruct.h>
 #include <taptest.h>
 
+/* Buffer sizes, including the terminating NUL, of the fast formatters */
+#define TAP_UINT_FMT_LEN 21
+#define TAP_DURATION_FMT_LEN 16
+
 struct tap_duration {
     struct timespec t1, t0;
 };
@@ -12,11 +19,98 @@ struct tap_seconds {
     double secs;
 };
 
+struct tap_testpoint {
+    bool success;
+    struct test *test;
+    /* Time spent in the test itself when it is known, otherwise from the
+     * runner starting the test to noticing it had finished */
+    struct tap_duration *duration;
+    /* CPU time of the test, NULL if unknown */
+    struct tap_duration *cpu;
+    /* Runner time spent starting and reaping the test, NULL if unknown */
+    struct tap_duration *overhead;
+    const char *directive;
+    tap_cmd_t *subtests;
+};
+
+/* Events of a test run, every hook is optional */
+struct tap_reporter_ops {
+    int (*plan)(void *priv, size_t n_tests);
+    int (*testpoint)(void *priv, struct tap_testpoint *point);
+    /* test is NULL for comments not belonging to a test */
+    int (*comment)(void *priv, struct test *test, const char *line);
+    /* A block of newline separated comment lines, empty lines are skipped.
+     * Reporters without it get each line through comment */
+    int (*comment_lines)(void *priv, struct test *test, const char *lines,
+                         size_t len);
+    int (*bailout)(void *priv, const char *reason);
+    int (*finish)(void *priv);
+    void (*dtor)(void *priv);
+};
+
+struct tap_reporter {
+    const struct tap_reporter_ops *ops;
+    void *priv;
+    struct tap_reporter *next;
+};
+
 struct tap_seconds tap_duration_to_secs(struct tap_duration *d);
 
+double tap_duration_to_double(struct tap_duration *d);
+
+/* Format as %.3g with a metric prefix and unit, e.g. "37.1ms" */
+size_t tap_duration_format(struct tap_duration *d, char *buf);
+
+/* A duration of ns nanoseconds */
+struct tap_duration tap_duration_from_ns(uint64_t ns);
+
+size_t tap_uint_format(size_t n, char *buf);
+
+/* Buffered stdout, written out by tap_out_flush() or when the buffer fills */
+int tap_out_write(const char *data, size_t len);
+
+int tap_out_str(const char *str);
+
+/* Write str up to, not including, its first newline */
+int tap_out_span(const char *str);
+
+int tap_out_char(char c);
+
+/* Write prefix, line and a newline, line must not contain a newline */
+int tap_out_prefixed_line(const char *prefix, size_t prefix_len,
+                          const char *line, size_t line_len);
+
+int tap_out_uint(size_t n);
+
+int tap_out_duration(struct tap_duration *d);
+
+int tap_out_vprintf(const char *fmt, va_list ap);
+
+int tap_out_printf(const char *fmt, ...);
+
+/* Format up to the first newline, then end the line */
+int tap_out_vprintf_line(const char *fmt, va_list ap);
+
+int tap_out_flush(void);
+
+/* Flush, then send later output to fd instead of stdout */
+int tap_out_set_fd(int fd);
+
+/* Write the buffered output from a thread of its own, so a flush returns
+ * without waiting on stdout. Up to size bytes of output are queued before a
+ * flush waits on the writer after all */
+int tap_out_start_writer(size_t size);
+
+/* Write out everything queued and stop the writer thread */
+int tap_out_stop_writer(void);
+
 int tap_pipe_setup(int fds[2]);
 
-int tap_parse_cmd(const char *line, struct tap_cmd **d_cmd);
+int tap_pipe_nonblock(int fd);
+
+/* The command is allocated from arena, see tap_cmd_strndup() */
+int tap_parse_cmd(tap_arena_t *arena, const char *line,
+                  struct tap_cmd **d_cmd);
 
 int tap_trim_string(const char *in, char **out);
 
@@ -27,8 +121,45 @@ int tap_print_line(const char *line);
 int tap_printf_line(const char *fmt, ...);
 
 int tap_print_testpoint(bool success, struct test *test,
-                        struct tap_duration *duration, const char *directive);
+                        struct tap_duration *duration,
+                        struct tap_duration *cpu,
+                        struct tap_duration *overhead, const char *directive,
+                        tap_cmd_t *subtests);
 
 int tap_print_internal_error(int err, struct test *test, const char *reason);
 
+int tap_reporter_ctor(const struct tap_reporter_ops *ops, void *priv,
+                      struct tap_reporter **d_reporter);
+
+int tap_reporter_tap_ctor(struct tap_reporter **d_reporter);
+
+int tap_reporter_junit_ctor(const char *path, struct tap_reporter **d_reporter);
+
+int tap_reporter_jsonl_ctor(const char *path, struct tap_reporter **d_reporter);
+
+/* Write str as a quoted and escaped JSON string, or null if str is NULL */
+void tap_json_string(FILE *fp, const char *str);
+
+void tap_reporters_dtor(struct tap_reporter *reporters);
+
+int tap_report_plan(struct tap_reporter *reporters, size_t n_tests);
+
+int tap_report_testpoint(struct tap_reporter *reporters,
+                         struct tap_testpoint *point);
+
+int tap_report_comment(struct tap_reporter *reporters, struct test *test,
+                       const char *fmt, ...);
+
+/* As tap_report_comment(), for a line already without a newline */
+int tap_report_comment_line(struct tap_reporter *reporters, struct test *test,
+                            const char *line);
+
+/* Report every line of a block of output, none of them commands */
+int tap_report_comment_lines(struct tap_reporter *reporters, struct test *test,
+                             const char *lines, size_t len);
+
+int tap_report_bailout(struct tap_reporter *reporters, const char *fmt, ...);
+
+int tap_report_finish(struct tap_reporter *reporters);
+
 #endif /* __TAP_IO_H__ */
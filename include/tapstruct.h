@@ -2,23 +2,41 @@
 #define __TAP_STRUCT_H__
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+/* Strings up to this length, including the null byte, need no allocation */
+#define TAP_STRING_INLINE_LEN 128
 
 enum tap_cmd_type {
     tap_cmd_type_unknown = -1,
     tap_cmd_type_todo = 0,
     tap_cmd_type_skip,
     tap_cmd_type_bail,
+    tap_cmd_type_ok,
+    tap_cmd_type_not_ok,
+    /* Sent by the runner's own child, see tap_run_test_and_exit() */
+    tap_cmd_type_timing,
 };
 
 struct tap_cmd {
     enum tap_cmd_type type;
+    struct tap_cmd *next;
     char str[];
 };
 typedef struct tap_cmd tap_cmd_t;
 
-struct tap_string;
+struct tap_string {
+    size_t allocated;
+    size_t len;
+    char *data;
+    /* Storage of data until it outgrows it */
+    char inline_data[TAP_STRING_INLINE_LEN];
+};
 typedef struct tap_string tap_string_t;
 
+struct tap_arena;
+typedef struct tap_arena tap_arena_t;
+
 static inline bool tap_cmd_is_bailed(tap_cmd_t *cmd) {
     return cmd && cmd->type == tap_cmd_type_bail;
 }
@@ -34,15 +52,45 @@ static inline bool tap_cmd_is_directive(tap_cmd_t *cmd) {
     return ctype == tap_cmd_type_skip || ctype == tap_cmd_type_todo;
 }
 
-int tap_cmd_strndup(enum tap_cmd_type type, const char *line, size_t n_copy,
-                    tap_cmd_t **d_cmd);
+static inline bool tap_cmd_is_assertion(tap_cmd_t *cmd) {
+    int ctype;
+
+    if (!cmd) {
+        return false;
+    }
+
+    ctype = cmd->type;
+    return ctype == tap_cmd_type_ok || ctype == tap_cmd_type_not_ok;
+}
+
+int tap_arena_ctor(tap_arena_t **d_arena);
+
+int tap_arena_alloc(tap_arena_t *arena, size_t size, void **d_ptr);
+
+/* Frees every allocation made from the arena */
+void tap_arena_dtor(tap_arena_t *arena);
+
+/* Allocated from arena, or from the heap to be free()d if arena is NULL */
+int tap_cmd_strndup(tap_arena_t *arena, enum tap_cmd_type type,
+                    const char *line, size_t n_copy, tap_cmd_t **d_cmd);
 
 int tap_string_ctor(tap_string_t **d_tstr, const char *fmt, ...);
 
+/* For strings embedded in other structures or on the stack */
+void tap_string_init(tap_string_t *tstr);
+
+void tap_string_fini(tap_string_t *tstr);
+
 const char *tap_string_borrow(tap_string_t *tstr);
 
 int tap_string_concat(tap_string_t *tstr, const char *str);
 
+/* Append the first len bytes of str */
+int tap_string_concat_len(tap_string_t *tstr, const char *str, size_t len);
+
+/* Empty the string, keeping any allocated space */
+void tap_string_clear(tap_string_t *tstr);
+
 int tap_string_concat_vprintf(tap_string_t *tstr, const char *fmt, va_list ap);
 
 int tap_string_concat_printf(tap_string_t *tstr, const char *fmt, ...);
@@ -1,5 +1,6 @@
 #ifndef __TAP_TEST_H__
 #define __TAP_TEST_H__
+#include <stdint.h>
 #include <sys/types.h>
 #include <tap.h>
 
@@ -12,6 +13,19 @@ struct test {
     char *description;
     test_t funct;
     size_t id;
+    /* Processes started together to run the test, 0 or 1 for a plain test */
+    size_t n_instances;
+    /* Bit i set for each resource i held while running, see tap_resources */
+    uint64_t resources;
+    /* Hints of tap_register_ex(), see tap_test_attrs */
+    int priority;
+    double cost;
+    char *tags;
+    double timeout;
+    /* Expected peak memory in bytes, declared or learned from a baseline */
+    size_t memory;
+    /* The test's own, merged with the runner's when the test is started */
+    struct tap_limits limits;
 };
 
 #endif /* __TAP_TEST_H__ */
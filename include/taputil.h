@@ -18,6 +18,10 @@
 #define TAP_DIRECTIVE_SKIP "SKIP"
 #define TAP_DIRECTIVE_TODO "TODO"
 #define TAP_BAILOUT "Bail out!"
+#define TAP_ASSERT_OK "ok"
+#define TAP_ASSERT_NOT_OK "not ok"
+#define TAP_CMD_TIMING "timing"
+#define TAP_SUBTEST_INDENT "    "
 #define TAP_PIPE_RX 0
 #define TAP_PIPE_TX 1
 
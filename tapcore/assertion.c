@@ -0,0 +1,95 @@
+/**
+ * @file assertion.c
+ *
+ * Child side assertions. Each assertion is written to the test's output as a
+ * command line that the runner collects into subtests of the testpoint.
+ */
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <tap.h>
+#include <taputil.h>
+
+#include "config.h"
+
+static bool tap_vok(bool pass, const char *fmt, va_list ap) {
+    const char *ok;
+
+    ok = pass ? TAP_ASSERT_OK : TAP_ASSERT_NOT_OK;
+    printf(":%s", ok);
+    if (fmt) {
+        printf(" ");
+        vprintf(fmt, ap);
+    }
+    printf("\n");
+    return pass;
+}
+
+bool tap_ok(bool pass, const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    pass = tap_vok(pass, fmt, ap);
+    va_end(ap);
+    return pass;
+}
+
+static bool tap_describe_ok(bool pass, const char *description) {
+    if (!description) {
+        return tap_ok(pass, NULL);
+    }
+    return tap_ok(pass, "%s", description);
+}
+
+bool tap_is(long long got, long long expected, const char *description) {
+    if (!tap_describe_ok(got == expected, description)) {
+        printf("got: %lld\n", got);
+        printf("expected: %lld\n", expected);
+        return false;
+    }
+    return true;
+}
+
+bool tap_is_str(const char *got, const char *expected,
+                const char *description) {
+    bool pass;
+
+    if (!got || !expected) {
+        pass = got == expected;
+    } else {
+        pass = strcmp(got, expected) == 0;
+    }
+
+    if (!tap_describe_ok(pass, description)) {
+        printf("got: '%s'\n", got ? got : "(null)");
+        printf("expected: '%s'\n", expected ? expected : "(null)");
+        return false;
+    }
+    return true;
+}
+
+bool tap_cmp(long long lhs, const char *op, long long rhs,
+             const char *description) {
+    bool pass = false;
+
+    if (strcmp(op, "==") == 0) {
+        pass = lhs == rhs;
+    } else if (strcmp(op, "!=") == 0) {
+        pass = lhs != rhs;
+    } else if (strcmp(op, "<") == 0) {
+        pass = lhs < rhs;
+    } else if (strcmp(op, "<=") == 0) {
+        pass = lhs <= rhs;
+    } else if (strcmp(op, ">") == 0) {
+        pass = lhs > rhs;
+    } else if (strcmp(op, ">=") == 0) {
+        pass = lhs >= rhs;
+    }
+
+    if (!tap_describe_ok(pass, description)) {
+        printf("failed comparison: %lld %s %lld\n", lhs, op, rhs);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,365 @@
+/**
+ * @file baseline.c
+ *
+ * Compares test durations with those of an earlier run. The baseline file has
+ * a line per test of "<nanoseconds> <key>", the key being the test's
+ * description or "test <id>" for tests without one. A key shared by several
+ * tests is qualified as "<key> (test <id>)" for each of them, tests with a
+ * newline in their description are left out. Tests whose peak memory was
+ * measured have "<nanoseconds>/<bytes> <key>" instead.
+ */
+#define _GNU_SOURCE /* asprintf() */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <tapio.h>
+#include <tapstruct.h>
+#include <taptest.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "internal.h"
+
+struct tap_baseline_entry {
+    uint64_t ns;
+    /* Peak resident memory, 0 if not measured */
+    uint64_t max_rss;
+    char *key;
+};
+
+struct tap_baseline {
+    const struct tap_baseline_opts *opts;
+    /* Sorted by key */
+    struct tap_baseline_entry *entries;
+    size_t n_entries;
+    /* Whether each test's key is qualified with its id, by test id - 1 */
+    bool *shared;
+    size_t n_tests;
+};
+
+/* Descriptions are unique enough and survive tests being added or removed.
+ * Returns NULL if the test can't have a key, with errno set */
+static char *tap_baseline_key(struct test *test, bool shared) {
+    char *key;
+    int res;
+
+    if (test->description && strchr(test->description, '\n')) {
+        /* It would end the line early */
+        errno = EINVAL;
+        return NULL;
+    }
+    if (test->description && shared) {
+        res = asprintf(&key, "%s (test %zu)", test->description, test->id);
+    } else if (test->description) {
+        res = asprintf(&key, "%s", test->description);
+    } else {
+        res = asprintf(&key, "test %zu", test->id);
+    }
+    return res == -1 ? NULL : key;
+}
+
+static int tap_baseline_cmp(const void *lhs, const void *rhs) {
+    const struct tap_baseline_entry *lentry = lhs, *rentry = rhs;
+
+    return strcmp(lentry->key, rentry->key);
+}
+
+/* The unqualified key of the test at idx */
+struct tap_baseline_test_key {
+    char *key;
+    size_t idx;
+};
+
+static int tap_baseline_test_key_cmp(const void *lhs, const void *rhs) {
+    const struct tap_baseline_test_key *lkey = lhs, *rkey = rhs;
+
+    return strcmp(lkey->key, rkey->key);
+}
+
+/* Mark which of the tests share a key, tests with an id of 0 are ignored */
+static int tap_baseline_mark_shared(struct test *const *tests, size_t n_tests,
+                                    bool *shared) {
+    struct tap_baseline_test_key *keys;
+    size_t n_keys = 0;
+    int err = 0;
+
+    memset(shared, 0, n_tests * sizeof(*shared));
+    keys = calloc(n_tests ? n_tests : 1, sizeof(*keys));
+    if (!keys) {
+        return errno;
+    }
+    for (size_t idx = 0; idx < n_tests; idx++) {
+        if (tests[idx]->id == 0) {
+            continue;
+        }
+        keys[n_keys].key = tap_baseline_key(tests[idx], false);
+        if (!keys[n_keys].key && errno != EINVAL) {
+            err = errno;
+            goto done;
+        }
+        keys[n_keys].idx = idx;
+        n_keys += !!keys[n_keys].key;
+    }
+    qsort(keys, n_keys, sizeof(*keys), tap_baseline_test_key_cmp);
+    for (size_t idx = 1; idx < n_keys; idx++) {
+        if (strcmp(keys[idx - 1].key, keys[idx].key) == 0) {
+            shared[keys[idx - 1].idx] = true;
+            shared[keys[idx].idx] = true;
+        }
+    }
+
+done:
+    for (size_t idx = 0; idx < n_keys; idx++) {
+        free(keys[idx].key);
+    }
+    free(keys);
+    return err;
+}
+
+static struct tap_baseline_entry *tap_baseline_find(
+    struct tap_baseline *baseline, struct test *test) {
+    struct tap_baseline_entry needle, *entry;
+    bool shared;
+
+    if (!baseline) {
+        return NULL;
+    }
+    shared = test->id > 0 && test->id <= baseline->n_tests &&
+             baseline->shared[test->id - 1];
+    needle.key = tap_baseline_key(test, shared);
+    if (!needle.key) {
+        return NULL;
+    }
+    entry = bsearch(&needle, baseline->entries, baseline->n_entries,
+                    sizeof(*baseline->entries), tap_baseline_cmp);
+    free(needle.key);
+    return entry;
+}
+
+static int tap_baseline_add(struct tap_baseline *baseline, size_t *allocated,
+                            uint64_t ns, uint64_t max_rss, const char *key) {
+    struct tap_baseline_entry *entry;
+
+    if (baseline->n_entries == *allocated) {
+        size_t n = *allocated ? *allocated * 2 : 64;
+
+        entry = realloc(baseline->entries, n * sizeof(*entry));
+        if (!entry) {
+            return errno;
+        }
+        baseline->entries = entry;
+        *allocated = n;
+    }
+    entry = &baseline->entries[baseline->n_entries];
+    entry->key = strdup(key);
+    if (!entry->key) {
+        return errno;
+    }
+    entry->ns = ns;
+    entry->max_rss = max_rss;
+    baseline->n_entries++;
+    return 0;
+}
+
+int tap_baseline_ctor(const struct tap_baseline_opts *opts,
+                      struct test *tests, size_t n_tests,
+                      struct tap_baseline **d_baseline) {
+    struct tap_baseline *baseline;
+    size_t line_len = 0, allocated = 0;
+    struct test **by_id = NULL;
+    char *line = NULL;
+    FILE *fp = NULL;
+    int err = 0;
+
+    baseline = calloc(1, sizeof(*baseline));
+    if (!baseline) {
+        return errno;
+    }
+    baseline->opts = opts;
+
+    baseline->shared = calloc(n_tests ? n_tests : 1, sizeof(bool));
+    by_id = calloc(n_tests ? n_tests : 1, sizeof(*by_id));
+    if (!baseline->shared || !by_id) {
+        err = ENOMEM;
+        goto failed;
+    }
+    for (size_t idx = 0; idx < n_tests; idx++) {
+        by_id[idx] = &tests[idx];
+    }
+    baseline->n_tests = n_tests;
+    err = tap_baseline_mark_shared(by_id, n_tests, baseline->shared);
+    if (err != 0) {
+        goto failed;
+    }
+
+    fp = fopen(opts->path, "r");
+    if (!fp) {
+        err = errno;
+        goto failed;
+    }
+    for (; getline(&line, &line_len, fp) != -1;) {
+        unsigned long long ns, max_rss = 0;
+        int key_pos = 0;
+
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, "%llu/%llu %n", &ns, &max_rss, &key_pos) != 2) {
+            key_pos = 0;
+            sscanf(line, "%llu %n", &ns, &key_pos);
+        }
+        if (key_pos == 0 || line[key_pos] == '\0') {
+            /* Not written by tap_baseline_save(), don't guess at it */
+            err = EINVAL;
+            goto failed;
+        }
+        err = tap_baseline_add(baseline, &allocated, ns, max_rss,
+                               line + key_pos);
+        if (err != 0) {
+            goto failed;
+        }
+    }
+    if (ferror(fp)) {
+        err = EIO;
+        goto failed;
+    }
+    qsort(baseline->entries, baseline->n_entries, sizeof(*baseline->entries),
+          tap_baseline_cmp);
+
+    free(by_id);
+    free(line);
+    fclose(fp);
+    *d_baseline = baseline;
+    return 0;
+
+failed:
+    free(by_id);
+    free(line);
+    if (fp) {
+        fclose(fp);
+    }
+    tap_baseline_dtor(baseline);
+    return err;
+}
+
+uint64_t tap_baseline_ns(struct tap_baseline *baseline, struct test *test) {
+    struct tap_baseline_entry *entry;
+
+    entry = tap_baseline_find(baseline, test);
+    return entry ? entry->ns : 0;
+}
+
+size_t tap_baseline_memory(struct tap_baseline *baseline, struct test *test) {
+    struct tap_baseline_entry *entry;
+
+    entry = tap_baseline_find(baseline, test);
+    return entry ? entry->max_rss : 0;
+}
+
+bool tap_baseline_regressed(struct tap_baseline *baseline, struct test *test,
+                            struct tap_duration *duration,
+                            struct tap_duration *d_base) {
+    const struct tap_baseline_opts *opts;
+    struct tap_baseline_entry *entry;
+    double now, base;
+
+    entry = tap_baseline_find(baseline, test);
+    if (!entry) {
+        /* New tests have nothing to regress from */
+        return false;
+    }
+
+    /* Slower by the relative threshold, and by more than noise */
+    opts = baseline->opts;
+    *d_base = tap_duration_from_ns(entry->ns);
+    now = tap_duration_to_double(duration);
+    base = tap_duration_to_double(d_base);
+    return now > base * (1 + opts->threshold) &&
+           now - base > opts->noise_floor;
+}
+
+int tap_baseline_save(const char *path, struct test_run *runs, size_t n_runs) {
+    struct test **tests = NULL;
+    bool *shared = NULL;
+    char *tmp_path;
+    FILE *fp;
+    int err = 0;
+
+    if (asprintf(&tmp_path, "%s.tmp", path) == -1) {
+        return ENOMEM;
+    }
+    tests = calloc(n_runs ? n_runs : 1, sizeof(*tests));
+    shared = calloc(n_runs ? n_runs : 1, sizeof(*shared));
+    if (!tests || !shared) {
+        err = ENOMEM;
+        goto done;
+    }
+    for (size_t idx = 0; idx < n_runs; idx++) {
+        tests[idx] = &runs[idx].test;
+    }
+    err = tap_baseline_mark_shared(tests, n_runs, shared);
+    if (err != 0) {
+        goto done;
+    }
+    fp = fopen(tmp_path, "w");
+    if (!fp) {
+        err = errno;
+        goto done;
+    }
+    for (size_t idx = 0; idx < n_runs; idx++) {
+        struct tap_duration *d;
+        struct test_run *run = &runs[idx];
+        char *key;
+
+        /* Skipped tests did not run their usual course */
+        if (!run->exited ||
+            (run->cmd && run->cmd->type == tap_cmd_type_skip)) {
+            continue;
+        }
+        key = tap_baseline_key(&run->test, shared[idx]);
+        if (!key) {
+            continue;
+        }
+        d = tap_testrun_duration(run);
+        fprintf(fp, "%llu",
+                (unsigned long long)tap_timespec_diff_ns(&d->t0, &d->t1));
+        /* Tests run by the threaded engine share the runner's memory */
+        if (run->max_rss > 0) {
+            fprintf(fp, "/%llu", (unsigned long long)run->max_rss);
+        }
+        fprintf(fp, " %s\n", key);
+        free(key);
+    }
+    if (ferror(fp)) {
+        err = EIO;
+    }
+    if (fclose(fp) != 0 && err == 0) {
+        err = errno;
+    }
+    /* Only replace the old baseline with a complete one */
+    if (err == 0 && rename(tmp_path, path) != 0) {
+        err = errno;
+    }
+    if (err != 0) {
+        unlink(tmp_path);
+    }
+
+done:
+    free(shared);
+    free(tests);
+    free(tmp_path);
+    return err;
+}
+
+void tap_baseline_dtor(struct tap_baseline *baseline) {
+    if (!baseline) {
+        return;
+    }
+    for (size_t idx = 0; idx < baseline->n_entries; idx++) {
+        free(baseline->entries[idx].key);
+    }
+    free(baseline->entries);
+    free(baseline->shared);
+    free(baseline);
+}
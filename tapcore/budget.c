@@ -0,0 +1,87 @@
+/**
+ * @file budget.c
+ *
+ * Chooses the tests to run within a time budget. Tests are predicted to take
+ * their declared cost, or else their duration in the baseline. As many tests
+ * as fit in the budget over every slot are chosen, cheapest first, or the
+ * most priority for the time under TAP_SCHED_PRIORITY. Packing the slots is
+ * left to the scheduler, the deadline catches whatever was mispredicted.
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <tap.h>
+#include <taptest.h>
+
+#include "config.h"
+#include "internal.h"
+
+struct tap_budget_entry {
+    size_t idx;
+    /* Seconds, for every repetition of the test */
+    double cost;
+    double value;
+};
+
+/* Greater value for the time first, then cheaper, then registered first */
+static int tap_budget_cmp(const void *lhs, const void *rhs) {
+    const struct tap_budget_entry *lentry = lhs, *rentry = rhs;
+    double ldensity, rdensity;
+
+    /* Free tests go first, whatever their value */
+    ldensity = lentry->cost > 0 ? lentry->value / lentry->cost : INFINITY;
+    rdensity = rentry->cost > 0 ? rentry->value / rentry->cost : INFINITY;
+    if (ldensity != rdensity) {
+        return ldensity > rdensity ? -1 : 1;
+    }
+    if (lentry->cost != rentry->cost) {
+        return lentry->cost < rentry->cost ? -1 : 1;
+    }
+    return lentry->idx < rentry->idx ? -1 : 1;
+}
+
+int tap_budget_select(struct test *tests, size_t n_tests,
+                      const size_t *n_jobs, struct tap_baseline *baseline,
+                      double budget, size_t n_slots, bool by_priority,
+                      bool *fits) {
+    struct tap_budget_entry *entries;
+    double capacity = budget * n_slots, used = 0;
+
+    entries = calloc(n_tests, sizeof(*entries));
+    if (!entries) {
+        return ENOMEM;
+    }
+    for (size_t idx = 0; idx < n_tests; idx++) {
+        struct test *test = &tests[idx];
+
+        /* Learned, so the scheduler can order the tests by it as well */
+        if (test->cost == 0) {
+            test->cost = tap_baseline_ns(baseline, test) / 1e9;
+        }
+        entries[idx] = (struct tap_budget_entry){
+            .idx = idx,
+            .cost = test->cost * n_jobs[idx],
+            .value = by_priority && test->priority > 1 ? test->priority : 1,
+        };
+        fits[idx] = false;
+    }
+    qsort(entries, n_tests, sizeof(*entries), tap_budget_cmp);
+
+    for (size_t idx = 0; idx < n_tests; idx++) {
+        struct tap_budget_entry *entry = &entries[idx];
+
+        /* A test longer than the budget could only ever be cancelled */
+        if (n_jobs[entry->idx] == 0 ||
+            tests[entry->idx].cost > budget ||
+            used + entry->cost > capacity) {
+            continue;
+        }
+        used += entry->cost;
+        fits[entry->idx] = true;
+    }
+    free(entries);
+    return 0;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file concurrent.c
+ *
+ * Runs several instances of a test at the same moment, to shake out races
+ * between processes. A group leader forks the instances, which wait on a
+ * barrier in shared memory until all of them, and the leader, are ready.
+ */
+#define _GNU_SOURCE /* sched_setaffinity() */
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <tap.h>
+#include <tapio.h>
+#include <tapstruct.h>
+#include <taptest.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "internal.h"
+
+/* Instance index of this process, see tap_instance() */
+static size_t instance = 0;
+
+size_t tap_instance(void) { return instance; }
+
+/* Pin the instance to the next of the allowed CPUs, wrapping around */
+static void tap_instance_pin(size_t idx, cpu_set_t *allowed) {
+    size_t nth = idx % CPU_COUNT(allowed);
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        cpu_set_t pinned;
+
+        if (!CPU_ISSET(cpu, allowed) || nth-- > 0) {
+            continue;
+        }
+        CPU_ZERO(&pinned);
+        CPU_SET(cpu, &pinned);
+        /* Only a matter of spreading the load, carry on regardless */
+        sched_setaffinity(0, sizeof(pinned), &pinned);
+        return;
+    }
+}
+
+static void tap_instance_kill(pid_t *pids, size_t n_pids) {
+    for (size_t idx = 0; idx < n_pids; idx++) {
+        kill(pids[idx], SIGKILL);
+        waitpid(pids[idx], NULL, 0);
+    }
+}
+
+/* Comment on an instance that failed, returns whether it did */
+static bool tap_instance_failed(size_t idx, int wstatus) {
+    if (WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0) {
+        return false;
+    }
+    if (WIFSIGNALED(wstatus)) {
+        const char *sig_name = strsignal(WTERMSIG(wstatus));
+
+        printf("instance %zu terminated via %s(%d)\n", idx,
+               sig_name ? sig_name : "UNKNOWN", WTERMSIG(wstatus));
+    } else if (WIFEXITED(wstatus)) {
+        printf("instance %zu exited with status %d\n", idx,
+               WEXITSTATUS(wstatus));
+    } else {
+        printf("instance %zu exited for unknown reason\n", idx);
+    }
+    return true;
+}
+
+void tap_run_instances_and_exit(struct test *test) {
+    size_t n_instances = test->n_instances, n_failed = 0;
+    struct timespec wall_t0, wall_t1;
+    pthread_barrierattr_t attr;
+    pthread_barrier_t *barrier;
+    bool have_affinity;
+    cpu_set_t allowed;
+    struct rusage usage;
+    pid_t *pids, leader = getpid();
+    int err;
+
+    pids = calloc(n_instances, sizeof(*pids));
+    barrier = mmap(NULL, sizeof(*barrier), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (!pids || barrier == MAP_FAILED) {
+        printf("failed to set up %zu instances: %s\n", n_instances,
+               strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+
+    /* The leader waits too, releasing the instances once all are forked */
+    pthread_barrierattr_init(&attr);
+    pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    err = pthread_barrier_init(barrier, &attr, n_instances + 1);
+    pthread_barrierattr_destroy(&attr);
+    if (err != 0) {
+        printf("failed to set up barrier: %s\n", strerror(err));
+        _exit(EXIT_FAILURE);
+    }
+    have_affinity = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    for (size_t idx = 0; idx < n_instances; idx++) {
+        pids[idx] = fork();
+        if (pids[idx] == 0) {
+            int res;
+
+            instance = idx;
+            /* Go down with the leader, should the runner cancel it */
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            if (getppid() != leader) {
+                _exit(EXIT_FAILURE);
+            }
+            if (have_affinity) {
+                tap_instance_pin(idx, &allowed);
+            }
+            pthread_barrier_wait(barrier);
+            /* Timers are per process, each instance times itself */
+            tap_arm_timeout(test);
+            res = test->funct();
+            fflush(NULL);
+            _exit(res);
+        }
+        if (pids[idx] == -1) {
+            /* The barrier can never be released, the others must go */
+            printf("failed to fork instance %zu: %s\n", idx, strerror(errno));
+            tap_instance_kill(pids, idx);
+            _exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_barrier_wait(barrier);
+    clock_gettime(CLOCK_MONOTONIC, &wall_t0);
+    for (size_t idx = 0; idx < n_instances; idx++) {
+        int wstatus;
+
+        while (waitpid(pids[idx], &wstatus, 0) == -1 && errno == EINTR)
+            ;
+        n_failed += tap_instance_failed(idx, wstatus);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &wall_t1);
+
+    /* From the release to the last instance exiting, CPU of them all */
+    getrusage(RUSAGE_CHILDREN, &usage);
+    tap_send_timing(&wall_t0, &wall_t1,
+                    (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+                            1000000000ull +
+                        (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) *
+                            1000ull);
+    fflush(NULL);
+    _exit(n_failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,577 @@
+/**
+ * @file driver.c
+ *
+ * unitestap-driver runs the tests of many uniTesTap programs through one pool
+ * of runner slots, instead of each program sizing a pool of its own. Every
+ * program is asked for its tests, see TAP_ENV_LIST, then each test is run on
+ * its own via TAP_ENV_RUN. Results are reported as one TAP stream per program,
+ * in the order the programs were given.
+ */
+#define _GNU_SOURCE /* asprintf(), basename() */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <tap.h>
+#include <tapio.h>
+#include <tapstruct.h>
+#include <taptest.h>
+#include <taputil.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "internal.h"
+
+#define DRIVER_MAX_SLOTS 32
+
+struct driver_program;
+
+struct driver_job {
+    struct driver_program *program;
+    struct test test;
+    struct test_run run;
+    /* Comments on the test, held back until its program is reported */
+    tap_string_t comments;
+    struct tap_reporter *buffer;
+    bool started;
+    bool done;
+};
+
+struct driver_program {
+    const char *path;
+    struct driver_job *jobs;
+    size_t n_jobs;
+    /* Index of the next job to start */
+    size_t next_job;
+    size_t n_running;
+    bool bailed;
+    /* Error listing the tests, if any */
+    int err;
+};
+
+/* Test the next forked runner child is to exec, see driver_exec_test() */
+static const char *exec_path;
+static char exec_id[TAP_UINT_FMT_LEN];
+
+/* Resources named by the tests of every program, a port is as much in use by
+ * one program's test as by another's */
+static struct tap_resources resources;
+
+static int driver_exec_test(void) {
+    int err;
+
+    setenv(TAP_ENV_RUN, exec_id, 1);
+    execl(exec_path, exec_path, (char *)NULL);
+    err = errno;
+    fprintf(stderr, "failed to run %s: %s(%d)\n", exec_path, strerror(err),
+            err);
+    return err;
+}
+
+static int driver_buffer_comment(void *priv, struct test *test,
+                                 const char *line) {
+    tap_string_t *comments = priv;
+    int err;
+
+    err = tap_string_concat(comments, line);
+    if (err == 0) {
+        err = tap_string_concat(comments, "\n");
+    }
+    return err;
+}
+
+static int driver_buffer_comment_lines(void *priv, struct test *test,
+                                       const char *lines, size_t len) {
+    tap_string_t *comments = priv;
+    int err;
+
+    err = tap_string_concat_len(comments, lines, len);
+    if (err == 0) {
+        err = tap_string_concat(comments, "\n");
+    }
+    return err;
+}
+
+static const struct tap_reporter_ops driver_buffer_ops = {
+    .comment = driver_buffer_comment,
+    .comment_lines = driver_buffer_comment_lines,
+};
+
+static int driver_add_job(struct driver_program *program, size_t id,
+                          const char *spec, const char *description) {
+    struct driver_job *jobs, *job;
+    int err;
+
+    jobs = realloc(program->jobs, (program->n_jobs + 1) * sizeof(*jobs));
+    if (!jobs) {
+        return errno;
+    }
+    program->jobs = jobs;
+    job = &jobs[program->n_jobs];
+    *job = (struct driver_job){
+        .program = program,
+        .test =
+            {
+                .id = id,
+                .funct = driver_exec_test,
+                .n_instances = 1,
+            },
+        .run = {.outfd = -1, .pid = -1},
+    };
+    err = tap_resources_parse(&resources, spec, &job->test.resources);
+    if (err != 0) {
+        return err;
+    }
+    if (*description) {
+        job->test.description = strdup(description);
+        if (!job->test.description) {
+            return errno;
+        }
+    }
+    program->n_jobs++;
+    return 0;
+}
+
+/* Parse the "<id>\t<resources>\t<description>" lines of the program's test
+ * list */
+static int driver_read_list(struct driver_program *program, FILE *fp) {
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    int err = 0;
+
+    while (err == 0 && (len = getline(&line, &size, fp)) != -1) {
+        unsigned long id;
+        char *end, *spec;
+
+        if (len > 0 && line[len - 1] == '\n') {
+            line[len - 1] = '\0';
+        }
+        id = strtoul(line, &end, 10);
+        /* Tests are listed in order, anything else is not a test list */
+        if (*end != '\t' || id != program->n_jobs + 1) {
+            err = EPROTO;
+            break;
+        }
+        spec = end + 1;
+        end = strchr(spec, '\t');
+        if (!end) {
+            err = EPROTO;
+            break;
+        }
+        *end = '\0';
+        err = driver_add_job(program, id, spec, end + 1);
+    }
+    free(line);
+    return err;
+}
+
+static int driver_list(struct driver_program *program) {
+    int pipefd[2];
+    int status, err;
+    pid_t pid;
+    FILE *fp;
+
+    err = tap_pipe_setup(pipefd);
+    if (err != 0) {
+        return err;
+    }
+
+    tap_out_flush();
+    fflush(NULL);
+    pid = fork();
+    if (pid == 0) {
+        close(pipefd[TAP_PIPE_RX]);
+        dup2(pipefd[TAP_PIPE_TX], STDOUT_FILENO);
+        close(pipefd[TAP_PIPE_TX]);
+        setenv(TAP_ENV_LIST, "1", 1);
+        execl(program->path, program->path, (char *)NULL);
+        _exit(errno);
+    }
+    if (pid == -1) {
+        err = errno;
+        close(pipefd[TAP_PIPE_RX]);
+        close(pipefd[TAP_PIPE_TX]);
+        return err;
+    }
+    close(pipefd[TAP_PIPE_TX]);
+
+    fp = fdopen(pipefd[TAP_PIPE_RX], "r");
+    if (!fp) {
+        err = errno;
+        close(pipefd[TAP_PIPE_RX]);
+    } else {
+        err = driver_read_list(program, fp);
+        fclose(fp);
+    }
+
+    if (waitpid(pid, &status, 0) == -1) {
+        return err ? err : errno;
+    }
+    if (err == 0 && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+        /* A failed exec exits with its errno */
+        err = WIFEXITED(status) ? WEXITSTATUS(status) : ECHILD;
+    }
+    return err;
+}
+
+/* Whether every test the program is going to run has finished */
+static bool driver_program_done(struct driver_program *program) {
+    return program->n_running == 0 &&
+           (program->bailed || program->next_job == program->n_jobs);
+}
+
+static int driver_open_output(struct driver_program *program,
+                              const char *out_dir, int *d_fd) {
+    char *path;
+    int err = 0;
+
+    if (asprintf(&path, "%s/%s.tap", out_dir, basename(program->path)) ==
+        -1) {
+        return ENOMEM;
+    }
+    *d_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (*d_fd == -1) {
+        err = errno;
+        fprintf(stderr, "failed to open %s: %s(%d)\n", path, strerror(err),
+                err);
+    }
+    free(path);
+    return err;
+}
+
+/* Report the program's finished tests as a TAP stream, to stdout unless
+ * out_dir is set. Sets d_failed if anything failed */
+static int driver_report(struct driver_program *program, const char *out_dir,
+                         bool *d_failed) {
+    struct tap_reporter *reporters;
+    int fd = -1;
+    int err;
+
+    if (out_dir) {
+        err = driver_open_output(program, out_dir, &fd);
+        if (err != 0) {
+            *d_failed = true;
+            return err;
+        }
+        tap_out_set_fd(fd);
+    }
+
+    err = tap_reporter_tap_ctor(&reporters);
+    if (err != 0) {
+        goto done;
+    }
+    if (!out_dir) {
+        /* Tell the programs apart when their streams share stdout */
+        tap_report_comment(reporters, NULL, "%s", program->path);
+    }
+    if (program->err != 0) {
+        tap_report_bailout(reporters, "failed to list tests of %s: %s(%d)",
+                           program->path, strerror(program->err),
+                           program->err);
+        *d_failed = true;
+    } else {
+        tap_report_plan(reporters, program->n_jobs);
+    }
+
+    /* Report test runs up to the first bail */
+    for (size_t idx = 0; idx < program->n_jobs; idx++) {
+        struct driver_job *job = &program->jobs[idx];
+        struct test_run *run = &job->run;
+
+        if (!job->done) {
+            break;
+        }
+        run->reporters = reporters;
+        if (job->comments.len > 0) {
+            tap_report_comment_lines(reporters, &run->test,
+                                     job->comments.data, job->comments.len);
+        }
+        if (tap_cmd_is_bailed(run->cmd)) {
+            tap_report_bailout(reporters, "%s", tap_bailout_reason(run->cmd));
+            *d_failed = true;
+            break;
+        }
+        tap_report_testrun(run, NULL, NULL);
+        if (!tap_cmd_is_directive(run->cmd) && !tap_testrun_passed(run)) {
+            *d_failed = true;
+        }
+    }
+    err = tap_report_finish(reporters);
+    tap_reporters_dtor(reporters);
+
+done:
+    if (fd != -1) {
+        tap_out_set_fd(STDOUT_FILENO);
+        close(fd);
+    }
+    return err;
+}
+
+static bool driver_jobs_left(struct driver_program *programs,
+                             size_t n_programs) {
+    for (size_t idx = 0; idx < n_programs; idx++) {
+        struct driver_program *program = &programs[idx];
+
+        if (!program->bailed && program->next_job < program->n_jobs) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Next job to start, the first whose resources are free in program order */
+static struct driver_job *driver_next_job(struct driver_program *programs,
+                                          size_t n_programs) {
+    for (size_t idx = 0; idx < n_programs; idx++) {
+        struct driver_program *program = &programs[idx];
+
+        for (size_t jdx = program->next_job;
+             !program->bailed && jdx < program->n_jobs; jdx++) {
+            struct driver_job *job = &program->jobs[jdx];
+
+            if (!job->started &&
+                tap_resources_available(&resources, &job->test)) {
+                return job;
+            }
+        }
+    }
+    return NULL;
+}
+
+static int driver_start(struct driver_job *job, struct test_run *run) {
+    int err;
+
+    /* Not before, the jobs move while they are being listed */
+    tap_string_init(&job->comments);
+    job->started = true;
+    err = tap_reporter_ctor(&driver_buffer_ops, &job->comments, &job->buffer);
+    if (err != 0) {
+        return err;
+    }
+    exec_path = job->program->path;
+    snprintf(exec_id, sizeof(exec_id), "%zu", job->test.id);
+    err = tap_start_testrun(&job->test, NULL, job->buffer, NULL, run);
+    if (err != 0) {
+        return err;
+    }
+    tap_resources_acquire(&resources, &job->test);
+    job->program->n_running++;
+    for (struct driver_program *program = job->program;
+         program->next_job < program->n_jobs &&
+         program->jobs[program->next_job].started;
+         program->next_job++)
+        ;
+    return 0;
+}
+
+static int driver_run(struct driver_program *programs, size_t n_programs,
+                      size_t n_slots, struct tap_jobserver *jobserver,
+                      const char *out_dir, bool *d_failed) {
+    struct test_run running[DRIVER_MAX_SLOTS];
+    struct driver_job *slot_jobs[DRIVER_MAX_SLOTS] = {0};
+    struct pollfd fds[DRIVER_MAX_SLOTS + 1];
+    struct tap_stats stats = {0};
+    size_t n_running = 0, next_report = 0;
+    bool need_token;
+    int err = 0;
+
+    for (size_t slot = 0; slot < n_slots; slot++) {
+        running[slot] = (struct test_run){.outfd = -1, .pid = -1};
+    }
+
+    while (true) {
+        /* Programs are reported in order, as soon as they are done */
+        for (; next_report < n_programs &&
+               driver_program_done(&programs[next_report]);
+             next_report++) {
+            driver_report(&programs[next_report], out_dir, d_failed);
+        }
+        if (n_running == 0 &&
+            (err != 0 || !driver_jobs_left(programs, n_programs))) {
+            break;
+        }
+
+        /* Start tests in any free slots */
+        need_token = false;
+        for (size_t slot = 0; err == 0 && slot < n_slots; slot++) {
+            struct driver_job *job;
+
+            if (slot_jobs[slot]) {
+                continue;
+            }
+            if (!tap_jobserver_reserve(jobserver, n_running)) {
+                need_token = true;
+                break;
+            }
+            job = driver_next_job(programs, n_programs);
+            if (!job) {
+                /* Whatever is left waits on a resource */
+                break;
+            }
+            err = driver_start(job, &running[slot]);
+            if (err != 0) {
+                break;
+            }
+            slot_jobs[slot] = job;
+            n_running++;
+        }
+
+        tap_jobserver_fit(jobserver, n_running);
+
+        if (n_running > 0) {
+            err = tap_wait_for_testrun(
+                running, n_slots, fds,
+                need_token ? tap_jobserver_fd(jobserver) : -1, NULL, NULL,
+                &stats);
+            if (err != 0) {
+                break;
+            }
+        }
+
+        for (size_t slot = 0; slot < n_slots; slot++) {
+            struct driver_job *job = slot_jobs[slot];
+
+            if (!job || !running[slot].exited) {
+                continue;
+            }
+            job->run = running[slot];
+            job->done = true;
+            tap_resources_release(&resources, &job->test);
+            job->program->n_running--;
+            if (tap_cmd_is_bailed(job->run.cmd)) {
+                job->program->bailed = true;
+            }
+            running[slot] = (struct test_run){.outfd = -1, .pid = -1};
+            slot_jobs[slot] = NULL;
+            n_running--;
+        }
+    }
+
+    /* Give up on whatever is left after an error */
+    for (size_t slot = 0; slot < n_slots; slot++) {
+        if (slot_jobs[slot]) {
+            kill(running[slot].pid, SIGKILL);
+            waitpid(running[slot].pid, NULL, 0);
+            tap_cleanup_testrun(&running[slot]);
+        }
+    }
+    return err;
+}
+
+static void driver_cleanup(struct driver_program *programs,
+                           size_t n_programs) {
+    for (size_t idx = 0; idx < n_programs; idx++) {
+        struct driver_program *program = &programs[idx];
+
+        for (size_t jdx = 0; jdx < program->n_jobs; jdx++) {
+            struct driver_job *job = &program->jobs[jdx];
+
+            if (job->done) {
+                tap_cleanup_testrun(&job->run);
+            }
+            if (job->started) {
+                tap_reporters_dtor(job->buffer);
+                tap_string_fini(&job->comments);
+            }
+            free(job->test.description);
+        }
+        free(program->jobs);
+    }
+    free(programs);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-j N] [-o DIR] PROGRAM...\n"
+            "Run the tests of uniTesTap PROGRAMs through one pool of runners\n"
+            "\n"
+            "  -j N    run up to N tests at once, default one per core but"
+            " one\n"
+            "  -o DIR  write each PROGRAM's TAP to DIR/<PROGRAM>.tap instead"
+            " of stdout\n",
+            name);
+}
+
+int main(int argc, char **argv) {
+    struct tap_jobserver *jobserver = NULL;
+    struct driver_program *programs;
+    const char *out_dir = NULL;
+    size_t n_programs, n_slots;
+    long n_jobs = 0;
+    bool failed = false;
+    int opt, err;
+
+    while ((opt = getopt(argc, argv, "j:o:h")) != -1) {
+        switch (opt) {
+            case 'j':
+                n_jobs = strtol(optarg, NULL, 10);
+                if (n_jobs < 1) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'o':
+                out_dir = optarg;
+                break;
+            case 'h':
+                usage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    n_slots = n_jobs;
+    if (n_slots == 0) {
+        /* Same default as tap_runall(), but for every program at once */
+        n_slots = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    }
+    if (n_slots < 1) {
+        n_slots = 1;
+    }
+    if (n_slots > DRIVER_MAX_SLOTS) {
+        n_slots = DRIVER_MAX_SLOTS;
+    }
+
+    n_programs = argc - optind;
+    programs = calloc(n_programs, sizeof(*programs));
+    if (!programs) {
+        perror("failed to allocate programs");
+        return EXIT_FAILURE;
+    }
+    for (size_t idx = 0; idx < n_programs; idx++) {
+        programs[idx].path = argv[optind + idx];
+        programs[idx].err = driver_list(&programs[idx]);
+        /* Nothing is run of a program that could not be listed */
+        programs[idx].bailed = programs[idx].err != 0;
+    }
+
+    /* Under make, the tests share make's job slots rather than the host */
+    err = tap_jobserver_ctor(n_slots, &jobserver);
+    if (err != 0 && err != ENOENT) {
+        fprintf(stderr, "failed to join make's jobserver: %s(%d)\n",
+                strerror(err), err);
+    }
+    err = driver_run(programs, n_programs, n_slots, jobserver, out_dir,
+                     &failed);
+    if (err != 0) {
+        fprintf(stderr, "internal test runner error %s(%d)\n", strerror(err),
+                err);
+        failed = true;
+    }
+    driver_cleanup(programs, n_programs);
+    tap_resources_fini(&resources);
+    tap_jobserver_dtor(jobserver);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -2,24 +2,385 @@
 #define __INTERNAL_H__
 #include <poll.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <tap.h>
+#include <tapio.h>
 #include <tapstruct.h>
 #include <taptest.h>
+#include <time.h>
+
+struct tap_trace;
+
+/* Limits on what a test's output may cost the runner, zero is unlimited */
+struct tap_output_opts {
+    size_t max_bytes;
+    size_t max_lines;
+    /* Output past the limits goes to <spill_dir>/test-<id>.log, if set */
+    const char *spill_dir;
+    bool collapse_repeats;
+};
+
+/* Accounting of the comment lines a test has printed */
+struct test_output {
+    size_t n_lines;
+    size_t n_bytes;
+    size_t n_over_lines;
+    size_t n_over_bytes;
+    FILE *spill;
+    /* Copy of the last reported line, and how often it was repeated since */
+    char *last_line;
+    size_t last_line_len;
+    size_t last_line_size;
+    size_t n_repeats;
+};
 
 struct test_run {
     struct test test;
+    struct tap_reporter *reporters;
+    const struct tap_output_opts *output_opts;
+    struct test_output output;
+    /* Backs cmd and subtests, freed in bulk when the run is cleaned up */
+    tap_arena_t *arena;
     tap_cmd_t *cmd;
+    /* Assertions reported by the test, in order, linked via next */
+    tap_cmd_t *subtests;
+    tap_cmd_t *last_subtest;
     pid_t pid;
     int outfd;
+    /* Output read from outfd that does not yet end in a newline */
+    char *outbuf;
+    size_t outbuf_len;
+    size_t outbuf_size;
     int exitstatus;
     struct tap_duration duration;
+    /* When fork() returned in the runner, ending the fork phase */
+    struct timespec forked;
+    /* When the runner first saw the test close its output */
+    struct timespec hup;
+    size_t n_bytes_read;
+    /* Time spent processing the test's output */
+    uint64_t format_ns;
+    /* Timing taken around the test function itself, when it reported it */
+    bool timed;
+    struct tap_duration test_wall;
+    struct tap_duration test_cpu;
+    /* 1 + the runner slot the test was reaped from, 0 if it ran in none */
+    size_t slot;
+    /* Peak resident memory of the test's process in bytes, 0 if unmeasured */
+    size_t max_rss;
+    /* Killed by the runner once the time budget ran out */
+    bool cancelled;
+    /* Taken from the journal of an earlier run, see tap_journal_replay() */
+    bool replayed;
     bool exited;
+    bool inprocess;
 };
 
-int tap_start_testrun(struct test *test, struct test_run *testrun);
+/* Progress of tap_runall(), written out to path if set */
+struct tap_status {
+    const char *path;
+    struct timespec start;
+    size_t n_tests;
+    size_t n_queued;
+    size_t n_completed;
+    size_t n_failed;
+    size_t n_skipped;
+    struct test_run *running;
+    size_t n_slots;
+    struct timespec last_write;
+    bool written;
+};
+
+/* limits are the runner's, merged into the test's own, NULL for none */
+int tap_start_testrun(struct test *test, const struct tap_limits *limits,
+                      struct tap_reporter *reporters,
+                      const struct tap_output_opts *output_opts,
+                      struct test_run *testrun);
 
+/* test_poll has room for n_runs + 1 fds. Also returns once wake_fd is
+ * readable, unless it is -1, and by the CLOCK_MONOTONIC deadline, unless it
+ * is NULL */
 int tap_wait_for_testrun(struct test_run *testruns, size_t n_runs,
-                         struct pollfd *test_poll);
+                         struct pollfd *test_poll, int wake_fd,
+                         const struct timespec *deadline,
+                         struct tap_trace *trace, struct tap_stats *stats);
 
 void tap_cleanup_testrun(struct test_run *testrun);
 
+/* buf must be writable with buf[len] == '\0', lines are split in place */
+int tap_process_testrun_buffer(struct test_run *testrun, char *buf,
+                               size_t len);
+
+/* Path of the file the output of test id past the limits is spilled to */
+int tap_output_spill_path(const struct tap_output_opts *opts, size_t id,
+                          char *path, size_t path_len);
+
+/* Process output of the test that was not read from its outfd, e.g. sent by a
+ * worker. Incomplete lines are kept for the next call, at EOF the output is
+ * finished */
+int tap_process_testrun_data(struct test_run *testrun, const char *data,
+                             size_t len, bool at_eof);
+
+/* The engine process is limited by the runner's limits, which leave all but
+ * core dumps unlimited */
+int tap_run_threaded(struct test *tests, size_t n_tests,
+                     unsigned int n_threads, const struct tap_limits *limits,
+                     struct tap_reporter *reporters,
+                     const struct tap_output_opts *output_opts,
+                     struct test_run *runs);
+
+/* Lease the tests to workers connecting to address, until they are done or
+ * no worker was connected for wait seconds. Tests holding resources, and
+ * tests that lost their lease too often, are left unfinished in runs */
+int tap_run_remote(struct test *tests, size_t n_tests, const char *address,
+                   double wait, const struct tap_limits *limits,
+                   struct tap_reporter *reporters,
+                   const struct tap_output_opts *output_opts,
+                   struct test_run *runs);
+
+/* Serve the runner at address as a worker, over n_conns connections */
+int tap_remote_work(struct test *tests, size_t n_tests,
+                    const struct tap_limits *limits, const char *address,
+                    size_t n_conns);
+
+/* Write out a snapshot of status, at most every 250ms unless forced */
+int tap_status_update(struct tap_status *status, bool force);
+
+int tap_trace_ctor(const char *path, size_t n_slots,
+                   struct tap_trace **d_trace);
+
+/* The trace functions do nothing given a NULL trace */
+void tap_trace_wakeup(struct tap_trace *trace, int n_ready);
+
+void tap_trace_testrun(struct tap_trace *trace, struct test_run *run);
+
+void tap_trace_threaded(struct tap_trace *trace, struct test_run *run);
+
+void tap_trace_reported(struct tap_trace *trace, struct test_run *run);
+
+int tap_trace_dtor(struct tap_trace *trace);
+
+/* Environment variables of the protocol a driver uses to run the tests of a
+ * program one at a time. With TAP_ENV_LIST set, tap_runall() lists the tests
+ * as "<id>\t<resources>\t<description>" lines and exits, see
+ * tap_resources_format(). With TAP_ENV_RUN set to an id, it runs that test
+ * alone, as the runner's child would, and exits */
+#define TAP_ENV_LIST "UNITESTAP_LIST"
+#define TAP_ENV_RUN "UNITESTAP_RUN"
+
+/* Address of the runner a worker leases its tests from, see remote.c. With
+ * it set, tap_runall() connects n_slots times, running a leased test at a
+ * time over each connection, then exits */
+#define TAP_ENV_WORKER "UNITESTAP_WORKER"
+
+/* Run the test in the calling process, as the runner's forked child */
+void tap_run_test_and_exit(struct test *test) __attribute__((noreturn));
+
+/* Fill the limits left zero with the runner's, which may be NULL */
+void tap_limits_merge(struct tap_limits *limits,
+                      const struct tap_limits *runner);
+
+/* Whether limits has anything besides core dumps limited */
+bool tap_limits_set(const struct tap_limits *limits);
+
+/* Limit the calling process, before it runs a test */
+void tap_limits_apply(const struct tap_limits *limits);
+
+/* Terminate the calling process with SIGALRM once the test's timeout is up */
+void tap_arm_timeout(struct test *test);
+
+/* Tell the runner how long the test took, see tap_run_test_and_exit() */
+void tap_send_timing(struct timespec *wall_t0, struct timespec *wall_t1,
+                     uint64_t cpu_ns);
+
+/* Run the n_instances of a concurrent test, released together, from a forked
+ * child. Exits with the combined result */
+void tap_run_instances_and_exit(struct test *test) __attribute__((noreturn));
+
+/* Zero if t1 is before t0 */
+uint64_t tap_timespec_diff_ns(const struct timespec *t0,
+                              const struct timespec *t1);
+
+void tap_histogram_add(struct tap_histogram *hist, uint64_t value);
+
+/* Account for the overheads of a finished test run */
+void tap_stats_testrun(struct tap_stats *stats, struct test_run *run);
+
+int tap_stats_report(struct tap_stats *stats, struct tap_reporter *reporters);
+
+struct tap_baseline_opts {
+    /* Durations to compare with, NULL to not compare */
+    const char *path;
+    /* Durations to save for later runs, NULL to not save */
+    const char *save_path;
+    /* Relative slowdown, 0.5 flags tests taking over 1.5 times as long */
+    double threshold;
+    /* Seconds a test may get slower by without being flagged */
+    double noise_floor;
+    /* Fail slower tests as TODO, instead of only commenting on them */
+    bool todo;
+};
+
+struct tap_baseline;
+
+/* Durations from opts->path, of the tests about to be run */
+int tap_baseline_ctor(const struct tap_baseline_opts *opts,
+                      struct test *tests, size_t n_tests,
+                      struct tap_baseline **d_baseline);
+
+/* Duration of the test in the baseline, 0 if it has none */
+uint64_t tap_baseline_ns(struct tap_baseline *baseline, struct test *test);
+
+/* Peak memory of the test in the baseline, 0 if it has none */
+size_t tap_baseline_memory(struct tap_baseline *baseline, struct test *test);
+
+/* Whether duration is a regression from the test's baseline, if it has one.
+ * d_base is set to the baseline of a regressed test */
+bool tap_baseline_regressed(struct tap_baseline *baseline, struct test *test,
+                            struct tap_duration *duration,
+                            struct tap_duration *d_base);
+
+int tap_baseline_save(const char *path, struct test_run *runs, size_t n_runs);
+
+void tap_baseline_dtor(struct tap_baseline *baseline);
+
+#define TAP_MAX_RESOURCES 64
+
+/* Resources named by the registered tests, indexed by a test's resource bits */
+struct tap_resources {
+    char *names[TAP_MAX_RESOURCES];
+    size_t capacity[TAP_MAX_RESOURCES];
+    /* Units held by the running tests */
+    size_t n_held[TAP_MAX_RESOURCES];
+    size_t n_resources;
+    /* Memory the running tests expect to use, 0 for no budget */
+    size_t memory_budget;
+    size_t memory_held;
+};
+
+/* Add the resources of a "name:capacity,..." spec, setting their bits */
+int tap_resources_parse(struct tap_resources *res, const char *spec,
+                        uint64_t *d_mask);
+
+/* Write the resources of mask as a spec tap_resources_parse() reads back */
+int tap_resources_format(struct tap_resources *res, uint64_t mask,
+                         tap_string_t *tstr);
+
+/* Whether the test can start beside the running tests, with its resources and
+ * memory */
+bool tap_resources_available(struct tap_resources *res, struct test *test);
+
+void tap_resources_acquire(struct tap_resources *res, struct test *test);
+
+void tap_resources_release(struct tap_resources *res, struct test *test);
+
+void tap_resources_fini(struct tap_resources *res);
+
+/* Set fits for the tests chosen to run within budget seconds over n_slots,
+ * n_jobs being the jobs of each test. Tests without a cost take theirs from
+ * the baseline, which may be NULL */
+int tap_budget_select(struct test *tests, size_t n_tests,
+                      const size_t *n_jobs, struct tap_baseline *baseline,
+                      double budget, size_t n_slots, bool by_priority,
+                      bool *fits);
+
+/* How tap_runall() chooses the next test to start */
+struct tap_sched {
+    TAP_SCHED policy;
+    /* Overrides the policy when set */
+    tap_pick_t pick;
+    void *priv;
+};
+
+/* Index of the test to start next, from first on, among those with jobs left
+ * and their resources free. n_tests if none is to start yet. idle is set when
+ * no test is running */
+size_t tap_sched_pick(const struct tap_sched *sched, struct test *tests,
+                      size_t n_tests, const size_t *n_left, size_t first,
+                      struct tap_resources *res, bool idle);
+
+struct tap_jobserver;
+
+/* Join the jobserver of the make running this program, ENOENT if none */
+int tap_jobserver_ctor(size_t max_tokens, struct tap_jobserver **d_js);
+
+/* Hold the tokens to start a test beside n_running others, false if make has
+ * none to spare. Always true without a jobserver */
+bool tap_jobserver_reserve(struct tap_jobserver *js, size_t n_running);
+
+/* Readable when a token may be available, -1 if there is nothing to wait on */
+int tap_jobserver_fd(struct tap_jobserver *js);
+
+/* Give back the tokens not needed by n_running tests */
+void tap_jobserver_fit(struct tap_jobserver *js, size_t n_running);
+
+void tap_jobserver_dtor(struct tap_jobserver *js);
+
+struct tap_journal;
+
+/* Open the journal at path for n_tests tests. When resuming, the results of
+ * the same build of the program already in it are kept, else it starts over */
+int tap_journal_ctor(const char *path, bool resume, size_t n_tests,
+                     struct tap_journal **d_journal);
+
+/* Fill run with the journaled result of test, ENOENT if there is none */
+int tap_journal_replay(struct tap_journal *journal, struct test *test,
+                       struct tap_reporter *reporters,
+                       const struct tap_output_opts *output_opts,
+                       struct test_run *run);
+
+/* Append the finished run, does nothing given a NULL journal */
+void tap_journal_add(struct tap_journal *journal, struct test_run *run);
+
+/* Sync and close the journal, EIO if any write to it failed */
+int tap_journal_dtor(struct tap_journal *journal);
+
+/* Report the finished test run, a baseline is optional */
+int tap_report_testrun(struct test_run *run, struct tap_baseline *baseline,
+                       const struct tap_baseline_opts *baseline_opts);
+
+/* Repetitions of one test, see TAP_OPTION_REPEAT */
+struct tap_repeat {
+    size_t n_reps;
+    size_t n_done;
+    size_t n_passed;
+    /* Duration of each finished repetition */
+    uint64_t *ns;
+    /* The repetition to report in full, once n_done > 0 */
+    struct test_run kept;
+};
+
+/* Times test is to be run, 1 unless it is selected for repeating */
+size_t tap_repeat_count(size_t n_repeats, const char *filter,
+                        struct test *test);
+
+int tap_repeat_ctor(size_t n_reps, struct tap_repeat *rep);
+
+/* Account for a finished repetition, taking ownership of run */
+void tap_repeat_add(struct tap_repeat *rep, struct test_run *run);
+
+/* Comment on the pass rate and spread of durations of the repetitions */
+int tap_repeat_report(struct tap_repeat *rep, struct tap_reporter *reporters,
+                      struct test *test);
+
+void tap_repeat_dtor(struct tap_repeat *rep);
+
+/* Exited successfully without any failed assertion */
+bool tap_testrun_passed(struct test_run *run);
+
+/* Reason given by a bailed test, without the bail out marker */
+const char *tap_bailout_reason(tap_cmd_t *cmd);
+
+/* The test's own wall time if it was reported, otherwise the runner's view */
+static inline struct tap_duration *tap_testrun_duration(struct test_run *run) {
+    return run->timed ? &run->test_wall : &run->duration;
+}
+
+/* Report the n_slowest tests, and how well runs were spread over n_slots in
+ * the suite's wall time */
+int tap_report_summary(struct test_run *runs, size_t n_runs, size_t n_slots,
+                       struct tap_duration *suite, size_t n_slowest,
+                       struct tap_reporter *reporters);
+
 #endif /* __INTERNAL_H__ */
@@ -0,0 +1,215 @@
+/**
+ * @file jobserver.c
+ *
+ * Client of the GNU make jobserver, so the tests of every program run by one
+ * `make -jN check` share make's N job slots. Each process has one implicit
+ * token, every further test running at once holds a token read from the
+ * jobserver, written back once the test is reaped.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "internal.h"
+
+struct tap_jobserver {
+    int rfd;
+    int wfd;
+    /* The write end is make's own in the pipe form, only the fifo's is ours */
+    bool close_wfd;
+    /* Make went away, run as if there was no jobserver */
+    bool broken;
+    /* Tokens are written back as they were read, make may tell them apart */
+    char *tokens;
+    size_t n_held;
+    size_t max_tokens;
+};
+
+/* The value of the last jobserver option in MAKEFLAGS, NULL if none */
+static char *tap_jobserver_auth(const char *makeflags) {
+    static const char *const options[] = {"--jobserver-auth=",
+                                          "--jobserver-fds="};
+    const char *pos = makeflags, *auth = NULL;
+    size_t auth_len = 0;
+
+    while (*pos) {
+        size_t word_len;
+
+        pos += strspn(pos, " ");
+        word_len = strcspn(pos, " ");
+        /* Variable overrides follow, they are not options */
+        if (word_len == 2 && strncmp(pos, "--", 2) == 0) {
+            break;
+        }
+        for (size_t idx = 0; idx < sizeof(options) / sizeof(*options); idx++) {
+            size_t opt_len = strlen(options[idx]);
+
+            if (word_len > opt_len &&
+                strncmp(pos, options[idx], opt_len) == 0) {
+                auth = pos + opt_len;
+                auth_len = word_len - opt_len;
+            }
+        }
+        pos += word_len;
+    }
+    return auth ? strndup(auth, auth_len) : NULL;
+}
+
+static int tap_jobserver_open_fifo(struct tap_jobserver *js,
+                                   const char *path) {
+    js->rfd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (js->rfd == -1) {
+        return errno;
+    }
+    /* Does not block, the read end above is already open */
+    js->wfd = open(path, O_WRONLY | O_CLOEXEC);
+    if (js->wfd == -1) {
+        int err = errno;
+
+        close(js->rfd);
+        return err;
+    }
+    js->close_wfd = true;
+    return 0;
+}
+
+/* Whether fd is open for access, one of O_RDONLY or O_WRONLY, and a pipe */
+static bool tap_jobserver_is_pipe(int fd, int access, struct stat *st) {
+    int flags;
+
+    flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || (flags & O_ACCMODE) != access) {
+        return false;
+    }
+    return fstat(fd, st) == 0 && S_ISFIFO(st->st_mode);
+}
+
+static int tap_jobserver_open_pipe(struct tap_jobserver *js, const char *fds) {
+    struct stat rst, wst;
+    char path[32];
+    int rfd, wfd;
+
+    if (sscanf(fds, "%d,%d", &rfd, &wfd) != 2 || rfd < 0 || wfd < 0) {
+        return EINVAL;
+    }
+    /* Make only passes the pipe on to recipes it knows run make, other recipes
+     * still see the option with the fds closed or reused for something else */
+    if (!tap_jobserver_is_pipe(rfd, O_RDONLY, &rst) ||
+        !tap_jobserver_is_pipe(wfd, O_WRONLY, &wst) ||
+        rst.st_dev != wst.st_dev || rst.st_ino != wst.st_ino) {
+        return ENOENT;
+    }
+    /* Reopened to read without blocking, leaving make's pipe blocking */
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", rfd);
+    js->rfd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (js->rfd == -1) {
+        return errno;
+    }
+    js->wfd = wfd;
+    return 0;
+}
+
+int tap_jobserver_ctor(size_t max_tokens, struct tap_jobserver **d_js) {
+    struct tap_jobserver *js;
+    const char *makeflags;
+    char *auth;
+    int err;
+
+    makeflags = getenv("MAKEFLAGS");
+    auth = makeflags ? tap_jobserver_auth(makeflags) : NULL;
+    if (!auth) {
+        return ENOENT;
+    }
+
+    js = calloc(1, sizeof(*js));
+    if (js) {
+        js->tokens = calloc(max_tokens ? max_tokens : 1, 1);
+    }
+    if (!js || !js->tokens) {
+        err = ENOMEM;
+        goto failed;
+    }
+    js->max_tokens = max_tokens;
+    if (strncmp(auth, "fifo:", 5) == 0) {
+        err = tap_jobserver_open_fifo(js, auth + 5);
+    } else {
+        err = tap_jobserver_open_pipe(js, auth);
+    }
+    if (err != 0) {
+        goto failed;
+    }
+    free(auth);
+    *d_js = js;
+    return 0;
+
+failed:
+    if (js) {
+        free(js->tokens);
+    }
+    free(js);
+    free(auth);
+    return err;
+}
+
+bool tap_jobserver_reserve(struct tap_jobserver *js, size_t n_running) {
+    ssize_t n_read;
+
+    if (!js || js->broken || n_running <= js->n_held) {
+        return true;
+    }
+    if (js->n_held >= js->max_tokens) {
+        return false;
+    }
+    do {
+        n_read = read(js->rfd, &js->tokens[js->n_held], 1);
+    } while (n_read == -1 && errno == EINTR);
+    if (n_read == 0) {
+        js->broken = true;
+        return true;
+    }
+    if (n_read != 1) {
+        return false;
+    }
+    js->n_held++;
+    return true;
+}
+
+int tap_jobserver_fd(struct tap_jobserver *js) {
+    return js && !js->broken ? js->rfd : -1;
+}
+
+void tap_jobserver_fit(struct tap_jobserver *js, size_t n_running) {
+    if (!js) {
+        return;
+    }
+    while (js->n_held > 0 && js->n_held + 1 > n_running) {
+        ssize_t n_written;
+
+        n_written = write(js->wfd, &js->tokens[js->n_held - 1], 1);
+        if (n_written == -1 && errno == EINTR) {
+            continue;
+        }
+        /* Nothing to do about a lost token, make reports those itself */
+        js->n_held--;
+    }
+}
+
+void tap_jobserver_dtor(struct tap_jobserver *js) {
+    if (!js) {
+        return;
+    }
+    tap_jobserver_fit(js, 0);
+    close(js->rfd);
+    if (js->close_wfd) {
+        close(js->wfd);
+    }
+    free(js->tokens);
+    free(js);
+}
@@ -0,0 +1,330 @@
+/**
+ * @file journal.c
+ *
+ * Journal of the tests a run has finished, so a run cut short by a crash of
+ * the runner or the host can be resumed. The journal starts with a line
+ * identifying the test program, then has a block per finished test:
+ *
+ *   test <id> <exitstatus> <inprocess> <duration> <timed> <wall> <cpu>
+ *        <max rss>\t<description>
+ *   cmd <type> <string>       for the directive and each assertion
+ *   end
+ *
+ * durations being nanoseconds. Blocks are flushed as they are added, and
+ * synced to disk in batches. A block missing its end was cut short and is
+ * ignored.
+ */
+#define _GNU_SOURCE /* fdatasync() */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <tapio.h>
+#include <tapstruct.h>
+#include <taptest.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "internal.h"
+
+#define TAP_JOURNAL_MAGIC "unitestap-journal 1"
+/* Blocks added before they are synced to disk, at the latest */
+#define TAP_JOURNAL_SYNC_BLOCKS 64
+#define TAP_JOURNAL_SYNC_NS 1000000000ULL
+
+struct tap_journal {
+    FILE *fp;
+    /* Complete blocks read back on resume, indexed by test id - 1 */
+    char **blocks;
+    size_t n_tests;
+    size_t n_unsynced;
+    struct timespec last_sync;
+};
+
+/* The header of a journal of this build of the test program. A rebuilt
+ * program may have other tests behind the same ids */
+static int tap_journal_header(size_t n_tests, char *buf, size_t size) {
+    struct stat st;
+
+    if (stat("/proc/self/exe", &st) != 0) {
+        return errno;
+    }
+    snprintf(buf, size, TAP_JOURNAL_MAGIC " %llu:%llu:%lld:%lld.%09ld %zu\n",
+             (unsigned long long)st.st_dev, (unsigned long long)st.st_ino,
+             (long long)st.st_size, (long long)st.st_mtim.tv_sec,
+             st.st_mtim.tv_nsec, n_tests);
+    return 0;
+}
+
+/* Keep the complete blocks of fp, the last one of a test winning. d_end is
+ * set to the offset just past the last complete block, or the header */
+static int tap_journal_load(struct tap_journal *journal, FILE *fp,
+                            off_t *d_end) {
+    size_t line_len = 0, id = 0;
+    tap_string_t block;
+    char *line = NULL;
+    int err = 0;
+
+    *d_end = ftello(fp);
+    tap_string_init(&block);
+    while (getline(&line, &line_len, fp) != -1 && err == 0) {
+        if (strcmp(line, "end\n") == 0) {
+            *d_end = ftello(fp);
+        }
+        if (strncmp(line, "test ", 5) == 0) {
+            tap_string_clear(&block);
+            if (sscanf(line + 5, "%zu", &id) != 1 || id == 0 ||
+                id > journal->n_tests) {
+                id = 0;
+            }
+        }
+        if (id == 0) {
+            continue;
+        }
+        if (strcmp(line, "end\n") == 0) {
+            free(journal->blocks[id - 1]);
+            journal->blocks[id - 1] = strdup(tap_string_borrow(&block));
+            if (!journal->blocks[id - 1]) {
+                err = ENOMEM;
+            }
+            id = 0;
+            continue;
+        }
+        err = tap_string_concat(&block, line);
+    }
+    free(line);
+    tap_string_fini(&block);
+    return err;
+}
+
+int tap_journal_ctor(const char *path, bool resume, size_t n_tests,
+                     struct tap_journal **d_journal) {
+    struct tap_journal *journal;
+    char header[128], *line = NULL;
+    size_t line_len = 0;
+    bool same_build = false;
+    FILE *fp = NULL;
+    off_t end = 0;
+    int err;
+
+    err = tap_journal_header(n_tests, header, sizeof(header));
+    if (err != 0) {
+        return err;
+    }
+    journal = calloc(1, sizeof(*journal));
+    if (journal) {
+        journal->blocks = calloc(n_tests ? n_tests : 1, sizeof(char *));
+    }
+    if (!journal || !journal->blocks) {
+        err = ENOMEM;
+        goto failed;
+    }
+    journal->n_tests = n_tests;
+
+    fp = resume ? fopen(path, "r") : NULL;
+    if (fp && getline(&line, &line_len, fp) != -1) {
+        same_build = strcmp(line, header) == 0;
+    }
+    if (same_build) {
+        err = tap_journal_load(journal, fp, &end);
+        if (err != 0) {
+            goto failed;
+        }
+    }
+    if (fp) {
+        fclose(fp);
+        fp = NULL;
+    }
+
+    /* Results of another build, or of a run not being resumed, are done */
+    journal->fp = fopen(path, same_build ? "a" : "w");
+    if (!journal->fp) {
+        err = errno;
+        goto failed;
+    }
+    if (same_build) {
+        /* Blocks are appended after the last complete one, not glued onto
+         * what a crash tore */
+        if (ftruncate(fileno(journal->fp), end) != 0) {
+            err = errno;
+            goto failed;
+        }
+    } else {
+        fputs(header, journal->fp);
+        fflush(journal->fp);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &journal->last_sync);
+    free(line);
+    *d_journal = journal;
+    return 0;
+
+failed:
+    free(line);
+    if (fp) {
+        fclose(fp);
+    }
+    tap_journal_dtor(journal);
+    return err;
+}
+
+static int tap_journal_cmd(struct test_run *run, const char *line) {
+    tap_cmd_t *cmd;
+    int type, pos = 0;
+    int err;
+
+    if (sscanf(line, "cmd %d %n", &type, &pos) != 1 || pos == 0 ||
+        type < tap_cmd_type_todo || type > tap_cmd_type_not_ok) {
+        return EINVAL;
+    }
+    if (!run->arena) {
+        err = tap_arena_ctor(&run->arena);
+        if (err != 0) {
+            return err;
+        }
+    }
+    err = tap_cmd_strndup(run->arena, type, line + pos, strlen(line + pos),
+                          &cmd);
+    if (err != 0) {
+        return err;
+    }
+    if (tap_cmd_is_assertion(cmd)) {
+        if (run->last_subtest) {
+            run->last_subtest->next = cmd;
+        } else {
+            run->subtests = cmd;
+        }
+        run->last_subtest = cmd;
+    } else {
+        run->cmd = cmd;
+    }
+    return 0;
+}
+
+int tap_journal_replay(struct tap_journal *journal, struct test *test,
+                       struct tap_reporter *reporters,
+                       const struct tap_output_opts *output_opts,
+                       struct test_run *run) {
+    unsigned long long duration, wall, cpu;
+    size_t id, max_rss;
+    int exitstatus, inprocess, timed, err = 0;
+    char *block, *line, *desc;
+
+    if (!journal || test->id > journal->n_tests ||
+        !journal->blocks[test->id - 1]) {
+        return ENOENT;
+    }
+    block = strdup(journal->blocks[test->id - 1]);
+    if (!block) {
+        return ENOMEM;
+    }
+    /* A test registered under the id since is not the journaled one */
+    line = strtok(block, "\n");
+    desc = strchr(line, '\t');
+    if (!desc ||
+        strcmp(desc + 1, test->description ? test->description : "") != 0 ||
+        sscanf(line, "test %zu %d %d %llu %d %llu %llu %zu", &id, &exitstatus,
+               &inprocess, &duration, &timed, &wall, &cpu, &max_rss) != 8) {
+        free(block);
+        return ENOENT;
+    }
+
+    *run = (struct test_run){
+        .test = *test,
+        .reporters = reporters,
+        .output_opts = output_opts,
+        .outfd = -1,
+        .pid = -1,
+        .exitstatus = exitstatus,
+        .duration = tap_duration_from_ns(duration),
+        .timed = timed,
+        .test_wall = tap_duration_from_ns(wall),
+        .test_cpu = tap_duration_from_ns(cpu),
+        .max_rss = max_rss,
+        .inprocess = inprocess,
+        .replayed = true,
+        .exited = true,
+    };
+    while (err == 0 && (line = strtok(NULL, "\n"))) {
+        err = tap_journal_cmd(run, line);
+    }
+    free(block);
+    if (err != 0) {
+        tap_arena_dtor(run->arena);
+        *run = (struct test_run){.outfd = -1, .pid = -1};
+    }
+    /* A malformed block is as good as none, the test is run again */
+    return err == EINVAL ? ENOENT : err;
+}
+
+static void tap_journal_sync(struct tap_journal *journal) {
+    fflush(journal->fp);
+    fdatasync(fileno(journal->fp));
+    journal->n_unsynced = 0;
+    clock_gettime(CLOCK_MONOTONIC, &journal->last_sync);
+}
+
+void tap_journal_add(struct tap_journal *journal, struct test_run *run) {
+    const char *description = run->test.description;
+    struct tap_duration *d = &run->duration;
+    struct timespec now;
+
+    /* Nothing to resume from a bailed run or one cut short by the runner */
+    if (!journal || run->cancelled || tap_cmd_is_bailed(run->cmd)) {
+        return;
+    }
+    fprintf(journal->fp, "test %zu %d %d %llu %d %llu %llu %zu\t%s\n",
+            run->test.id, run->exitstatus, run->inprocess,
+            (unsigned long long)tap_timespec_diff_ns(&d->t0, &d->t1),
+            run->timed,
+            (unsigned long long)tap_timespec_diff_ns(&run->test_wall.t0,
+                                                     &run->test_wall.t1),
+            (unsigned long long)tap_timespec_diff_ns(&run->test_cpu.t0,
+                                                     &run->test_cpu.t1),
+            run->max_rss, description ? description : "");
+    if (run->cmd) {
+        fprintf(journal->fp, "cmd %d %s\n", run->cmd->type, run->cmd->str);
+    }
+    for (tap_cmd_t *cmd = run->subtests; cmd; cmd = cmd->next) {
+        fprintf(journal->fp, "cmd %d %s\n", cmd->type, cmd->str);
+    }
+    fputs("end\n", journal->fp);
+
+    /* Flushed, the block survives the runner crashing. Only the host going
+     * down loses the blocks not synced yet */
+    fflush(journal->fp);
+    journal->n_unsynced++;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (journal->n_unsynced >= TAP_JOURNAL_SYNC_BLOCKS ||
+        tap_timespec_diff_ns(&journal->last_sync, &now) >=
+            TAP_JOURNAL_SYNC_NS) {
+        tap_journal_sync(journal);
+    }
+}
+
+int tap_journal_dtor(struct tap_journal *journal) {
+    int err = 0;
+
+    if (!journal) {
+        return 0;
+    }
+    if (journal->fp) {
+        tap_journal_sync(journal);
+        if (ferror(journal->fp)) {
+            err = EIO;
+        }
+        if (fclose(journal->fp) != 0 && err == 0) {
+            err = errno;
+        }
+    }
+    for (size_t idx = 0; journal->blocks && idx < journal->n_tests; idx++) {
+        free(journal->blocks[idx]);
+    }
+    free(journal->blocks);
+    free(journal);
+    return err;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file limits.c
+ *
+ * Resource limits of a test's process, so a runaway test fails on its own
+ * instead of taking the host down with it, and a crash does not spend seconds
+ * writing out a core dump.
+ */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <tap.h>
+
+#include "config.h"
+#include "internal.h"
+
+void tap_limits_merge(struct tap_limits *limits,
+                      const struct tap_limits *runner) {
+    if (!runner) {
+        return;
+    }
+    if (limits->cpu == 0) {
+        limits->cpu = runner->cpu;
+    }
+    if (limits->address_space == 0) {
+        limits->address_space = runner->address_space;
+    }
+    if (limits->file_size == 0) {
+        limits->file_size = runner->file_size;
+    }
+    if (limits->core == 0) {
+        limits->core = runner->core;
+    }
+}
+
+bool tap_limits_set(const struct tap_limits *limits) {
+    return limits->cpu != 0 || limits->address_space != 0 ||
+           limits->file_size != 0;
+}
+
+/* Only the soft limit is lowered, never past the hard one, which a test may
+ * then raise its soft limit back up to */
+static void tap_limits_apply_one(int resource, const char *name,
+                                 unsigned long long limit) {
+    struct rlimit rlim;
+
+    if (getrlimit(resource, &rlim) != 0) {
+        return;
+    }
+    if (limit == TAP_NO_LIMIT) {
+        rlim.rlim_cur = rlim.rlim_max;
+    } else if (rlim.rlim_max == RLIM_INFINITY || limit < rlim.rlim_max) {
+        rlim.rlim_cur = limit;
+    } else {
+        rlim.rlim_cur = rlim.rlim_max;
+    }
+    if (setrlimit(resource, &rlim) != 0) {
+        fprintf(stderr, "failed to limit %s: %s(%d)\n", name, strerror(errno),
+                errno);
+    }
+}
+
+void tap_limits_apply(const struct tap_limits *limits) {
+    if (limits->cpu != 0) {
+        tap_limits_apply_one(RLIMIT_CPU, "CPU time", limits->cpu);
+    }
+    if (limits->address_space != 0) {
+        tap_limits_apply_one(RLIMIT_AS, "address space",
+                             limits->address_space);
+    }
+    if (limits->file_size != 0) {
+        tap_limits_apply_one(RLIMIT_FSIZE, "file size", limits->file_size);
+    }
+    /* Unlike the others, no limit on core dumps means none are written */
+    tap_limits_apply_one(RLIMIT_CORE, "core dumps", limits->core);
+}
@@ -0,0 +1,812 @@
+/**
+ * @file remote.c
+ *
+ * Leases the tests of a run to workers, processes running the same program
+ * on this host or on others, see TAP_ENV_WORKER. Workers connect to the
+ * runner's address and are leased one test at a time, run it as the runner
+ * would and stream back its output and how it exited. The output is held by
+ * the runner until the test is done, as the lease of a worker that disconnects
+ * or goes quiet is issued again to another worker.
+ *
+ * Messages either way are the length of the payload as 4 big-endian bytes,
+ * a byte of type, then the payload:
+ *
+ *   H  worker  "<n_tests> <hash of the program>", sent first
+ *   L  runner  "<id>" of the test leased
+ *   O  worker  output of the leased test, as the runner would read it
+ *   A  worker  the leased test is still running, after a second of silence
+ *   D  worker  "<wait status> <duration ns> <max rss>" once it was reaped
+ *   S  runner  nothing is left to lease, the worker exits
+ *
+ * An address with a '/' is the path of a UNIX socket, otherwise it is a TCP
+ * "host:port", with an empty host listening on every interface.
+ */
+#define _GNU_SOURCE /* accept4() */
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <tapio.h>
+#include <tapstruct.h>
+#include <taptest.h>
+#include <taputil.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "internal.h"
+
+#define TAP_REMOTE_HEADER_LEN 5
+#define TAP_REMOTE_MAX_PAYLOAD (1 << 20)
+#define TAP_REMOTE_READ_SIZE 65536
+#define TAP_REMOTE_MAX_WORKERS 256
+/* A test is left to the runner once this many of its leases were lost */
+#define TAP_REMOTE_MAX_LEASES 3
+/* Silence after which a worker is taken to be gone, with its lease */
+#define TAP_REMOTE_LEASE_NS 10000000000ULL
+/* How long a worker started before its runner tries to connect for */
+#define TAP_REMOTE_CONNECT_NS 10000000000ULL
+
+enum tap_remote_type {
+    TAP_REMOTE_HELLO = 'H',
+    TAP_REMOTE_LEASE = 'L',
+    TAP_REMOTE_OUTPUT = 'O',
+    TAP_REMOTE_ALIVE = 'A',
+    TAP_REMOTE_DONE = 'D',
+    TAP_REMOTE_STOP = 'S',
+};
+
+struct tap_remote_worker {
+    int fd;
+    bool greeted;
+    /* Index of the leased test, n_tests while idle */
+    size_t leased;
+    struct test_run run;
+    /* Output of the leased test, reported once it is done */
+    tap_string_t *output;
+    struct timespec heard;
+    /* Received data not yet a whole message */
+    char *rxbuf;
+    size_t rx_len;
+    size_t rx_size;
+};
+
+struct tap_remote_lease {
+    unsigned int n_issued;
+    bool held;
+};
+
+static int tap_remote_unix_addr(const char *path, struct sockaddr_un *addr) {
+    *addr = (struct sockaddr_un){.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        return ENAMETOOLONG;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+static int tap_remote_tcp_socket(const char *address, bool listening,
+                                 int *d_fd) {
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags = listening ? AI_PASSIVE : 0,
+    };
+    struct addrinfo *addrs, *ai;
+    const char *colon;
+    char *host;
+    int fd = -1, err, one = 1;
+
+    colon = strrchr(address, ':');
+    if (!colon) {
+        return EINVAL;
+    }
+    host = strndup(address, colon - address);
+    if (!host) {
+        return ENOMEM;
+    }
+    err = getaddrinfo(*host ? host : NULL, colon + 1, &hints, &addrs);
+    free(host);
+    if (err != 0) {
+        return err == EAI_SYSTEM ? errno : EHOSTUNREACH;
+    }
+    err = ECONNREFUSED;
+    for (ai = addrs; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+                    ai->ai_protocol);
+        if (fd == -1) {
+            err = errno;
+            continue;
+        }
+        if (listening) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+                listen(fd, SOMAXCONN) == 0) {
+                break;
+            }
+        } else if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            /* Messages are small and each waits on the one before */
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            break;
+        }
+        err = errno;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+    if (fd == -1) {
+        return err;
+    }
+    *d_fd = fd;
+    return 0;
+}
+
+/* A listening socket at address, or one connected to it */
+static int tap_remote_socket(const char *address, bool listening, int *d_fd) {
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd, err;
+
+    if (!strchr(address, '/')) {
+        return tap_remote_tcp_socket(address, listening, d_fd);
+    }
+    err = tap_remote_unix_addr(address, &addr);
+    if (err != 0) {
+        return err;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return errno;
+    }
+    if (listening) {
+        /* Left behind by a runner that did not get to clean up */
+        if (lstat(address, &st) == 0 && S_ISSOCK(st.st_mode)) {
+            unlink(address);
+        }
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+            listen(fd, SOMAXCONN) == 0) {
+            *d_fd = fd;
+            return 0;
+        }
+    } else if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        *d_fd = fd;
+        return 0;
+    }
+    err = errno;
+    close(fd);
+    return err;
+}
+
+/* What a worker introduces itself with, the same for the same program and
+ * tests wherever it was copied to */
+static int tap_remote_hello(size_t n_tests, char *buf, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    unsigned char chunk[TAP_REMOTE_READ_SIZE];
+    size_t n_read;
+    FILE *fp;
+
+    fp = fopen("/proc/self/exe", "r");
+    if (!fp) {
+        return errno;
+    }
+    /* FNV-1a */
+    while ((n_read = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+        for (size_t idx = 0; idx < n_read; idx++) {
+            hash = (hash ^ chunk[idx]) * 0x100000001b3ULL;
+        }
+    }
+    fclose(fp);
+    snprintf(buf, size, "%zu %016llx", n_tests, (unsigned long long)hash);
+    return 0;
+}
+
+static int tap_remote_send(int fd, enum tap_remote_type type,
+                           const void *payload, size_t len) {
+    unsigned char header[TAP_REMOTE_HEADER_LEN] = {
+        len >> 24, len >> 16, len >> 8, len, type,
+    };
+    struct iovec iov[2] = {
+        {.iov_base = header, .iov_len = sizeof(header)},
+        {.iov_base = (void *)payload, .iov_len = len},
+    };
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = 2};
+
+    while (iov[0].iov_len + iov[1].iov_len > 0) {
+        ssize_t n_sent;
+
+        n_sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n_sent == -1 && errno == EINTR) {
+            continue;
+        } else if (n_sent == -1) {
+            return errno;
+        }
+        for (size_t idx = 0; idx < 2; idx++) {
+            size_t n = (size_t)n_sent < iov[idx].iov_len ? (size_t)n_sent
+                                                         : iov[idx].iov_len;
+
+            iov[idx].iov_base = (char *)iov[idx].iov_base + n;
+            iov[idx].iov_len -= n;
+            n_sent -= n;
+        }
+    }
+    return 0;
+}
+
+static int tap_remote_read_full(int fd, void *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n_read;
+
+        n_read = read(fd, buf, len);
+        if (n_read == -1 && errno == EINTR) {
+            continue;
+        } else if (n_read == -1) {
+            return errno;
+        } else if (n_read == 0) {
+            return ECONNRESET;
+        }
+        buf = (char *)buf + n_read;
+        len -= n_read;
+    }
+    return 0;
+}
+
+/* Wait for the next message to the worker, its payload as a string */
+static int tap_remote_recv(int fd, enum tap_remote_type *d_type, char *buf,
+                           size_t size) {
+    unsigned char header[TAP_REMOTE_HEADER_LEN];
+    size_t len;
+    int err;
+
+    err = tap_remote_read_full(fd, header, sizeof(header));
+    if (err != 0) {
+        return err;
+    }
+    len = (size_t)header[0] << 24 | header[1] << 16 | header[2] << 8 |
+          header[3];
+    if (len >= size) {
+        return EPROTO;
+    }
+    err = tap_remote_read_full(fd, buf, len);
+    if (err != 0) {
+        return err;
+    }
+    buf[len] = '\0';
+    *d_type = header[4];
+    return 0;
+}
+
+/* Run the test as the runner would, forwarding its output to the runner */
+static int tap_worker_run(int fd, struct test *test) {
+    struct timespec t0, t1;
+    struct rusage usage;
+    char buf[TAP_REMOTE_READ_SIZE], done[96];
+    int pipefd[2], wstatus, err = 0;
+    pid_t cpid;
+
+    err = tap_pipe_setup(pipefd);
+    if (err != 0) {
+        return err;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    fflush(NULL);
+    cpid = fork();
+    if (cpid == 0) {
+        close(fd);
+        close(pipefd[TAP_PIPE_RX]);
+        dup2(pipefd[TAP_PIPE_TX], STDOUT_FILENO);
+        dup2(pipefd[TAP_PIPE_TX], STDERR_FILENO);
+        close(pipefd[TAP_PIPE_TX]);
+        tap_run_test_and_exit(test);
+    }
+    close(pipefd[TAP_PIPE_TX]);
+    if (cpid == -1) {
+        err = errno;
+        close(pipefd[TAP_PIPE_RX]);
+        return err;
+    }
+
+    while (err == 0) {
+        struct pollfd pfd = {.fd = pipefd[TAP_PIPE_RX], .events = POLLIN};
+        ssize_t n_read;
+        int n_ready;
+
+        n_ready = poll(&pfd, 1, 1000);
+        if (n_ready == -1 && errno == EINTR) {
+            continue;
+        } else if (n_ready == 0) {
+            err = tap_remote_send(fd, TAP_REMOTE_ALIVE, NULL, 0);
+            continue;
+        }
+        n_read = read(pipefd[TAP_PIPE_RX], buf, sizeof(buf));
+        if (n_read == -1 && errno == EINTR) {
+            continue;
+        } else if (n_read <= 0) {
+            break;
+        }
+        err = tap_remote_send(fd, TAP_REMOTE_OUTPUT, buf, n_read);
+    }
+    close(pipefd[TAP_PIPE_RX]);
+    if (err != 0) {
+        /* The runner is gone, it has already leased the test elsewhere */
+        kill(cpid, SIGKILL);
+    }
+    while (wait4(cpid, &wstatus, 0, &usage) == -1) {
+        if (errno != EINTR) {
+            return errno;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (err != 0) {
+        return err;
+    }
+    snprintf(done, sizeof(done), "%d %llu %zu", wstatus,
+             (unsigned long long)tap_timespec_diff_ns(&t0, &t1),
+             (size_t)usage.ru_maxrss * 1024);
+    return tap_remote_send(fd, TAP_REMOTE_DONE, done, strlen(done));
+}
+
+static int tap_worker_connect(const char *address, int *d_fd) {
+    struct timespec t0, now;
+    int err;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (;;) {
+        err = tap_remote_socket(address, false, d_fd);
+        if (err != ECONNREFUSED && err != ENOENT) {
+            return err;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (tap_timespec_diff_ns(&t0, &now) >= TAP_REMOTE_CONNECT_NS) {
+            return err;
+        }
+        usleep(100000);
+    }
+}
+
+/* Run the tests leased over one connection, until told to stop */
+static int tap_worker_serve(struct test *tests, size_t n_tests,
+                            const struct tap_limits *limits,
+                            const char *address) {
+    enum tap_remote_type type;
+    char buf[128];
+    int fd, err;
+
+    err = tap_remote_hello(n_tests, buf, sizeof(buf));
+    if (err != 0) {
+        return err;
+    }
+    err = tap_worker_connect(address, &fd);
+    if (err != 0) {
+        fprintf(stderr, "failed to connect to %s: %s(%d)\n", address,
+                strerror(err), err);
+        return err;
+    }
+    err = tap_remote_send(fd, TAP_REMOTE_HELLO, buf, strlen(buf));
+    while (err == 0) {
+        struct test test;
+        char *end;
+        unsigned long id;
+
+        err = tap_remote_recv(fd, &type, buf, sizeof(buf));
+        if (err != 0 || type == TAP_REMOTE_STOP) {
+            break;
+        }
+        id = strtoul(buf, &end, 10);
+        if (type != TAP_REMOTE_LEASE || *end != '\0' || id == 0 ||
+            id > n_tests) {
+            err = EPROTO;
+            break;
+        }
+        test = tests[id - 1];
+        tap_limits_merge(&test.limits, limits);
+        err = tap_worker_run(fd, &test);
+    }
+    close(fd);
+    return err;
+}
+
+int tap_remote_work(struct test *tests, size_t n_tests,
+                    const struct tap_limits *limits, const char *address,
+                    size_t n_conns) {
+    pid_t pids[TAP_REMOTE_MAX_WORKERS];
+    size_t n_pids = 0;
+    int err, wstatus;
+
+    if (n_conns > TAP_REMOTE_MAX_WORKERS) {
+        n_conns = TAP_REMOTE_MAX_WORKERS;
+    }
+    /* A connection per slot, each its own process to run a test at a time */
+    fflush(NULL);
+    for (size_t idx = 1; idx < n_conns; idx++) {
+        pid_t pid = fork();
+
+        if (pid == 0) {
+            _exit(tap_worker_serve(tests, n_tests, limits, address));
+        } else if (pid > 0) {
+            pids[n_pids++] = pid;
+        }
+    }
+    err = tap_worker_serve(tests, n_tests, limits, address);
+    for (size_t idx = 0; idx < n_pids; idx++) {
+        if (waitpid(pids[idx], &wstatus, 0) == pids[idx] && err == 0 &&
+            WIFEXITED(wstatus)) {
+            err = WEXITSTATUS(wstatus);
+        }
+    }
+    return err;
+}
+
+/* State of tap_run_remote() */
+struct tap_remote {
+    struct test *tests;
+    size_t n_tests;
+    const struct tap_limits *limits;
+    struct tap_reporter *reporters;
+    const struct tap_output_opts *output_opts;
+    struct test_run *runs;
+    struct tap_remote_lease *leases;
+    /* What a worker of the same program introduces itself with */
+    char hello[128];
+};
+
+/* Whether another lease of the test may be issued */
+static bool tap_remote_leasable(struct tap_remote *remote, size_t idx) {
+    struct tap_remote_lease *lease = &remote->leases[idx];
+
+    /* Resources are only ever held by the runner's own tests */
+    return !remote->runs[idx].exited && !lease->held &&
+           remote->tests[idx].resources == 0 &&
+           lease->n_issued < TAP_REMOTE_MAX_LEASES;
+}
+
+static void tap_remote_drop(struct tap_remote *remote,
+                            struct tap_remote_worker *worker) {
+    if (worker->leased < remote->n_tests) {
+        remote->leases[worker->leased].held = false;
+        tap_report_comment(remote->reporters, &worker->run.test,
+                           "lost the worker running the test, %s",
+                           tap_remote_leasable(remote, worker->leased)
+                               ? "leasing it again"
+                               : "leaving it to the runner");
+        tap_cleanup_testrun(&worker->run);
+    }
+    close(worker->fd);
+    free(worker->rxbuf);
+    tap_string_dtor(worker->output);
+    *worker = (struct tap_remote_worker){.fd = -1};
+}
+
+static int tap_remote_done(struct tap_remote *remote,
+                           struct tap_remote_worker *worker, char *payload) {
+    struct test_run *run = &worker->run;
+    unsigned long long duration;
+    size_t max_rss;
+    int wstatus, err;
+
+    if (sscanf(payload, "%d %llu %zu", &wstatus, &duration, &max_rss) != 3) {
+        return EPROTO;
+    }
+    /* Known before the output is done, to check the test's own timing */
+    run->exitstatus = wstatus;
+    run->duration = tap_duration_from_ns(duration);
+    run->max_rss = max_rss;
+    err = tap_process_testrun_data(run, tap_string_borrow(worker->output),
+                                   worker->output->len, true);
+    if (err != 0) {
+        return err;
+    }
+    tap_string_dtor(worker->output);
+    worker->output = NULL;
+    run->exited = true;
+    remote->runs[worker->leased] = *run;
+    remote->leases[worker->leased].held = false;
+    worker->run = (struct test_run){.outfd = -1, .pid = -1};
+    worker->leased = remote->n_tests;
+    return 0;
+}
+
+/* Handle a message from the worker, payload[len] is writable. An error
+ * drops the worker */
+static int tap_remote_handle(struct tap_remote *remote,
+                             struct tap_remote_worker *worker,
+                             enum tap_remote_type type, char *payload,
+                             size_t len) {
+    payload[len] = '\0';
+    if (!worker->greeted) {
+        if (type != TAP_REMOTE_HELLO || strcmp(payload, remote->hello) != 0) {
+            tap_report_comment(remote->reporters, NULL,
+                               "turned away a worker running other tests");
+            tap_remote_send(worker->fd, TAP_REMOTE_STOP, NULL, 0);
+            return EPROTO;
+        }
+        worker->greeted = true;
+        return 0;
+    }
+    if (worker->leased >= remote->n_tests) {
+        return EPROTO;
+    }
+    switch (type) {
+        case TAP_REMOTE_ALIVE:
+            return 0;
+        case TAP_REMOTE_OUTPUT:
+            return tap_string_concat_len(worker->output, payload, len);
+        case TAP_REMOTE_DONE:
+            return tap_remote_done(remote, worker, payload);
+        default:
+            return EPROTO;
+    }
+}
+
+static int tap_remote_reserve(struct tap_remote_worker *worker, size_t size) {
+    char *rxbuf;
+
+    if (worker->rx_size >= size) {
+        return 0;
+    }
+    rxbuf = realloc(worker->rxbuf, size);
+    if (!rxbuf) {
+        return errno;
+    }
+    worker->rxbuf = rxbuf;
+    worker->rx_size = size;
+    return 0;
+}
+
+/* Read what the worker sent and handle each whole message of it */
+static int tap_remote_receive(struct tap_remote *remote,
+                              struct tap_remote_worker *worker) {
+    size_t consumed = 0;
+    ssize_t n_read;
+    int err;
+
+    /* One more byte to end a payload at the end of the buffer with '\0' */
+    err = tap_remote_reserve(worker,
+                             worker->rx_len + TAP_REMOTE_READ_SIZE + 1);
+    if (err != 0) {
+        return err;
+    }
+    n_read = read(worker->fd, worker->rxbuf + worker->rx_len,
+                  TAP_REMOTE_READ_SIZE);
+    if (n_read == -1 && errno == EINTR) {
+        return 0;
+    } else if (n_read <= 0) {
+        return n_read == 0 ? ECONNRESET : errno;
+    }
+    worker->rx_len += n_read;
+    clock_gettime(CLOCK_MONOTONIC, &worker->heard);
+
+    while (err == 0 && worker->rx_len - consumed >= TAP_REMOTE_HEADER_LEN) {
+        unsigned char *header = (unsigned char *)worker->rxbuf + consumed;
+        char *payload = (char *)header + TAP_REMOTE_HEADER_LEN, next;
+        size_t len;
+
+        len = (size_t)header[0] << 24 | header[1] << 16 | header[2] << 8 |
+              header[3];
+        if (len > TAP_REMOTE_MAX_PAYLOAD) {
+            return EPROTO;
+        }
+        if (worker->rx_len - consumed < TAP_REMOTE_HEADER_LEN + len) {
+            break;
+        }
+        /* The payload is ended in place, over the next message's first byte */
+        next = payload[len];
+        err = tap_remote_handle(remote, worker, header[4], payload, len);
+        payload[len] = next;
+        consumed += TAP_REMOTE_HEADER_LEN + len;
+    }
+    worker->rx_len -= consumed;
+    memmove(worker->rxbuf, worker->rxbuf + consumed, worker->rx_len);
+    return err;
+}
+
+static int tap_remote_lease(struct tap_remote *remote,
+                            struct tap_remote_worker *worker) {
+    char id[TAP_UINT_FMT_LEN];
+    struct test_run *run = &worker->run;
+    size_t idx;
+    int err;
+
+    for (idx = 0; idx < remote->n_tests; idx++) {
+        if (tap_remote_leasable(remote, idx)) {
+            break;
+        }
+    }
+    if (idx == remote->n_tests) {
+        return 0;
+    }
+    err = tap_string_ctor(&worker->output, NULL);
+    if (err != 0) {
+        return err;
+    }
+    *run = (struct test_run){
+        .test = remote->tests[idx],
+        .reporters = remote->reporters,
+        .output_opts = remote->output_opts,
+        .outfd = -1,
+        .pid = -1,
+        .exitstatus = -1,
+    };
+    /* Kept to report what limit a terminated test ran into */
+    tap_limits_merge(&run->test.limits, remote->limits);
+    worker->leased = idx;
+    remote->leases[idx].n_issued++;
+    remote->leases[idx].held = true;
+    clock_gettime(CLOCK_MONOTONIC, &worker->heard);
+    snprintf(id, sizeof(id), "%zu", run->test.id);
+    return tap_remote_send(worker->fd, TAP_REMOTE_LEASE, id, strlen(id));
+}
+
+static void tap_remote_accept(struct tap_remote_worker *workers,
+                              size_t *n_slots, int listen_fd, size_t n_tests,
+                              struct timespec *now) {
+    size_t widx;
+    int fd;
+
+    fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd == -1) {
+        return;
+    }
+    for (widx = 0; widx < TAP_REMOTE_MAX_WORKERS; widx++) {
+        if (workers[widx].fd == -1) {
+            break;
+        }
+    }
+    if (widx == TAP_REMOTE_MAX_WORKERS) {
+        close(fd);
+        return;
+    }
+    workers[widx] = (struct tap_remote_worker){
+        .fd = fd,
+        .leased = n_tests,
+        .heard = *now,
+    };
+    if (widx >= *n_slots) {
+        *n_slots = widx + 1;
+    }
+}
+
+/* Whether anything is leased or left to lease */
+static bool tap_remote_pending(struct tap_remote *remote, bool bailed) {
+    for (size_t idx = 0; idx < remote->n_tests; idx++) {
+        /* A bail makes whatever is still to run untrustworthy */
+        if (remote->leases[idx].held ||
+            (!bailed && tap_remote_leasable(remote, idx))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int tap_run_remote(struct test *tests, size_t n_tests, const char *address,
+                   double wait, const struct tap_limits *limits,
+                   struct tap_reporter *reporters,
+                   const struct tap_output_opts *output_opts,
+                   struct test_run *runs) {
+    struct tap_remote remote = {
+        .tests = tests,
+        .n_tests = n_tests,
+        .limits = limits,
+        .reporters = reporters,
+        .output_opts = output_opts,
+        .runs = runs,
+    };
+    struct tap_remote_worker *workers;
+    /* One more for the listening socket */
+    struct pollfd fds[TAP_REMOTE_MAX_WORKERS + 1];
+    struct timespec idle_since, now;
+    size_t n_slots = 0;
+    bool bailed = false;
+    int listen_fd = -1, err;
+
+    err = tap_remote_hello(n_tests, remote.hello, sizeof(remote.hello));
+    if (err != 0) {
+        return err;
+    }
+    workers = calloc(TAP_REMOTE_MAX_WORKERS, sizeof(*workers));
+    remote.leases = calloc(n_tests, sizeof(*remote.leases));
+    if (!workers || !remote.leases) {
+        err = ENOMEM;
+        goto done;
+    }
+    for (size_t widx = 0; widx < TAP_REMOTE_MAX_WORKERS; widx++) {
+        workers[widx].fd = -1;
+    }
+    err = tap_remote_socket(address, true, &listen_fd);
+    if (err != 0) {
+        goto done;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &idle_since);
+
+    while (err == 0) {
+        size_t n_fds = 0, n_workers = 0;
+
+        for (size_t widx = 0; widx < n_slots; widx++) {
+            n_workers += workers[widx].fd != -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (n_workers > 0) {
+            idle_since = now;
+        }
+        /* Whatever no worker turned up for is left to the runner */
+        if (!tap_remote_pending(&remote, bailed) ||
+            tap_timespec_diff_ns(&idle_since, &now) >= wait * 1e9) {
+            break;
+        }
+
+        fds[n_fds++] = (struct pollfd){.fd = listen_fd, .events = POLLIN};
+        for (size_t widx = 0; widx < n_slots; widx++) {
+            fds[n_fds++] =
+                (struct pollfd){.fd = workers[widx].fd, .events = POLLIN};
+        }
+        if (poll(fds, n_fds, 100) == -1 && errno != EINTR) {
+            err = errno;
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        for (size_t widx = 0; widx < n_slots; widx++) {
+            struct tap_remote_worker *worker = &workers[widx];
+            int werr = 0;
+
+            if (worker->fd == -1) {
+                continue;
+            }
+            if (fds[widx + 1].revents) {
+                werr = tap_remote_receive(&remote, worker);
+            } else if (worker->leased < n_tests &&
+                       tap_timespec_diff_ns(&worker->heard, &now) >=
+                           TAP_REMOTE_LEASE_NS) {
+                /* Its host may be gone without closing the connection */
+                werr = ETIMEDOUT;
+            }
+            if (werr == 0 && worker->leased < n_tests) {
+                continue;
+            }
+            for (size_t idx = 0; idx < n_tests && !bailed; idx++) {
+                bailed = runs[idx].exited && tap_cmd_is_bailed(runs[idx].cmd);
+            }
+            if (werr == 0 && worker->greeted && !bailed) {
+                werr = tap_remote_lease(&remote, worker);
+            }
+            if (werr == ENOMEM) {
+                err = werr;
+            }
+            if (werr != 0) {
+                tap_remote_drop(&remote, worker);
+            }
+        }
+        /* Accepted last, its slot was not polled */
+        if (fds[0].revents & POLLIN) {
+            tap_remote_accept(workers, &n_slots, listen_fd, n_tests, &now);
+        }
+    }
+
+done:
+    for (size_t widx = 0; workers && widx < n_slots; widx++) {
+        if (workers[widx].fd != -1) {
+            tap_remote_send(workers[widx].fd, TAP_REMOTE_STOP, NULL, 0);
+            tap_remote_drop(&remote, &workers[widx]);
+        }
+    }
+    if (listen_fd != -1) {
+        close(listen_fd);
+        if (strchr(address, '/')) {
+            unlink(address);
+        }
+    }
+    free(workers);
+    free(remote.leases);
+    return err;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file repeat.c
+ *
+ * Runs a test several times over, reporting it as a single testpoint. The
+ * repetition reported in full is the one most worth a look: a bail out, the
+ * first failure or else the last repetition.
+ */
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <tapio.h>
+#include <tapstruct.h>
+#include <taptest.h>
+
+#include "config.h"
+#include "internal.h"
+
+size_t tap_repeat_count(size_t n_repeats, const char *filter,
+                        struct test *test) {
+    if (n_repeats <= 1) {
+        return 1;
+    }
+    if (filter &&
+        (!test->description || fnmatch(filter, test->description, 0) != 0)) {
+        return 1;
+    }
+    return n_repeats;
+}
+
+int tap_repeat_ctor(size_t n_reps, struct tap_repeat *rep) {
+    *rep = (struct tap_repeat){.n_reps = n_reps};
+    rep->ns = calloc(n_reps, sizeof(*rep->ns));
+    if (!rep->ns) {
+        return errno;
+    }
+    return 0;
+}
+
+/* Higher for repetitions more worth reporting in full */
+static int tap_repeat_rank(struct test_run *run) {
+    if (tap_cmd_is_bailed(run->cmd)) {
+        return 2;
+    }
+    return !tap_testrun_passed(run);
+}
+
+void tap_repeat_add(struct tap_repeat *rep, struct test_run *run) {
+    struct tap_duration *d = tap_testrun_duration(run);
+
+    rep->ns[rep->n_done++] = tap_timespec_diff_ns(&d->t0, &d->t1);
+    rep->n_passed += tap_testrun_passed(run);
+
+    /* Ties go to the later repetition, only a first failure is kept */
+    if (rep->n_done == 1 ||
+        tap_repeat_rank(run) > tap_repeat_rank(&rep->kept) ||
+        (tap_repeat_rank(run) == 0 && tap_repeat_rank(&rep->kept) == 0)) {
+        if (rep->n_done > 1) {
+            tap_cleanup_testrun(&rep->kept);
+        }
+        rep->kept = *run;
+    } else {
+        tap_cleanup_testrun(run);
+    }
+}
+
+static int tap_cmp_ns(const void *lhs, const void *rhs) {
+    uint64_t lns = *(const uint64_t *)lhs, rns = *(const uint64_t *)rhs;
+
+    return lns < rns ? -1 : lns > rns;
+}
+
+int tap_repeat_report(struct tap_repeat *rep, struct tap_reporter *reporters,
+                      struct test *test) {
+    char min[TAP_DURATION_FMT_LEN], median[TAP_DURATION_FMT_LEN];
+    char max[TAP_DURATION_FMT_LEN];
+    struct tap_duration d;
+
+    if (rep->n_done == 0) {
+        return 0;
+    }
+    qsort(rep->ns, rep->n_done, sizeof(*rep->ns), tap_cmp_ns);
+    d = tap_duration_from_ns(rep->ns[0]);
+    tap_duration_format(&d, min);
+    d = tap_duration_from_ns(rep->ns[rep->n_done / 2]);
+    tap_duration_format(&d, median);
+    d = tap_duration_from_ns(rep->ns[rep->n_done - 1]);
+    tap_duration_format(&d, max);
+    return tap_report_comment(
+        reporters, test,
+        "passed %zu/%zu repetitions, duration min %s median %s max %s",
+        rep->n_passed, rep->n_done, min, median, max);
+}
+
+void tap_repeat_dtor(struct tap_repeat *rep) {
+    free(rep->ns);
+    rep->ns = NULL;
+}
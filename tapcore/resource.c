@@ -0,0 +1,153 @@
+/**
+ * @file resource.c
+ *
+ * Named resources that tests hold a unit of while running, e.g. a fixed port
+ * or a scratch file. A resource with a capacity of 1 serialises the tests
+ * using it, leaving every other test to run alongside them.
+ */
+#define _GNU_SOURCE /* strndup() */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <tapstruct.h>
+#include <taptest.h>
+
+#include "config.h"
+#include "internal.h"
+
+static size_t tap_resources_find(struct tap_resources *res, const char *name,
+                                 size_t name_len) {
+    size_t idx;
+
+    for (idx = 0; idx < res->n_resources; idx++) {
+        if (strlen(res->names[idx]) == name_len &&
+            strncmp(res->names[idx], name, name_len) == 0) {
+            break;
+        }
+    }
+    return idx;
+}
+
+/* Add one "name[:capacity]" entry of a spec to mask */
+static int tap_resources_add(struct tap_resources *res, const char *entry,
+                             size_t len, uint64_t *mask) {
+    const char *colon;
+    unsigned long capacity = 1;
+    size_t name_len, idx;
+
+    colon = memchr(entry, ':', len);
+    name_len = colon ? (size_t)(colon - entry) : len;
+    if (name_len == 0) {
+        return EINVAL;
+    }
+    if (colon) {
+        char *end;
+
+        capacity = strtoul(colon + 1, &end, 10);
+        if (end != entry + len || end == colon + 1 || capacity == 0) {
+            return EINVAL;
+        }
+    }
+
+    idx = tap_resources_find(res, entry, name_len);
+    if (idx < res->n_resources) {
+        /* A resource has the one capacity, whichever test names it */
+        if (res->capacity[idx] != capacity) {
+            return EINVAL;
+        }
+    } else {
+        if (idx >= TAP_MAX_RESOURCES) {
+            return ENOSPC;
+        }
+        res->names[idx] = strndup(entry, name_len);
+        if (!res->names[idx]) {
+            return ENOMEM;
+        }
+        res->capacity[idx] = capacity;
+        res->n_resources++;
+    }
+    *mask |= UINT64_C(1) << idx;
+    return 0;
+}
+
+int tap_resources_parse(struct tap_resources *res, const char *spec,
+                        uint64_t *d_mask) {
+    uint64_t mask = 0;
+
+    while (*spec) {
+        size_t len;
+        int err;
+
+        len = strcspn(spec, ",");
+        err = tap_resources_add(res, spec, len, &mask);
+        if (err != 0) {
+            return err;
+        }
+        spec += len;
+        if (*spec == ',') {
+            spec++;
+        }
+    }
+    *d_mask = mask;
+    return 0;
+}
+
+int tap_resources_format(struct tap_resources *res, uint64_t mask,
+                         tap_string_t *tstr) {
+    bool first = true;
+
+    for (size_t idx = 0; idx < res->n_resources; idx++) {
+        int err;
+
+        if ((mask & (UINT64_C(1) << idx)) == 0) {
+            continue;
+        }
+        err = tap_string_concat_printf(tstr, "%s%s:%zu", first ? "" : ",",
+                                       res->names[idx], res->capacity[idx]);
+        if (err != 0) {
+            return err;
+        }
+        first = false;
+    }
+    return 0;
+}
+
+bool tap_resources_available(struct tap_resources *res, struct test *test) {
+    for (size_t idx = 0; idx < res->n_resources; idx++) {
+        if ((test->resources & (UINT64_C(1) << idx)) &&
+            res->n_held[idx] >= res->capacity[idx]) {
+            return false;
+        }
+    }
+    /* A test over the whole budget still gets to run, on its own */
+    if (res->memory_budget > 0 && test->memory > 0 && res->memory_held > 0 &&
+        res->memory_held + test->memory > res->memory_budget) {
+        return false;
+    }
+    return true;
+}
+
+void tap_resources_acquire(struct tap_resources *res, struct test *test) {
+    for (size_t idx = 0; idx < res->n_resources; idx++) {
+        res->n_held[idx] += (test->resources >> idx) & 1;
+    }
+    res->memory_held += test->memory;
+}
+
+void tap_resources_release(struct tap_resources *res, struct test *test) {
+    for (size_t idx = 0; idx < res->n_resources; idx++) {
+        res->n_held[idx] -= (test->resources >> idx) & 1;
+    }
+    res->memory_held -= test->memory;
+}
+
+void tap_resources_fini(struct tap_resources *res) {
+    for (size_t idx = 0; idx < res->n_resources; idx++) {
+        free(res->names[idx]);
+    }
+    *res = (struct tap_resources){0};
+}
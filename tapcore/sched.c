@@ -0,0 +1,111 @@
+/**
+ * @file sched.c
+ *
+ * Chooses which of the tests that could start next does, by a TAP_SCHED
+ * policy or a caller's tap_pick_t.
+ */
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <tap.h>
+#include <taptest.h>
+
+#include "config.h"
+#include "internal.h"
+
+/* Whether test a goes before test b, which was registered earlier */
+static bool tap_sched_before(TAP_SCHED policy, struct test *a,
+                             struct test *b) {
+    switch (policy) {
+        case TAP_SCHED_PRIORITY:
+            return a->priority > b->priority;
+        case TAP_SCHED_SHORTEST_FIRST:
+            return a->cost < b->cost;
+        case TAP_SCHED_LONGEST_FIRST:
+            return a->cost > b->cost;
+        case TAP_SCHED_FIFO:
+        default:
+            return false;
+    }
+}
+
+static bool tap_sched_runnable(struct test *test, size_t n_left,
+                               struct tap_resources *res) {
+    return n_left > 0 && tap_resources_available(res, test);
+}
+
+static size_t tap_sched_pick_custom(const struct tap_sched *sched,
+                                    struct test *tests, size_t n_tests,
+                                    const size_t *n_left, size_t first,
+                                    struct tap_resources *res, bool idle) {
+    struct tap_sched_candidate *candidates;
+    size_t *idxs, n_candidates = 0, picked, idx = n_tests;
+
+    candidates = calloc(n_tests - first, sizeof(*candidates));
+    idxs = calloc(n_tests - first, sizeof(*idxs));
+    if (!candidates || !idxs) {
+        /* Fall back on the policy rather than stall the run */
+        free(candidates);
+        free(idxs);
+        return tap_sched_pick(&(struct tap_sched){.policy = sched->policy},
+                              tests, n_tests, n_left, first, res, idle);
+    }
+
+    for (size_t cur = first; cur < n_tests; cur++) {
+        struct test *test = &tests[cur];
+
+        if (!tap_sched_runnable(test, n_left[cur], res)) {
+            continue;
+        }
+        candidates[n_candidates] = (struct tap_sched_candidate){
+            .id = test->id,
+            .description = test->description,
+            .priority = test->priority,
+            .cost = test->cost,
+            .tags = test->tags,
+        };
+        idxs[n_candidates++] = cur;
+    }
+
+    if (n_candidates > 0) {
+        picked = sched->pick(candidates, n_candidates, sched->priv);
+        if (picked < n_candidates) {
+            idx = idxs[picked];
+        } else if (idle) {
+            /* Nothing running would ever free up a slot to pick again */
+            idx = idxs[0];
+        }
+    }
+    free(candidates);
+    free(idxs);
+    return idx;
+}
+
+size_t tap_sched_pick(const struct tap_sched *sched, struct test *tests,
+                      size_t n_tests, const size_t *n_left, size_t first,
+                      struct tap_resources *res, bool idle) {
+    size_t best = n_tests;
+
+    if (first >= n_tests) {
+        return n_tests;
+    }
+    if (sched->pick) {
+        return tap_sched_pick_custom(sched, tests, n_tests, n_left, first,
+                                     res, idle);
+    }
+
+    for (size_t idx = first; idx < n_tests; idx++) {
+        if (!tap_sched_runnable(&tests[idx], n_left[idx], res)) {
+            continue;
+        }
+        if (best == n_tests ||
+            tap_sched_before(sched->policy, &tests[idx], &tests[best])) {
+            best = idx;
+        }
+        if (sched->policy == TAP_SCHED_FIFO) {
+            break;
+        }
+    }
+    return best;
+}
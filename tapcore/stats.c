@@ -0,0 +1,142 @@
+/**
+ * @file stats.c
+ *
+ * Measurements the runner takes of its own overheads, and the summary of them
+ * reported at the end of a run.
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <tap.h>
+#include <tapio.h>
+#include <tapstruct.h>
+#include <taptest.h>
+#include <time.h>
+
+#include "config.h"
+#include "internal.h"
+
+uint64_t tap_timespec_diff_ns(const struct timespec *t0,
+                              const struct timespec *t1) {
+    int64_t ns;
+
+    ns = (int64_t)(t1->tv_sec - t0->tv_sec) * 1000000000 +
+         (t1->tv_nsec - t0->tv_nsec);
+    return ns > 0 ? ns : 0;
+}
+
+void tap_histogram_add(struct tap_histogram *hist, uint64_t value) {
+    size_t bucket;
+
+    bucket = value ? 64 - __builtin_clzll(value) : 0;
+    hist->buckets[bucket]++;
+    if (hist->count == 0 || value < hist->min) {
+        hist->min = value;
+    }
+    if (value > hist->max) {
+        hist->max = value;
+    }
+    hist->count++;
+    hist->sum += value;
+}
+
+uint64_t tap_histogram_percentile(const struct tap_histogram *hist,
+                                  double percentile) {
+    uint64_t rank, seen = 0;
+    double exact;
+
+    if (hist->count == 0) {
+        return 0;
+    }
+
+    /* The smallest rank covering the percentile, at least the first value */
+    exact = percentile / 100 * hist->count;
+    rank = exact;
+    if (rank < exact) {
+        rank++;
+    }
+    if (rank < 1) {
+        rank = 1;
+    }
+    for (size_t bucket = 0; bucket < TAP_HISTOGRAM_BUCKETS; bucket++) {
+        uint64_t upper;
+
+        seen += hist->buckets[bucket];
+        if (seen < rank) {
+            continue;
+        }
+        upper = bucket == 0 ? 0 : (UINT64_MAX >> (64 - bucket));
+        return upper < hist->max ? upper : hist->max;
+    }
+    return hist->max;
+}
+
+void tap_stats_testrun(struct tap_stats *stats, struct test_run *run) {
+    struct timespec zero = {0};
+
+    if (!run->inprocess) {
+        tap_histogram_add(
+            &stats->fork_ns,
+            tap_timespec_diff_ns(&run->duration.t0, &run->forked));
+    }
+    if (run->hup.tv_sec != zero.tv_sec || run->hup.tv_nsec != zero.tv_nsec) {
+        tap_histogram_add(&stats->reap_delay_ns,
+                          tap_timespec_diff_ns(&run->hup, &run->duration.t1));
+    }
+    tap_histogram_add(&stats->output_bytes, run->n_bytes_read);
+    stats->format_ns += run->format_ns;
+}
+
+/* Format ns as a duration, e.g. "1.2ms", into buf of TAP_DURATION_FMT_LEN */
+static const char *tap_stats_ns(uint64_t ns, char *buf) {
+    struct tap_duration d = tap_duration_from_ns(ns);
+
+    tap_duration_format(&d, buf);
+    return buf;
+}
+
+static int tap_stats_report_latency(struct tap_reporter *reporters,
+                                    const char *name,
+                                    struct tap_histogram *hist) {
+    char p50[TAP_DURATION_FMT_LEN], p99[TAP_DURATION_FMT_LEN];
+    char max[TAP_DURATION_FMT_LEN];
+
+    if (hist->count == 0) {
+        return 0;
+    }
+    return tap_report_comment(
+        reporters, NULL, "runner stats: %s p50 %s p99 %s max %s (n=%llu)",
+        name, tap_stats_ns(tap_histogram_percentile(hist, 50), p50),
+        tap_stats_ns(tap_histogram_percentile(hist, 99), p99),
+        tap_stats_ns(hist->max, max), (unsigned long long)hist->count);
+}
+
+int tap_stats_report(struct tap_stats *stats, struct tap_reporter *reporters) {
+    char format[TAP_DURATION_FMT_LEN];
+    struct tap_histogram *bytes = &stats->output_bytes;
+    int err;
+
+    err = tap_report_comment(
+        reporters, NULL, "runner stats: wakeups %llu (%llu wasted)",
+        (unsigned long long)stats->n_wakeups,
+        (unsigned long long)stats->n_wasted_wakeups);
+    if (err == 0) {
+        err = tap_stats_report_latency(reporters, "fork", &stats->fork_ns);
+    }
+    if (err == 0) {
+        err = tap_stats_report_latency(reporters, "exit to reap",
+                                       &stats->reap_delay_ns);
+    }
+    if (err == 0) {
+        err = tap_report_comment(
+            reporters, NULL,
+            "runner stats: output %llu bytes, per test p50 %llu max %llu,"
+            " formatting %s",
+            (unsigned long long)bytes->sum,
+            (unsigned long long)tap_histogram_percentile(bytes, 50),
+            (unsigned long long)bytes->max,
+            tap_stats_ns(stats->format_ns, format));
+    }
+    return err;
+}
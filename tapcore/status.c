@@ -0,0 +1,108 @@
+/**
+ * @file status.c
+ *
+ * Writes a snapshot of a test run in progress as a JSON document. The file is
+ * replaced atomically, readers never see a partially written snapshot.
+ */
+#define _GNU_SOURCE /* asprintf() */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <tapio.h>
+#include <tapstruct.h>
+#include <taptest.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "internal.h"
+
+/* Minimum time between snapshots while tests are running */
+#define TAP_STATUS_INTERVAL_NS (250 * 1000 * 1000)
+
+static double tap_status_since(struct timespec *now, struct timespec *then) {
+    struct tap_duration d = {.t0 = *then, .t1 = *now};
+
+    return tap_duration_to_double(&d);
+}
+
+static void tap_status_print(FILE *fp, struct tap_status *status,
+                             struct timespec *now) {
+    size_t n_busy = 0;
+    bool first = true;
+
+    for (size_t idx = 0; idx < status->n_slots; idx++) {
+        n_busy += status->running[idx].test.id != 0;
+    }
+
+    fprintf(fp, "{\"pid\":%ld,\"elapsed\":%.3f", (long)getpid(),
+            tap_status_since(now, &status->start));
+    fprintf(fp,
+            ",\"tests\":%zu,\"queued\":%zu,\"completed\":%zu,\"failed\":%zu"
+            ",\"skipped\":%zu",
+            status->n_tests, status->n_queued, status->n_completed,
+            status->n_failed, status->n_skipped);
+    fprintf(fp, ",\"slots\":%zu,\"busy\":%zu,\"running\":[", status->n_slots,
+            n_busy);
+    for (size_t idx = 0; idx < status->n_slots; idx++) {
+        struct test_run *run = &status->running[idx];
+
+        if (run->test.id == 0) {
+            continue;
+        }
+        fprintf(fp, "%s{\"slot\":%zu,\"test\":%zu,\"description\":",
+                first ? "" : ",", idx, run->test.id);
+        tap_json_string(fp, run->test.description);
+        fprintf(fp, ",\"elapsed\":%.3f}",
+                tap_status_since(now, &run->duration.t0));
+        first = false;
+    }
+    fputs("]}\n", fp);
+}
+
+int tap_status_update(struct tap_status *status, bool force) {
+    struct timespec now;
+    char *tmp_path;
+    FILE *fp;
+    int err = 0;
+
+    if (!status->path) {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (!force && status->written &&
+        (now.tv_sec - status->last_write.tv_sec) * 1000000000 +
+                (now.tv_nsec - status->last_write.tv_nsec) <
+            TAP_STATUS_INTERVAL_NS) {
+        return 0;
+    }
+
+    if (asprintf(&tmp_path, "%s.tmp", status->path) == -1) {
+        return ENOMEM;
+    }
+    fp = fopen(tmp_path, "w");
+    if (!fp) {
+        err = errno;
+        goto done;
+    }
+    tap_status_print(fp, status, &now);
+    if (fclose(fp) != 0) {
+        err = errno;
+        unlink(tmp_path);
+        goto done;
+    }
+    if (rename(tmp_path, status->path) != 0) {
+        err = errno;
+        unlink(tmp_path);
+        goto done;
+    }
+    status->last_write = now;
+    status->written = true;
+
+done:
+    free(tmp_path);
+    return err;
+}
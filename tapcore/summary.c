@@ -0,0 +1,127 @@
+/**
+ * @file summary.c
+ *
+ * Reports where the time of a run went: the slowest tests, and how well the
+ * tests were spread over the runner slots.
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <tapio.h>
+#include <tapstruct.h>
+#include <taptest.h>
+#include <time.h>
+
+#include "config.h"
+#include "internal.h"
+
+static uint64_t tap_duration_ns(struct tap_duration *d) {
+    return tap_timespec_diff_ns(&d->t0, &d->t1);
+}
+
+/* Slowest first, then in test order */
+static int tap_cmp_slowest(const void *lhs, const void *rhs) {
+    struct test_run *lrun = *(struct test_run *const *)lhs;
+    struct test_run *rrun = *(struct test_run *const *)rhs;
+    uint64_t lns, rns;
+
+    lns = tap_duration_ns(tap_testrun_duration(lrun));
+    rns = tap_duration_ns(tap_testrun_duration(rrun));
+    if (lns != rns) {
+        return lns < rns ? 1 : -1;
+    }
+    return lrun->test.id < rrun->test.id ? -1 : lrun->test.id > rrun->test.id;
+}
+
+static int tap_summary_slowest(struct test_run **sorted, size_t n_sorted,
+                               size_t n_slowest,
+                               struct tap_reporter *reporters) {
+    int err;
+
+    if (n_slowest > n_sorted) {
+        n_slowest = n_sorted;
+    }
+    err = tap_report_comment(reporters, NULL, "slowest %zu of %zu tests:",
+                             n_slowest, n_sorted);
+    for (size_t idx = 0; err == 0 && idx < n_slowest; idx++) {
+        struct test_run *run = sorted[idx];
+        char took[TAP_DURATION_FMT_LEN];
+
+        tap_duration_format(tap_testrun_duration(run), took);
+        if (run->test.description) {
+            err = tap_report_comment(reporters, NULL, "  test %zu - %s (%s)",
+                                     run->test.id, run->test.description,
+                                     took);
+        } else {
+            err = tap_report_comment(reporters, NULL, "  test %zu (%s)",
+                                     run->test.id, took);
+        }
+    }
+    return err;
+}
+
+int tap_report_summary(struct test_run *runs, size_t n_runs, size_t n_slots,
+                       struct tap_duration *suite, size_t n_slowest,
+                       struct tap_reporter *reporters) {
+    char suite_str[TAP_DURATION_FMT_LEN], wall_str[TAP_DURATION_FMT_LEN];
+    char cpu_str[TAP_DURATION_FMT_LEN], longest_str[TAP_DURATION_FMT_LEN];
+    uint64_t wall_ns = 0, cpu_ns = 0, suite_ns;
+    struct tap_duration wall, cpu;
+    struct test_run **sorted;
+    size_t n_sorted = 0;
+    int err;
+
+    sorted = calloc(n_runs ? n_runs : 1, sizeof(*sorted));
+    if (!sorted) {
+        return errno;
+    }
+    for (size_t idx = 0; idx < n_runs; idx++) {
+        struct test_run *run = &runs[idx];
+
+        if (!run->exited) {
+            continue;
+        }
+        sorted[n_sorted++] = run;
+        wall_ns += tap_duration_ns(tap_testrun_duration(run));
+        if (run->timed) {
+            cpu_ns += tap_duration_ns(&run->test_cpu);
+        }
+    }
+    qsort(sorted, n_sorted, sizeof(*sorted), tap_cmp_slowest);
+
+    err = tap_summary_slowest(sorted, n_sorted, n_slowest, reporters);
+    if (err != 0) {
+        goto done;
+    }
+
+    /* Tests kept every slot busy for the whole run at 100% efficiency */
+    suite_ns = tap_duration_ns(suite);
+    wall = tap_duration_from_ns(wall_ns);
+    cpu = tap_duration_from_ns(cpu_ns);
+    tap_duration_format(suite, suite_str);
+    tap_duration_format(&wall, wall_str);
+    tap_duration_format(&cpu, cpu_str);
+    err = tap_report_comment(reporters, NULL,
+                             "tests took %s wall and %s cpu in %s of suite"
+                             " wall time over %zu slot(s)",
+                             wall_str, cpu_str, suite_str, n_slots);
+    if (err != 0) {
+        goto done;
+    }
+    if (n_sorted > 0) {
+        tap_duration_format(tap_testrun_duration(sorted[0]), longest_str);
+    } else {
+        tap_duration_format(&(struct tap_duration){0}, longest_str);
+    }
+    err = tap_report_comment(
+        reporters, NULL,
+        "parallel efficiency %.0f%%, critical path at least %s (the longest"
+        " test)",
+        suite_ns && n_slots ? 100.0 * wall_ns / suite_ns / n_slots : 0.0,
+        longest_str);
+
+done:
+    free(sorted);
+    return err;
+}
@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -11,6 +12,7 @@
 #include <tapstruct.h>
 #include <taptest.h>
 #include <taputil.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "config.h"
@@ -23,6 +25,31 @@ struct TAP {
     struct test tests[MAX_TESTS];
     size_t n_tests;
     unsigned int n_runners;
+    bool threaded;
+    char *junit_path;
+    char *jsonl_path;
+    struct tap_output_opts output_opts;
+    char *spill_dir;
+    char *status_path;
+    char *trace_path;
+    bool show_stats;
+    size_t n_slowest;
+    char *baseline_path;
+    char *baseline_save_path;
+    struct tap_baseline_opts baseline_opts;
+    size_t n_repeats;
+    char *repeat_filter;
+    struct tap_resources resources;
+    struct tap_sched sched;
+    struct tap_limits limits;
+    size_t writer_size;
+    double time_budget;
+    char *journal_path;
+    bool resume;
+    char *worker_address;
+    double worker_wait;
+    /* Overheads of the last tap_runall() */
+    struct tap_stats stats;
 };
 
 /* Static variable used if no state is passed by caller */
@@ -46,33 +73,223 @@ static inline int get_or_create_handle(struct TAP **d_tap) {
     return 0;
 }
 
-static int tap_report_testrun(struct test_run *run) {
-    struct test *test = &run->test;
+bool tap_testrun_passed(struct test_run *run) {
     int wres = run->exitstatus;
-    const char *directive = NULL;
     bool passed = false;
-    int err;
 
-    if (WIFEXITED(wres)) {
+    if (run->inprocess) {
+        /* Match the exit status the test would have had as a process */
+        passed = (wres & 0xff) == 0;
+    } else if (WIFEXITED(wres)) {
         passed = WEXITSTATUS(wres) == 0;
-    } else if (WIFSIGNALED(wres)) {
-        const char *sig_name;
-        int sig;
+    }
 
-        sig = WTERMSIG(wres);
-        sig_name = strsignal(sig);
-        if (!sig_name) {
-            sig_name = "UNKNOWN";
+    /* Any failed assertion fails the test regardless of the exit status */
+    for (tap_cmd_t *cmd = run->subtests; cmd; cmd = cmd->next) {
+        if (cmd->type == tap_cmd_type_not_ok) {
+            passed = false;
         }
-        printf("# test %zu: terminated via %s(%d)\n", test->id, sig_name, sig);
-    } else {
-        printf("# test %zu: exited for unknown reason\n", test->id);
+    }
+    return passed;
+}
+
+/* Say why the test was terminated, naming the limit it ran into if any */
+static void tap_report_signal(struct tap_reporter *reporters,
+                              struct test *test, int sig) {
+    const struct tap_limits *limits = &test->limits;
+    const char *sig_name;
+
+    if (sig == SIGALRM && test->timeout > 0) {
+        char timeout[TAP_DURATION_FMT_LEN];
+        struct tap_duration d;
+
+        d = tap_duration_from_ns(test->timeout * 1e9);
+        tap_duration_format(&d, timeout);
+        tap_report_comment(reporters, test, "timed out after %s", timeout);
+        return;
+    }
+    if (sig == SIGXCPU && limits->cpu != 0 && limits->cpu != TAP_NO_LIMIT) {
+        tap_report_comment(reporters, test,
+                           "exceeded its CPU time limit of %lus",
+                           limits->cpu);
+        return;
+    }
+    if (sig == SIGXFSZ && limits->file_size != 0 &&
+        limits->file_size != TAP_NO_LIMIT) {
+        tap_report_comment(reporters, test,
+                           "exceeded its file size limit of %zu bytes",
+                           limits->file_size);
+        return;
+    }
+
+    sig_name = strsignal(sig);
+    if (!sig_name) {
+        sig_name = "UNKNOWN";
+    }
+    tap_report_comment(reporters, test, "terminated via %s(%d)", sig_name,
+                       sig);
+}
+
+int tap_report_testrun(struct test_run *run, struct tap_baseline *baseline,
+                       const struct tap_baseline_opts *baseline_opts) {
+    struct tap_reporter *reporters = run->reporters;
+    struct test *test = &run->test;
+    int wres = run->exitstatus;
+    struct tap_duration overhead, base;
+    struct tap_testpoint point;
+    const char *directive = NULL;
+    char regression[96];
+    bool passed;
+
+    passed = tap_testrun_passed(run);
+    if (run->cancelled) {
+        /* Cut short by the runner, not failed by the test */
+        passed = true;
+        directive = TAP_DIRECTIVE_SKIP " time budget";
+        tap_report_comment(reporters, test,
+                           "cancelled as the time budget ran out");
+    } else if (run->replayed) {
+        /* Whatever the test printed was reported by the run journaling it */
+        tap_report_comment(reporters, test, "result replayed from the journal");
+    } else if (!run->inprocess && WIFSIGNALED(wres)) {
+        tap_report_signal(reporters, test, WTERMSIG(wres));
+    } else if (!run->inprocess && !WIFEXITED(wres)) {
+        tap_report_comment(reporters, test, "exited for unknown reason");
     }
 
-    if (tap_cmd_is_directive(run->cmd)) {
+    if (!run->cancelled && tap_cmd_is_directive(run->cmd)) {
         directive = run->cmd->str;
     }
-    err = tap_print_testpoint(passed, test, &run->duration, directive);
+    point = (struct tap_testpoint){
+        .success = passed,
+        .test = test,
+        .duration = &run->duration,
+        .directive = directive,
+        .subtests = run->subtests,
+    };
+    point.duration = tap_testrun_duration(run);
+    if (run->timed) {
+        point.cpu = &run->test_cpu;
+    }
+    if (run->timed && !run->inprocess) {
+        uint64_t total_ns, test_ns;
+
+        /* Whatever the runner added around the test, fork to reap */
+        total_ns = tap_timespec_diff_ns(&run->duration.t0, &run->duration.t1);
+        test_ns = tap_timespec_diff_ns(&run->test_wall.t0, &run->test_wall.t1);
+        overhead = tap_duration_from_ns(total_ns > test_ns ? total_ns - test_ns
+                                                           : 0);
+        point.overhead = &overhead;
+    }
+    if (tap_baseline_regressed(baseline, test, point.duration, &base)) {
+        char now_str[TAP_DURATION_FMT_LEN], base_str[TAP_DURATION_FMT_LEN];
+
+        tap_duration_format(point.duration, now_str);
+        tap_duration_format(&base, base_str);
+        snprintf(regression, sizeof(regression),
+                 TAP_DIRECTIVE_TODO " slower than baseline: %s, was %s",
+                 now_str, base_str);
+        /* Never hide a real failure, or override the test's own directive */
+        if (baseline_opts->todo && passed && !directive) {
+            point.success = false;
+            point.directive = regression;
+        } else {
+            tap_report_comment(reporters, test, "%s",
+                               regression + sizeof(TAP_DIRECTIVE_TODO));
+        }
+    }
+    return tap_report_testpoint(reporters, &point);
+}
+
+static void tap_status_finished(struct tap_status *status,
+                                struct test_run *run) {
+    status->n_completed++;
+    if (run->cancelled || (run->cmd && run->cmd->type == tap_cmd_type_skip)) {
+        status->n_skipped++;
+    } else if (!tap_cmd_is_directive(run->cmd) && !tap_testrun_passed(run)) {
+        status->n_failed++;
+    }
+}
+
+static void tap_status_write(struct tap_status *status,
+                             struct tap_reporter *reporters, bool force) {
+    int err;
+
+    err = tap_status_update(status, force);
+    if (err != 0) {
+        /* Not worth failing the tests over, stop trying */
+        tap_report_comment(reporters, NULL,
+                           "failed to write status file %s: %s(%d)",
+                           status->path, strerror(err), err);
+        status->path = NULL;
+    }
+}
+
+const char *tap_bailout_reason(tap_cmd_t *cmd) {
+    const char *reason;
+
+    /* Reporters add their own bail out marker to the reason */
+    reason = cmd->str + sizeof(TAP_BAILOUT) - 1;
+    for (; *reason == ' '; reason++)
+        ;
+    return reason;
+}
+
+static int tap_set_path(char **d_path, const char *path) {
+    char *copy = NULL;
+
+    if (path) {
+        copy = strdup(path);
+        if (!copy) {
+            return errno;
+        }
+    }
+    free(*d_path);
+    *d_path = copy;
+    return 0;
+}
+
+static void tap_add_reporter(struct tap_reporter **d_reporters,
+                             struct tap_reporter *reporter) {
+    for (; *d_reporters; d_reporters = &(*d_reporters)->next)
+        ;
+    *d_reporters = reporter;
+}
+
+static int tap_reporters_ctor(struct TAP *tap,
+                              struct tap_reporter **d_reporters) {
+    struct tap_reporter *reporters = NULL;
+    struct tap_reporter *reporter;
+    int err;
+
+    /* TAP on stdout is always reported, other formats are on request */
+    err = tap_reporter_tap_ctor(&reporter);
+    if (err != 0) {
+        return err;
+    }
+    tap_add_reporter(&reporters, reporter);
+
+    if (tap->junit_path) {
+        err = tap_reporter_junit_ctor(tap->junit_path, &reporter);
+        if (err != 0) {
+            goto failed;
+        }
+        tap_add_reporter(&reporters, reporter);
+    }
+
+    if (tap->jsonl_path) {
+        err = tap_reporter_jsonl_ctor(tap->jsonl_path, &reporter);
+        if (err != 0) {
+            goto failed;
+        }
+        tap_add_reporter(&reporters, reporter);
+    }
+
+    *d_reporters = reporters;
+    return 0;
+
+failed:
+    tap_reporters_dtor(reporters);
     return err;
 }
 
@@ -87,33 +304,149 @@ int tap_init(struct TAP **d_tap) {
         return errno;
     }
 
+    tap->baseline_opts.threshold = 0.5;
+    tap->baseline_opts.noise_floor = 0.005;
+    tap->worker_wait = 10.0;
+
     *d_tap = tap;
     return 0;
 }
 
 int tap_set_option(TAP *tap, TAP_OPTION option, ...) {
+    unsigned int policy;
     va_list ap;
     int err;
 
-    if (option != TAP_OPTION_N_RUNNERS) {
-        return EINVAL;
-    }
-
     err = get_or_create_handle(&tap);
     if (err != 0) {
         return err;
     }
 
     va_start(ap, option);
-    tap->n_runners = va_arg(ap, int);
+    switch (option) {
+        case TAP_OPTION_N_RUNNERS:
+            tap->n_runners = va_arg(ap, int);
+            break;
+        case TAP_OPTION_THREADED:
+            tap->threaded = va_arg(ap, int) != 0;
+            break;
+        case TAP_OPTION_JUNIT_FILE:
+            err = tap_set_path(&tap->junit_path, va_arg(ap, const char *));
+            break;
+        case TAP_OPTION_JSONL_FILE:
+            err = tap_set_path(&tap->jsonl_path, va_arg(ap, const char *));
+            break;
+        case TAP_OPTION_OUTPUT_MAX_BYTES:
+            tap->output_opts.max_bytes = va_arg(ap, size_t);
+            break;
+        case TAP_OPTION_OUTPUT_MAX_LINES:
+            tap->output_opts.max_lines = va_arg(ap, size_t);
+            break;
+        case TAP_OPTION_OUTPUT_SPILL_DIR:
+            err = tap_set_path(&tap->spill_dir, va_arg(ap, const char *));
+            tap->output_opts.spill_dir = tap->spill_dir;
+            break;
+        case TAP_OPTION_COLLAPSE_REPEATS:
+            tap->output_opts.collapse_repeats = va_arg(ap, int) != 0;
+            break;
+        case TAP_OPTION_STATUS_FILE:
+            err = tap_set_path(&tap->status_path, va_arg(ap, const char *));
+            break;
+        case TAP_OPTION_TRACE_FILE:
+            err = tap_set_path(&tap->trace_path, va_arg(ap, const char *));
+            break;
+        case TAP_OPTION_STATS:
+            tap->show_stats = va_arg(ap, int) != 0;
+            break;
+        case TAP_OPTION_SLOWEST:
+            tap->n_slowest = va_arg(ap, size_t);
+            break;
+        case TAP_OPTION_BASELINE_FILE:
+            err = tap_set_path(&tap->baseline_path, va_arg(ap, const char *));
+            tap->baseline_opts.path = tap->baseline_path;
+            break;
+        case TAP_OPTION_BASELINE_SAVE_FILE:
+            err = tap_set_path(&tap->baseline_save_path,
+                               va_arg(ap, const char *));
+            tap->baseline_opts.save_path = tap->baseline_save_path;
+            break;
+        case TAP_OPTION_BASELINE_THRESHOLD:
+            tap->baseline_opts.threshold = va_arg(ap, double);
+            break;
+        case TAP_OPTION_BASELINE_NOISE_FLOOR:
+            tap->baseline_opts.noise_floor = va_arg(ap, double);
+            break;
+        case TAP_OPTION_BASELINE_TODO:
+            tap->baseline_opts.todo = va_arg(ap, int) != 0;
+            break;
+        case TAP_OPTION_REPEAT:
+            tap->n_repeats = va_arg(ap, size_t);
+            break;
+        case TAP_OPTION_REPEAT_FILTER:
+            err = tap_set_path(&tap->repeat_filter, va_arg(ap, const char *));
+            break;
+        case TAP_OPTION_TIME_BUDGET:
+            tap->time_budget = va_arg(ap, double);
+            if (tap->time_budget < 0) {
+                tap->time_budget = 0;
+                err = EINVAL;
+            }
+            break;
+        case TAP_OPTION_WRITER_THREAD:
+            tap->writer_size = va_arg(ap, size_t);
+            break;
+        case TAP_OPTION_LIMITS:
+            tap->limits = *va_arg(ap, const struct tap_limits *);
+            break;
+        case TAP_OPTION_JOURNAL_FILE:
+            err = tap_set_path(&tap->journal_path, va_arg(ap, const char *));
+            break;
+        case TAP_OPTION_RESUME:
+            tap->resume = va_arg(ap, int) != 0;
+            break;
+        case TAP_OPTION_WORKER_LISTEN:
+            err = tap_set_path(&tap->worker_address,
+                               va_arg(ap, const char *));
+            break;
+        case TAP_OPTION_WORKER_WAIT:
+            tap->worker_wait = va_arg(ap, double);
+            if (tap->worker_wait < 0) {
+                tap->worker_wait = 0;
+                err = EINVAL;
+            }
+            break;
+        case TAP_OPTION_MEMORY_BUDGET:
+            tap->resources.memory_budget = va_arg(ap, size_t);
+            break;
+        case TAP_OPTION_SCHEDULER:
+            policy = va_arg(ap, int);
+            if (policy > TAP_SCHED_LONGEST_FIRST) {
+                err = EINVAL;
+                break;
+            }
+            tap->sched.policy = policy;
+            break;
+        case TAP_OPTION_SCHEDULER_PICK:
+            tap->sched.pick = va_arg(ap, tap_pick_t);
+            tap->sched.priv = va_arg(ap, void *);
+            break;
+        default:
+            err = EINVAL;
+            break;
+    }
     va_end(ap);
-    return 0;
+    return err;
 }
 
-int tap_register(struct TAP *tap, test_t funct, const char *in_description) {
-    char *description = NULL;
+int tap_register_ex(struct TAP *tap, test_t funct,
+                    const struct tap_test_attrs *attrs) {
+    char *description = NULL, *tags = NULL;
+    uint64_t resource_mask = 0;
     int err;
 
+    if (attrs->cost < 0 || attrs->timeout < 0) {
+        return EINVAL;
+    }
     err = get_or_create_handle(&tap);
     if (err != 0) {
         return err;
@@ -121,11 +454,25 @@ int tap_register(struct TAP *tap, test_t funct, const char *in_description) {
 
     assert(tap->n_tests + 1 < MAX_TESTS);
 
-    if (in_description) {
-        err = tap_trim_string(in_description, &description);
+    if (attrs->resources) {
+        err = tap_resources_parse(&tap->resources, attrs->resources,
+                                  &resource_mask);
         if (err != 0) {
             return err;
         }
+    }
+    if (attrs->tags) {
+        tags = strdup(attrs->tags);
+        if (!tags) {
+            return errno;
+        }
+    }
+    if (attrs->description) {
+        err = tap_trim_string(attrs->description, &description);
+        if (err != 0) {
+            free(tags);
+            return err;
+        }
         tap_replace_string(description, '\n', ' ');
     }
 
@@ -133,21 +480,181 @@ int tap_register(struct TAP *tap, test_t funct, const char *in_description) {
         .id = tap->n_tests + 1,
         .funct = funct,
         .description = description,
+        .n_instances = attrs->n_instances,
+        .resources = resource_mask,
+        .priority = attrs->priority,
+        .cost = attrs->cost,
+        .tags = tags,
+        .timeout = attrs->timeout,
+        .memory = attrs->memory,
+        .limits = attrs->limits,
     };
     tap->n_tests++;
     return 0;
 }
 
+int tap_register(struct TAP *tap, test_t funct, const char *description) {
+    struct tap_test_attrs attrs = {.description = description};
+
+    return tap_register_ex(tap, funct, &attrs);
+}
+
+int tap_register_concurrent(struct TAP *tap, test_t funct, size_t n_instances,
+                            const char *description) {
+    struct tap_test_attrs attrs = {
+        .description = description,
+        .n_instances = n_instances,
+    };
+
+    if (n_instances < 1) {
+        return EINVAL;
+    }
+    return tap_register_ex(tap, funct, &attrs);
+}
+
+int tap_register_resources(struct TAP *tap, test_t funct,
+                           const char *resources, const char *description) {
+    struct tap_test_attrs attrs = {
+        .description = description,
+        .resources = resources,
+    };
+
+    if (!resources) {
+        return EINVAL;
+    }
+    return tap_register_ex(tap, funct, &attrs);
+}
+
+/* Run the tests a runner leases and exit, if the program is a worker, see
+ * TAP_ENV_WORKER */
+static void tap_serve_worker(struct TAP *tap, size_t n_slots) {
+    const char *address;
+
+    address = getenv(TAP_ENV_WORKER);
+    if (!address) {
+        return;
+    }
+    exit(tap_remote_work(tap->tests, tap->n_tests, &tap->limits, address,
+                         n_slots));
+}
+
+/* Answer a driver instead of running the tests, see TAP_ENV_LIST. Returns
+ * ENOENT when the program is not being driven */
+static int tap_serve_driver(struct TAP *tap) {
+    struct test test;
+    const char *str;
+    char *end;
+    unsigned long id;
+
+    if (getenv(TAP_ENV_LIST)) {
+        tap_string_t resources;
+
+        tap_string_init(&resources);
+        for (size_t idx = 0; idx < tap->n_tests; idx++) {
+            struct test *test = &tap->tests[idx];
+
+            tap_string_clear(&resources);
+            if (tap_resources_format(&tap->resources, test->resources,
+                                     &resources) != 0) {
+                exit(ENOMEM);
+            }
+            printf("%zu\t%s\t%s\n", test->id, tap_string_borrow(&resources),
+                   test->description ? test->description : "");
+        }
+        fflush(stdout);
+        exit(0);
+    }
+
+    str = getenv(TAP_ENV_RUN);
+    if (!str) {
+        return ENOENT;
+    }
+    errno = 0;
+    id = strtoul(str, &end, 10);
+    if (errno != 0 || *end != '\0' || id == 0 || id > tap->n_tests) {
+        fprintf(stderr, "%s: no test %s to run\n", TAP_ENV_RUN, str);
+        return EINVAL;
+    }
+    /* Programs the test runs itself are not being driven */
+    unsetenv(TAP_ENV_RUN);
+    test = tap->tests[id - 1];
+    tap_limits_merge(&test.limits, &tap->limits);
+    tap_run_test_and_exit(&test);
+}
+
+/* A run of a test that was never started, reported as skipped for reason */
+static int tap_skip_testrun(struct test *test, struct tap_reporter *reporters,
+                            const struct tap_output_opts *output_opts,
+                            const char *reason, struct test_run *run) {
+    char line[128];
+    int len;
+
+    *run = (struct test_run){
+        .test = *test,
+        .reporters = reporters,
+        .output_opts = output_opts,
+        .outfd = -1,
+        .pid = -1,
+        .inprocess = true,
+    };
+    clock_gettime(CLOCK_MONOTONIC, &run->duration.t0);
+    run->duration.t1 = run->duration.t0;
+    len = snprintf(line, sizeof(line), ":" TAP_DIRECTIVE_SKIP " %s\n", reason);
+    run->exited = true;
+    return tap_process_testrun_buffer(run, line, len);
+}
+
+/* Kill the running tests once the time budget is up, to be reaped as usual */
+static void tap_cancel_testruns(struct test_run *running, size_t n_slots) {
+    for (size_t ridx = 0; ridx < n_slots; ridx++) {
+        struct test_run *run = &running[ridx];
+
+        if (run->test.id != 0 && run->pid > 0) {
+            kill(run->pid, SIGKILL);
+            run->cancelled = true;
+        }
+    }
+}
+
 int tap_runall(struct TAP *tap) {
     struct test_run runs[MAX_TESTS] = {0};
     struct test_run running[MAX_TEST_PROCESSES] = {0};
-    struct pollfd fds[MAX_TEST_PROCESSES];
-    size_t n_running_slots, next_testid;
-    unsigned int n_running, n_finished;
-    bool bailed = false;
-    int err = 0;
+    /* One more for the jobserver */
+    struct pollfd fds[MAX_TEST_PROCESSES + 1];
+    struct tap_reporter *reporters = NULL;
+    struct tap_trace *trace = NULL;
+    struct tap_baseline *baseline = NULL;
+    struct tap_repeat *repeats = NULL;
+    struct tap_jobserver *jobserver = NULL;
+    struct tap_journal *journal = NULL;
+    /* Jobs of each test still to be started */
+    size_t n_left[MAX_TESTS];
+    size_t n_running_slots, next_testid, n_jobs;
+    unsigned int n_running, n_finished, n_replayed;
+    struct timespec report_t0, report_t1;
+    struct tap_duration suite;
+    struct tap_status status;
+    struct tap_sched sched;
+    /* Once the time budget is up */
+    struct timespec deadline;
+    bool bailed = false, need_token, out_of_time = false;
+    int err = 0, journal_err, trace_err;
 
     tap = get_handle(tap);
+    tap->stats = (struct tap_stats){0};
+
+    err = tap_serve_driver(tap);
+    if (err != ENOENT) {
+        return err;
+    }
+    err = 0;
+
+    /* Each repetition of a test is a job of its own */
+    n_jobs = 0;
+    for (size_t idx = 0; idx < tap->n_tests; idx++) {
+        n_jobs += tap_repeat_count(tap->n_repeats, tap->repeat_filter,
+                                   &tap->tests[idx]);
+    }
 
     for (size_t idx = 0; idx < MAX_TEST_PROCESSES; idx++) {
         running[idx] = (struct test_run){.outfd = -1, .pid = -1};
@@ -159,23 +666,277 @@ int tap_runall(struct TAP *tap) {
         /* Default to using all cores. One will monitor the tests */
         n_running_slots = sysconf(_SC_NPROCESSORS_ONLN) - 1;
     }
-    if (tap->n_tests < n_running_slots) {
-        n_running_slots = tap->n_tests;
+    if (n_running_slots < 1) {
+        /* Single core hosts still need somewhere to run the tests */
+        n_running_slots = 1;
+    }
+    if (n_jobs < n_running_slots) {
+        n_running_slots = n_jobs;
     }
     if (n_running_slots > MAX_TEST_PROCESSES) {
         n_running_slots = MAX_TEST_PROCESSES;
     }
+    tap_serve_worker(tap, n_running_slots);
+
+    err = tap_reporters_ctor(tap, &reporters);
+    if (err != 0) {
+        printf(TAP_BAILOUT " internal test runner error %s(%d)\n",
+               strerror(err), err);
+        return err;
+    }
+    if (tap->writer_size > 0) {
+        err = tap_out_start_writer(tap->writer_size);
+        if (err != 0) {
+            /* Carry on writing from the runner, only slower */
+            tap_report_comment(reporters, NULL,
+                               "failed to start writer thread: %s(%d)",
+                               strerror(err), err);
+            err = 0;
+        }
+    }
+
+    status = (struct tap_status){
+        .path = tap->status_path,
+        .n_tests = n_jobs,
+        .n_queued = n_jobs,
+        .running = running,
+        .n_slots = n_running_slots,
+    };
+    clock_gettime(CLOCK_MONOTONIC, &status.start);
+
+    tap_report_plan(reporters, tap->n_tests);
+    tap_status_write(&status, reporters, true);
+    if (tap->trace_path) {
+        err = tap_trace_ctor(tap->trace_path, n_running_slots, &trace);
+        if (err != 0) {
+            /* Carry on without a trace, it only observes the run */
+            tap_report_comment(reporters, NULL,
+                               "failed to open trace file %s: %s(%d)",
+                               tap->trace_path, strerror(err), err);
+            err = 0;
+        }
+    }
+    if (tap->baseline_path) {
+        err = tap_baseline_ctor(&tap->baseline_opts, tap->tests, tap->n_tests,
+                                &baseline);
+        if (err != 0) {
+            /* A first run has no baseline yet, compare with nothing */
+            tap_report_comment(reporters, NULL,
+                               "failed to read baseline file %s: %s(%d)",
+                               tap->baseline_path, strerror(err), err);
+            err = 0;
+        }
+    }
+    /* Tests that did not say what memory they need are taken at their word
+     * from the last run, before the threaded engine passes over them */
+    for (size_t idx = 0; tap->resources.memory_budget > 0 && baseline &&
+                         idx < tap->n_tests;
+         idx++) {
+        struct test *test = &tap->tests[idx];
+
+        if (test->memory == 0) {
+            test->memory = tap_baseline_memory(baseline, test);
+        }
+    }
+    err = tap_jobserver_ctor(n_running_slots, &jobserver);
+    if (err != 0 && err != ENOENT) {
+        /* Carry on as if make had not asked to share its job slots */
+        tap_report_comment(reporters, NULL,
+                           "failed to join make's jobserver: %s(%d)",
+                           strerror(err), err);
+    }
+    err = 0;
+    if (n_jobs > tap->n_tests) {
+        repeats = calloc(tap->n_tests, sizeof(*repeats));
+        if (!repeats) {
+            err = errno;
+            bailed = true;
+        }
+        for (size_t idx = 0; repeats && idx < tap->n_tests; idx++) {
+            size_t n_reps;
+
+            n_reps = tap_repeat_count(tap->n_repeats, tap->repeat_filter,
+                                      &tap->tests[idx]);
+            if (n_reps > 1 && err == 0) {
+                err = tap_repeat_ctor(n_reps, &repeats[idx]);
+                bailed = err != 0;
+            }
+        }
+    }
+    if (tap->journal_path && !bailed) {
+        err = tap_journal_ctor(tap->journal_path, tap->resume, tap->n_tests,
+                               &journal);
+        if (err != 0) {
+            /* Carry on without a journal, the run just cannot be resumed */
+            tap_report_comment(reporters, NULL,
+                               "failed to open journal file %s: %s(%d)",
+                               tap->journal_path, strerror(err), err);
+            err = 0;
+        }
+    }
+    n_finished = 0;
+    n_replayed = 0;
+    /* Tests finished before the run was cut short are not run again */
+    for (size_t idx = 0; journal && idx < tap->n_tests; idx++) {
+        err = tap_journal_replay(journal, &tap->tests[idx], reporters,
+                                 &tap->output_opts, &runs[idx]);
+        if (err == ENOENT) {
+            err = 0;
+            continue;
+        } else if (err != 0) {
+            bailed = true;
+            break;
+        }
+        status.n_queued -= tap_repeat_count(
+            tap->n_repeats, tap->repeat_filter, &tap->tests[idx]);
+        tap_status_finished(&status, &runs[idx]);
+        n_finished++;
+        n_replayed++;
+    }
+    /* Every run of a test adds to its spill file, start from none */
+    for (size_t idx = 0; tap->spill_dir && idx < tap->n_tests; idx++) {
+        char path[PATH_MAX];
+
+        if (!runs[idx].replayed &&
+            tap_output_spill_path(&tap->output_opts, tap->tests[idx].id, path,
+                                  sizeof(path)) == 0) {
+            unlink(path);
+        }
+    }
+    /* Workers get the first go at the tests, else the threaded engine.
+     * Repetitions are all forked, to run side by side over the slots. Limits
+     * are per process, the engine's CPU time would be shared by every test */
+    if (tap->worker_address && n_jobs == tap->n_tests &&
+        tap->time_budget == 0 && !bailed) {
+        err = tap_run_remote(tap->tests, tap->n_tests, tap->worker_address,
+                             tap->worker_wait, &tap->limits, reporters,
+                             &tap->output_opts, runs);
+        if (err != 0) {
+            /* Whatever the workers did not finish is run here */
+            tap_report_comment(reporters, NULL,
+                               "failed to lease tests to workers on %s: "
+                               "%s(%d)",
+                               tap->worker_address, strerror(err), err);
+            err = 0;
+        }
+        for (size_t idx = 0; idx < tap->n_tests; idx++) {
+            if (!runs[idx].exited || runs[idx].replayed) {
+                continue;
+            }
+            if (tap_cmd_is_bailed(runs[idx].cmd)) {
+                bailed = true;
+            }
+            status.n_queued--;
+            tap_status_finished(&status, &runs[idx]);
+            tap_journal_add(journal, &runs[idx]);
+            n_finished++;
+        }
+        tap_status_write(&status, reporters, false);
+    } else if (tap->threaded && tap->n_tests > 0 &&
+               n_jobs == tap->n_tests && !tap_limits_set(&tap->limits) &&
+               tap->time_budget == 0 && n_replayed == 0) {
+        unsigned int n_threads = 1;
+
+        /* The engine is one process, but each thread beyond the first is
+         * still a job of make's */
+        while (n_threads < n_running_slots &&
+               tap_jobserver_reserve(jobserver, n_threads)) {
+            n_threads++;
+        }
+        err = tap_run_threaded(tap->tests, tap->n_tests, n_threads,
+                               &tap->limits, reporters, &tap->output_opts,
+                               runs);
+        bailed = err != 0;
+        tap_jobserver_fit(jobserver, 0);
+
+        /* Anything the engine did not finish is re-run as a process */
+        for (size_t idx = 0; idx < tap->n_tests; idx++) {
+            if (!runs[idx].exited) {
+                continue;
+            }
+            if (tap_cmd_is_bailed(runs[idx].cmd)) {
+                bailed = true;
+            }
+            status.n_queued--;
+            tap_status_finished(&status, &runs[idx]);
+            tap_stats_testrun(&tap->stats, &runs[idx]);
+            tap_trace_threaded(trace, &runs[idx]);
+            tap_journal_add(journal, &runs[idx]);
+            n_finished++;
+        }
+        tap_status_write(&status, reporters, false);
+    }
+
+    /* Tests finished by the threaded engine have nothing left to run */
+    for (size_t idx = 0; idx < tap->n_tests; idx++) {
+        n_left[idx] = runs[idx].exited
+                          ? 0
+                          : tap_repeat_count(tap->n_repeats,
+                                             tap->repeat_filter,
+                                             &tap->tests[idx]);
+    }
+
+    sched = tap->sched;
+    if (tap->time_budget > 0 && !bailed) {
+        bool fits[MAX_TESTS];
+        time_t secs = tap->time_budget;
+
+        deadline = status.start;
+        deadline.tv_sec += secs;
+        deadline.tv_nsec += (tap->time_budget - secs) * 1e9;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        err = tap_budget_select(tap->tests, tap->n_tests, n_left, baseline,
+                                tap->time_budget, n_running_slots,
+                                sched.policy == TAP_SCHED_PRIORITY, fits);
+        bailed = err != 0;
+        for (size_t idx = 0; !bailed && idx < tap->n_tests; idx++) {
+            if (n_left[idx] == 0 || fits[idx]) {
+                continue;
+            }
+            err = tap_skip_testrun(&tap->tests[idx], reporters,
+                                   &tap->output_opts, "time budget",
+                                   &runs[idx]);
+            bailed = err != 0;
+            status.n_queued -= n_left[idx];
+            n_left[idx] = 0;
+            tap_status_finished(&status, &runs[idx]);
+            n_finished++;
+        }
+        /* The most tests get done by the deadline doing the shortest first */
+        if (sched.policy == TAP_SCHED_FIFO) {
+            sched.policy = TAP_SCHED_SHORTEST_FIRST;
+        }
+    }
 
     /* Trigger and wait on tests */
-    printf("1..%zu\n", tap->n_tests);
-    for (next_testid = 0, n_running = 0, n_finished = 0;
-         (n_finished < tap->n_tests && !bailed) || n_running > 0;) {
+    for (next_testid = 0, n_running = 0;
+         (n_finished < tap->n_tests && !bailed && !out_of_time) ||
+         n_running > 0;) {
+        struct timespec now;
+
+        /* Write out the last round of output once, before any fork */
+        tap_out_flush();
+        need_token = false;
+
+        if (tap->time_budget > 0 && !out_of_time) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (tap_timespec_diff_ns(&now, &deadline) == 0) {
+                out_of_time = true;
+                tap_cancel_testruns(running, n_running_slots);
+            }
+        }
+
         /* Start tests in any free slots */
-        for (size_t ridx = 0;
-             ridx < n_running_slots && next_testid < tap->n_tests && !bailed;
+        for (size_t ridx = 0; ridx < n_running_slots &&
+                              next_testid < tap->n_tests && !bailed &&
+                              !out_of_time;
              ridx++) {
             struct test_run *run;
             struct test *test;
+            size_t idx;
 
             run = &running[ridx];
             if (run->test.id != 0) {
@@ -183,17 +944,44 @@ int tap_runall(struct TAP *tap) {
                 continue;
             }
 
-            test = &tap->tests[next_testid];
-            err = tap_start_testrun(test, run);
+            for (; next_testid < tap->n_tests && n_left[next_testid] == 0;
+                 next_testid++)
+                ;
+            idx = tap_sched_pick(&sched, tap->tests, tap->n_tests,
+                                 n_left, next_testid, &tap->resources,
+                                 n_running == 0);
+            if (idx >= tap->n_tests) {
+                /* Whatever is left waits on a resource */
+                break;
+            }
+
+            /* Every test beside the first needs a token of make's */
+            if (!tap_jobserver_reserve(jobserver, n_running)) {
+                need_token = true;
+                break;
+            }
+            test = &tap->tests[idx];
+            err = tap_start_testrun(test, &tap->limits, reporters,
+                                    &tap->output_opts, run);
             if (err != 0) {
                 bailed = true;
                 break;
             }
-            next_testid++;
+            /* Repetitions go out back to back, so copies run at once */
+            n_left[idx]--;
+            tap_resources_acquire(&tap->resources, test);
             n_running++;
+            status.n_queued--;
         }
 
-        err = tap_wait_for_testrun(running, n_running_slots, fds);
+        /* Tokens freed up by reaped tests and not reused go back to make */
+        tap_jobserver_fit(jobserver, n_running);
+
+        err = tap_wait_for_testrun(
+            running, n_running_slots, fds,
+            need_token ? tap_jobserver_fd(jobserver) : -1,
+            tap->time_budget > 0 && !out_of_time ? &deadline : NULL, trace,
+            &tap->stats);
         if (err != 0) {
             bailed = true;
             break;
@@ -217,14 +1005,55 @@ int tap_runall(struct TAP *tap) {
             if (!run->exited || run->test.id == 0) {
                 continue;
             }
-            runs[run->test.id - 1] = *run;
+            run->slot = ridx + 1;
+            tap_resources_release(&tap->resources, &run->test);
+            tap_status_finished(&status, run);
+            tap_stats_testrun(&tap->stats, run);
+            tap_trace_testrun(trace, run);
+            if (repeats && repeats[run->test.id - 1].n_reps > 1) {
+                struct tap_repeat *rep = &repeats[run->test.id - 1];
+
+                tap_repeat_add(rep, run);
+                if (rep->n_done == rep->n_reps) {
+                    runs[rep->kept.test.id - 1] = rep->kept;
+                    tap_journal_add(journal, &rep->kept);
+                    n_finished++;
+                }
+            } else {
+                runs[run->test.id - 1] = *run;
+                tap_journal_add(journal, run);
+                n_finished++;
+            }
             running[ridx] = (struct test_run){.outfd = -1, .pid = -1};
-            n_finished++;
             n_running--;
         }
+        tap_status_write(&status, reporters, false);
     }
+    /* Report what repetitions there were of tests cut short by a bail */
+    for (size_t idx = 0; repeats && idx < tap->n_tests; idx++) {
+        struct tap_repeat *rep = &repeats[idx];
+
+        if (rep->n_done > 0 && rep->n_done < rep->n_reps) {
+            runs[idx] = rep->kept;
+        }
+    }
+    /* Tests the time budget ran out on before they could start */
+    for (size_t idx = 0; out_of_time && !bailed && idx < tap->n_tests;
+         idx++) {
+        if (runs[idx].test.id != 0) {
+            continue;
+        }
+        err = tap_skip_testrun(&tap->tests[idx], reporters, &tap->output_opts,
+                               "time budget", &runs[idx]);
+        bailed = err != 0;
+        tap_status_finished(&status, &runs[idx]);
+    }
+    tap_status_write(&status, reporters, true);
+    suite = (struct tap_duration){.t0 = status.start};
+    clock_gettime(CLOCK_MONOTONIC, &suite.t1);
 
     /* Report testruns up to first bail */
+    clock_gettime(CLOCK_MONOTONIC, &report_t0);
     for (size_t idx = 0; idx < ARRAY_LEN(runs); idx++) {
         struct test_run *run;
 
@@ -233,26 +1062,88 @@ int tap_runall(struct TAP *tap) {
         if (!run->exited) {
             break;
         } else if (tap_cmd_is_bailed(run->cmd)) {
-            err = tap_print_line(run->cmd->str);
+            tap_report_bailout(reporters, "%s", tap_bailout_reason(run->cmd));
             break;
         }
-        tap_report_testrun(run);
+        if (repeats && repeats[idx].n_reps > 1 && !run->replayed) {
+            tap_repeat_report(&repeats[idx], reporters, &run->test);
+        }
+        tap_report_testrun(run, baseline, &tap->baseline_opts);
+        tap_trace_reported(trace, run);
+    }
+    if (tap->baseline_save_path && !bailed) {
+        int save_err;
+
+        save_err = tap_baseline_save(tap->baseline_save_path, runs,
+                                     tap->n_tests);
+        if (save_err != 0) {
+            tap_report_comment(reporters, NULL,
+                               "failed to save baseline file %s: %s(%d)",
+                               tap->baseline_save_path, strerror(save_err),
+                               save_err);
+        }
+    }
+    /* Summarise before the runs are cleaned up */
+    if (tap->n_slowest > 0) {
+        tap_report_summary(runs, tap->n_tests, n_running_slots, &suite,
+                           tap->n_slowest, reporters);
     }
     /* Cleanup after all testruns */
     for (size_t idx = 0; idx < ARRAY_LEN(runs); idx++) {
         struct test_run *run;
 
         run = &runs[idx];
+        /* Runs never started are zeroed, their outfd of 0 is not theirs */
+        if (run->test.id == 0) {
+            continue;
+        }
         tap_cleanup_testrun(run);
     }
 
+    clock_gettime(CLOCK_MONOTONIC, &report_t1);
+    tap->stats.format_ns += tap_timespec_diff_ns(&report_t0, &report_t1);
+
+    if (tap->show_stats) {
+        tap_stats_report(&tap->stats, reporters);
+    }
+    journal_err = tap_journal_dtor(journal);
+    if (journal_err != 0) {
+        tap_report_comment(reporters, NULL,
+                           "failed to write journal file %s: %s(%d)",
+                           tap->journal_path, strerror(journal_err),
+                           journal_err);
+    }
+    trace_err = tap_trace_dtor(trace);
+    if (trace_err != 0) {
+        tap_report_comment(reporters, NULL,
+                           "failed to write trace file %s: %s(%d)",
+                           tap->trace_path, strerror(trace_err), trace_err);
+    }
     if (err != 0) {
-        printf(TAP_BAILOUT " internal test runner error %s(%d): ",
-               strerror(err), err);
+        tap_report_bailout(reporters, "internal test runner error %s(%d)",
+                           strerror(err), err);
     }
+    tap_report_finish(reporters);
+    tap_out_stop_writer();
+    tap_reporters_dtor(reporters);
+    tap_baseline_dtor(baseline);
+    tap_jobserver_dtor(jobserver);
+    for (size_t idx = 0; repeats && idx < tap->n_tests; idx++) {
+        tap_repeat_dtor(&repeats[idx]);
+    }
+    free(repeats);
     return err;
 }
 
+int tap_get_stats(struct TAP *tap, struct tap_stats *stats) {
+    tap = get_handle(tap);
+    if (!tap) {
+        return EINVAL;
+    }
+    *stats = tap->stats;
+    return 0;
+}
+
 void tap_cleanup(struct TAP *tap) {
     bool passed_handle;
 
@@ -264,7 +1155,19 @@ void tap_cleanup(struct TAP *tap) {
 
     for (size_t i = 0; i < tap->n_tests; i++) {
         free(tap->tests[i].description);
+        free(tap->tests[i].tags);
     }
+    free(tap->junit_path);
+    free(tap->jsonl_path);
+    free(tap->spill_dir);
+    free(tap->status_path);
+    free(tap->trace_path);
+    free(tap->baseline_path);
+    free(tap->baseline_save_path);
+    free(tap->repeat_filter);
+    free(tap->journal_path);
+    free(tap->worker_address);
+    tap_resources_fini(&tap->resources);
     free(tap);
 
     if (!passed_handle) {
@@ -1,85 +1,565 @@
 #include <errno.h>
+#include <limits.h>
 #include <poll.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <tap.h>
 #include <tapio.h>
 #include <tapstruct.h>
 #include <taptest.h>
+#include <taputil.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "config.h"
 #include "internal.h"
 
-static int tap_process_testrun_output(struct test_run *testrun) {
+/* Bytes asked for per read() of a test's output */
+#define TAP_OUTPUT_READ_SIZE (64 * 1024)
+/* Reads from one running test per poll, so a chatty test can't starve the
+ * others */
+#define TAP_OUTPUT_MAX_READS 16
+
+static struct timespec tap_ns_to_timespec(unsigned long long ns) {
+    return (struct timespec){
+        .tv_sec = ns / 1000000000,
+        .tv_nsec = ns % 1000000000,
+    };
+}
+
+/* Record the "<start> <end> <cpu>" nanoseconds the child took around the
+ * test function, see tap_run_test_and_exit(). Only kept if it stays the last
+ * line of output */
+static int tap_process_testrun_timing(struct test_run *testrun,
+                                      const char *str) {
+    unsigned long long wall_t0, wall_t1, cpu;
+
+    if (sscanf(str, "%llu %llu %llu", &wall_t0, &wall_t1, &cpu) != 3) {
+        return tap_report_comment(testrun->reporters, &testrun->test,
+                                  "ignoring malformed timing '%s'", str);
+    }
+    testrun->test_wall = (struct tap_duration){
+        .t0 = tap_ns_to_timespec(wall_t0),
+        .t1 = tap_ns_to_timespec(wall_t1),
+    };
+    testrun->test_cpu = tap_duration_from_ns(cpu);
+    testrun->timed = true;
+    return 0;
+}
+
+/* Drop the timing of a child that claims to have taken longer than it ran for,
+ * once all of its output is in */
+static void tap_check_testrun_timing(struct test_run *testrun) {
+    uint64_t total_ns, test_ns;
+
+    if (!testrun->timed || testrun->inprocess) {
+        return;
+    }
+    total_ns =
+        tap_timespec_diff_ns(&testrun->duration.t0, &testrun->duration.t1);
+    test_ns =
+        tap_timespec_diff_ns(&testrun->test_wall.t0, &testrun->test_wall.t1);
+    if (test_ns > total_ns) {
+        testrun->timed = false;
+    }
+}
+
+static int tap_process_testrun_line(struct test_run *testrun, char *line) {
     struct test *test = &testrun->test;
-    tap_cmd_t *cmd = testrun->cmd;
-    size_t line_len = 0;
-    char *line = NULL;
-    ssize_t bytes;
-    FILE *test_fp;
-    int err = 0;
+    tap_cmd_t *line_cmd = NULL;
+    char *newline;
+    int err;
 
-    test_fp = fdopen(testrun->outfd, "r");
-    if (!test_fp) {
-        err = errno;
-        tap_print_internal_error(err, test, "failed open pipe as stream");
+    /* Lines are reported without their newline, drop it in place */
+    newline = strchr(line, '\n');
+    if (newline) {
+        *newline = '\0';
+    }
+    if (*line == '\0') {
+        return 0;
+    }
+    /* The child sends its timing last, once the test function returned, a
+     * timing line followed by more output was the test's own. In-process runs
+     * are timed by the engine */
+    if (!testrun->inprocess) {
+        testrun->timed = false;
+    }
+
+    if (!testrun->arena) {
+        err = tap_arena_ctor(&testrun->arena);
+        if (err != 0) {
+            tap_print_internal_error(err, test, "failed to allocate arena");
+            return err;
+        }
+    }
+    err = tap_parse_cmd(testrun->arena, line, &line_cmd);
+    if (err != 0) {
+        tap_print_internal_error(err, test,
+                                 "failed to parse tap cmd from line");
         return err;
     }
+    if (!line_cmd) {
+        /* Debug from the test, output as TAP comment */
+        return tap_report_comment_line(testrun->reporters, test, line);
+    }
+    if (line_cmd->type == tap_cmd_type_timing) {
+        return testrun->inprocess
+                   ? 0
+                   : tap_process_testrun_timing(testrun, line_cmd->str);
+    }
+    if (tap_cmd_is_assertion(line_cmd)) {
+        if (testrun->last_subtest) {
+            testrun->last_subtest->next = line_cmd;
+        } else {
+            testrun->subtests = line_cmd;
+        }
+        testrun->last_subtest = line_cmd;
+        return 0;
+    }
+    if (testrun->cmd) {
+        /* Only allow one directive command per test, warn the extra is
+         * ignored */
+        return tap_report_comment(
+            testrun->reporters, test,
+            "One directive command per test: ignoring '%s'", line_cmd->str);
+    }
+    testrun->cmd = line_cmd;
+    return 0;
+}
+
+static bool tap_output_is_limited(const struct tap_output_opts *opts) {
+    return opts &&
+           (opts->max_bytes || opts->max_lines || opts->collapse_repeats);
+}
 
-    for (; (bytes = getline(&line, &line_len, test_fp)) != -1;) {
-        tap_cmd_t *line_cmd = NULL;
+static int tap_output_flush_repeats(struct test_run *testrun) {
+    struct test_output *output = &testrun->output;
+    size_t n_repeats = output->n_repeats;
+
+    if (n_repeats == 0) {
+        return 0;
+    }
+    output->n_repeats = 0;
+    return tap_report_comment(testrun->reporters, &testrun->test,
+                              "previous line repeated %zu more time%s",
+                              n_repeats, n_repeats == 1 ? "" : "s");
+}
+
+int tap_output_spill_path(const struct tap_output_opts *opts, size_t id,
+                          char *path, size_t path_len) {
+    int n_written;
+
+    n_written = snprintf(path, path_len, "%s/test-%zu.log", opts->spill_dir,
+                         id);
+    if (n_written < 0 || (size_t)n_written >= path_len) {
+        return ENAMETOOLONG;
+    }
+    return 0;
+}
+
+/* Output past a limit is counted and spilled to a file, or dropped */
+static int tap_output_overflow(struct test_run *testrun, const char *line,
+                               size_t line_len) {
+    const struct tap_output_opts *opts = testrun->output_opts;
+    struct test_output *output = &testrun->output;
+    struct test *test = &testrun->test;
+    char path[PATH_MAX];
+    int err = 0;
 
-        if (bytes == 0 || *line == '\n') {
+    if (output->n_over_lines++ == 0) {
+        if (opts->spill_dir) {
+            err = tap_output_spill_path(opts, test->id, path, sizeof(path));
+            if (err == 0) {
+                /* Repetitions and re-leased runs of the test add to it */
+                output->spill = fopen(path, "a");
+                err = output->spill ? 0 : errno;
+            }
+            if (err != 0) {
+                tap_report_comment(testrun->reporters, test,
+                                   "failed to open spill file: %s(%d)",
+                                   strerror(err), err);
+            }
+        }
+        if (output->spill) {
+            err = tap_report_comment(testrun->reporters, test,
+                                     "output limit reached, the rest is in %s",
+                                     path);
+        } else {
+            err = tap_report_comment(testrun->reporters, test,
+                                     "output limit reached, dropping the rest");
+        }
+    }
+    output->n_over_bytes += line_len;
+
+    if (output->spill) {
+        fwrite(line, 1, line_len, output->spill);
+        fputc('\n', output->spill);
+    }
+    return err;
+}
+
+static bool tap_output_is_repeat(struct test_output *output, const char *prev,
+                                 size_t prev_len, const char *line,
+                                 size_t line_len) {
+    if (!prev) {
+        /* First line of a block, compare with the end of the last block */
+        prev = output->last_line;
+        prev_len = output->last_line_len;
+    }
+    return prev && prev_len == line_len && memcmp(prev, line, line_len) == 0;
+}
+
+static int tap_output_save_line(struct test_output *output, const char *line,
+                                size_t line_len) {
+    if (output->last_line_size < line_len + 1) {
+        char *last_line;
+
+        last_line = realloc(output->last_line, line_len + 1);
+        if (!last_line) {
+            return errno;
+        }
+        output->last_line = last_line;
+        output->last_line_size = line_len + 1;
+    }
+    memcpy(output->last_line, line, line_len);
+    output->last_line[line_len] = '\0';
+    output->last_line_len = line_len;
+    return 0;
+}
+
+/* Report a block of comment lines, applying the limits on output. Lines
+ * within the limits are still reported a block at a time */
+static int tap_output_comment_lines(struct test_run *testrun,
+                                    const char *lines, size_t len) {
+    const struct tap_output_opts *opts = testrun->output_opts;
+    struct test_output *output = &testrun->output;
+    const char *pending = NULL, *prev = NULL;
+    const char *pos = lines, *end = lines + len;
+    size_t prev_len = 0;
+    int err = 0;
+
+    if (!tap_output_is_limited(opts)) {
+        return tap_report_comment_lines(testrun->reporters, &testrun->test,
+                                        lines, len);
+    }
+
+    while (pos < end && err == 0) {
+        const char *line = pos, *newline;
+        bool repeat, over_limit;
+        size_t line_len;
+
+        newline = memchr(pos, '\n', end - pos);
+        line_len = newline ? (size_t)(newline - pos) : (size_t)(end - pos);
+        pos = newline ? newline + 1 : end;
+        if (line_len == 0) {
             continue;
         }
 
-        err = tap_parse_cmd(line, &line_cmd);
+        repeat = opts->collapse_repeats &&
+                 tap_output_is_repeat(output, prev, prev_len, line, line_len);
+        /* Once over, later lines that would fit are not reported either, the
+         * report has no holes */
+        over_limit =
+            output->n_over_lines > 0 ||
+            (opts->max_lines && output->n_lines >= opts->max_lines) ||
+            (opts->max_bytes && output->n_bytes + line_len > opts->max_bytes);
+        if (!repeat && !over_limit) {
+            if (output->n_repeats > 0) {
+                err = tap_output_flush_repeats(testrun);
+            }
+            output->n_lines++;
+            output->n_bytes += line_len;
+            pending = pending ? pending : line;
+            prev = line;
+            prev_len = line_len;
+            continue;
+        }
+
+        /* The line breaks the run of reportable lines */
+        if (pending) {
+            err = tap_report_comment_lines(testrun->reporters, &testrun->test,
+                                           pending, line - pending);
+            pending = NULL;
+        }
         if (err != 0) {
-            tap_print_internal_error(err, test,
-                                     "failed to parse tap cmd from line");
             break;
         }
-        if (!line_cmd) {
-            /* Debug from the test, output as TAP comment */
-            err = tap_printf_line("# test %zu: %s\n", test->id, line);
-            if (err != 0) {
+        if (!over_limit) {
+            output->n_repeats++;
+        } else if (output->n_repeats > 0) {
+            /* Repeats of the last reported line go before the limit */
+            err = tap_output_flush_repeats(testrun);
+        }
+        if (over_limit && err == 0) {
+            err = tap_output_overflow(testrun, line, line_len);
+        }
+    }
+
+    if (pending && err == 0) {
+        err = tap_report_comment_lines(testrun->reporters, &testrun->test,
+                                       pending, end - pending);
+    }
+    if (opts->collapse_repeats && prev && err == 0) {
+        err = tap_output_save_line(output, prev, prev_len);
+    }
+    return err;
+}
+
+/* Summarise anything held back once the test has no more output */
+static int tap_output_finish(struct test_run *testrun) {
+    struct test_output *output = &testrun->output;
+    const char *fate = "dropped";
+    int err;
+
+    err = tap_output_flush_repeats(testrun);
+    if (err != 0 || output->n_over_lines == 0) {
+        return err;
+    }
+    if (output->spill) {
+        fate = "spilled";
+        if (fflush(output->spill) != 0) {
+            fate = "partially spilled";
+        }
+    }
+    return tap_report_comment(
+        testrun->reporters, &testrun->test,
+        "%zu line%s (%zu bytes) over the output limit %s", output->n_over_lines,
+        output->n_over_lines == 1 ? "" : "s", output->n_over_bytes, fate);
+}
+
+static void tap_output_cleanup(struct test_output *output) {
+    if (output->spill) {
+        fclose(output->spill);
+    }
+    free(output->last_line);
+    *output = (struct test_output){0};
+}
+
+/* Process the complete lines of buf, buf[len] must be '\0'. Comment lines
+ * are reported a block at a time and only lines starting with ':' are parsed
+ * as commands. At EOF a final line without a newline is also complete */
+static int tap_process_testrun_lines(struct test_run *testrun, char *buf,
+                                     size_t len, bool at_eof,
+                                     size_t *d_consumed) {
+    char *pos = buf, *end = buf + len;
+    struct timespec t0, t1;
+    int err = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (pos < end && err == 0) {
+        char *block = pos;
+        char *newline;
+
+        /* Gather the run of comment lines up to the next command */
+        while (pos < end && *pos != ':') {
+            newline = memchr(pos, '\n', end - pos);
+            if (!newline && !at_eof) {
                 break;
             }
-            continue;
+            pos = newline ? newline + 1 : end;
         }
-        if (cmd) {
-            /* Only allow one directive command per test, warn the extra is
-             * ignored */
-            err = tap_printf_line(
-                "# test %zu: One directive command per test: ignoring '%s'",
-                test->id, line_cmd->str);
-            free(line_cmd);
+        if (pos > block) {
+            err = tap_output_comment_lines(testrun, block, pos - block);
             if (err != 0) {
                 break;
             }
+        }
+        if (pos == end || *pos != ':') {
+            /* Out of data, or an incomplete comment line */
+            break;
+        }
+
+        newline = memchr(pos, '\n', end - pos);
+        if (!newline && !at_eof) {
+            break;
+        }
+        if (newline) {
+            *newline = '\0';
+        }
+        err = tap_process_testrun_line(testrun, pos);
+        pos = newline ? newline + 1 : end;
+    }
+
+    *d_consumed = pos - buf;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    testrun->format_ns += tap_timespec_diff_ns(&t0, &t1);
+    return err;
+}
+
+/* Read whatever the test has written, without blocking. If drain is set the
+ * test has exited, anything left over is processed as the final line */
+static int tap_process_testrun_output(struct test_run *testrun, bool drain) {
+    struct test *test = &testrun->test;
+    unsigned int n_reads = 0;
+    bool at_eof = false;
+    size_t consumed;
+    int err = 0;
+
+    while (!at_eof && (drain || n_reads < TAP_OUTPUT_MAX_READS)) {
+        ssize_t n_read;
+
+        if (testrun->outbuf_size - testrun->outbuf_len <
+            TAP_OUTPUT_READ_SIZE + 1) {
+            size_t size;
+            char *outbuf;
+
+            size = testrun->outbuf_size * 2;
+            if (size < testrun->outbuf_len + TAP_OUTPUT_READ_SIZE + 1) {
+                size = testrun->outbuf_len + TAP_OUTPUT_READ_SIZE + 1;
+            }
+            outbuf = realloc(testrun->outbuf, size);
+            if (!outbuf) {
+                err = errno;
+                tap_print_internal_error(err, test,
+                                         "failed to grow output buffer");
+                return err;
+            }
+            testrun->outbuf = outbuf;
+            testrun->outbuf_size = size;
+        }
+
+        n_read = read(testrun->outfd, testrun->outbuf + testrun->outbuf_len,
+                      testrun->outbuf_size - testrun->outbuf_len - 1);
+        if (n_read == -1 && errno == EINTR) {
             continue;
+        } else if (n_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else if (n_read == -1) {
+            err = errno;
+            tap_print_internal_error(err, test, "failed to read test output");
+            return err;
         }
-        cmd = line_cmd;
+        n_reads++;
+        at_eof = n_read == 0;
+        testrun->n_bytes_read += n_read;
+        testrun->outbuf_len += n_read;
+        testrun->outbuf[testrun->outbuf_len] = '\0';
+
+        err = tap_process_testrun_lines(testrun, testrun->outbuf,
+                                        testrun->outbuf_len, at_eof, &consumed);
+        if (err != 0) {
+            return err;
+        }
+        /* Carry any incomplete line over to the next read */
+        testrun->outbuf_len -= consumed;
+        memmove(testrun->outbuf, testrun->outbuf + consumed,
+                testrun->outbuf_len);
     }
 
-    if (err != 0) {
-        free(cmd);
-    } else if (cmd) {
-        testrun->cmd = cmd;
+    if (drain && testrun->outbuf_len > 0) {
+        testrun->outbuf[testrun->outbuf_len] = '\0';
+        err = tap_process_testrun_lines(testrun, testrun->outbuf,
+                                        testrun->outbuf_len, true, &consumed);
+        testrun->outbuf_len = 0;
+    }
+    if (drain && err == 0) {
+        tap_check_testrun_timing(testrun);
+        err = tap_output_finish(testrun);
     }
-    free(line);
     return err;
 }
 
-static void tap_run_test_and_exit(struct test *test) {
+int tap_process_testrun_buffer(struct test_run *testrun, char *buf,
+                               size_t len) {
+    size_t consumed;
+    int err;
+
+    err = tap_process_testrun_lines(testrun, buf, len, true, &consumed);
+    if (err != 0) {
+        return err;
+    }
+    return tap_output_finish(testrun);
+}
+
+int tap_process_testrun_data(struct test_run *testrun, const char *data,
+                             size_t len, bool at_eof) {
+    size_t consumed;
+    int err;
+
+    if (testrun->outbuf_size - testrun->outbuf_len < len + 1) {
+        size_t size = testrun->outbuf_len + len + 1;
+        char *outbuf;
+
+        outbuf = realloc(testrun->outbuf, size);
+        if (!outbuf) {
+            return errno;
+        }
+        testrun->outbuf = outbuf;
+        testrun->outbuf_size = size;
+    }
+    if (len > 0) {
+        memcpy(testrun->outbuf + testrun->outbuf_len, data, len);
+    }
+    testrun->n_bytes_read += len;
+    testrun->outbuf_len += len;
+    testrun->outbuf[testrun->outbuf_len] = '\0';
+
+    err = tap_process_testrun_lines(testrun, testrun->outbuf,
+                                    testrun->outbuf_len, at_eof, &consumed);
+    if (err != 0) {
+        return err;
+    }
+    testrun->outbuf_len -= consumed;
+    memmove(testrun->outbuf, testrun->outbuf + consumed, testrun->outbuf_len);
+    if (!at_eof) {
+        return 0;
+    }
+    tap_check_testrun_timing(testrun);
+    return tap_output_finish(testrun);
+}
+
+static unsigned long long tap_timespec_to_ns(struct timespec *ts) {
+    return ts->tv_sec * 1000000000ull + ts->tv_nsec;
+}
+
+void tap_send_timing(struct timespec *wall_t0, struct timespec *wall_t1,
+                     uint64_t cpu_ns) {
+    /* Send the test's own timing, free of the fork and of how long the runner
+     * takes to notice the exit. The leading newline ends any partial line */
+    printf("\n:" TAP_CMD_TIMING " %llu %llu %llu\n",
+           tap_timespec_to_ns(wall_t0), tap_timespec_to_ns(wall_t1),
+           (unsigned long long)cpu_ns);
+}
+
+void tap_arm_timeout(struct test *test) {
+    struct itimerval timer = {0};
+
+    if (test->timeout <= 0) {
+        return;
+    }
+    timer.it_value.tv_sec = test->timeout;
+    timer.it_value.tv_usec = (test->timeout - timer.it_value.tv_sec) * 1e6;
+    if (timer.it_value.tv_sec == 0 && timer.it_value.tv_usec == 0) {
+        /* A zero timer is a disarmed one */
+        timer.it_value.tv_usec = 1;
+    }
+    setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+void tap_run_test_and_exit(struct test *test) {
+    struct timespec wall_t0, wall_t1, cpu_t0, cpu_t1;
     int res;
 
+    /* Before any instances are forked, so they inherit them */
+    tap_limits_apply(&test->limits);
+    if (test->n_instances > 1) {
+        tap_run_instances_and_exit(test);
+    }
+
+    tap_arm_timeout(test);
+    clock_gettime(CLOCK_MONOTONIC, &wall_t0);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_t0);
     res = test->funct();
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_t1);
+    clock_gettime(CLOCK_MONOTONIC, &wall_t1);
+
+    tap_send_timing(&wall_t0, &wall_t1, tap_timespec_diff_ns(&cpu_t0, &cpu_t1));
     fflush(NULL);
     _exit(res);
 }
@@ -89,16 +569,28 @@ static void tap_exit_testrun(struct test_run *run) {
         close(run->outfd);
         run->outfd = -1;
     }
+    tap_output_cleanup(&run->output);
+    free(run->outbuf);
+    run->outbuf = NULL;
+    run->outbuf_len = 0;
+    run->outbuf_size = 0;
     run->pid = -1;
     run->exited = true;
 }
 
-int tap_start_testrun(struct test *test, struct test_run *run) {
-    struct timespec start;
+int tap_start_testrun(struct test *to_start, const struct tap_limits *limits,
+                      struct tap_reporter *reporters,
+                      const struct tap_output_opts *output_opts,
+                      struct test_run *run) {
+    struct timespec start, forked;
+    struct test limited = *to_start, *test = &limited;
     int pipefd[2] = {-1, -1};
     pid_t cpid;
     int err;
 
+    /* Kept in the run, to report what limit a terminated test ran into */
+    tap_limits_merge(&test->limits, limits);
+
     /* Communicate fail condition on pipe */
     err = tap_pipe_setup(pipefd);
     if (err != 0) {
@@ -106,6 +598,15 @@ int tap_start_testrun(struct test *test, struct test_run *run) {
         return err;
     }
 
+    /* Output is read as it arrives, never waiting on a still running test */
+    err = tap_pipe_nonblock(pipefd[TAP_PIPE_RX]);
+    if (err != 0) {
+        close(pipefd[TAP_PIPE_RX]);
+        close(pipefd[TAP_PIPE_TX]);
+        tap_print_internal_error(err, test, "failed to make pipe non-blocking");
+        return err;
+    }
+
     err = clock_gettime(CLOCK_MONOTONIC, &start);
     if (err != 0) {
         tap_print_internal_error(err, test, "failed to get monotonic time");
@@ -133,9 +634,12 @@ int tap_start_testrun(struct test *test, struct test_run *run) {
         return err;
     }
     close(pipefd[TAP_PIPE_TX]);
+    clock_gettime(CLOCK_MONOTONIC, &forked);
 
     *run = (struct test_run){
         .test = *test,
+        .reporters = reporters,
+        .output_opts = output_opts,
         .outfd = pipefd[TAP_PIPE_RX],
         .pid = cpid,
         .exitstatus = -1,
@@ -144,27 +648,60 @@ int tap_start_testrun(struct test *test, struct test_run *run) {
             (struct tap_duration){
                 .t0 = start,
             },
+        .forked = forked,
     };
     return 0;
 }
 
+/* Milliseconds to poll for, at most max_ms, rounded up to not wake early */
+static int tap_poll_timeout(const struct timespec *deadline, int max_ms) {
+    struct timespec now;
+    uint64_t left_ns;
+
+    if (!deadline) {
+        return max_ms;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    left_ns = tap_timespec_diff_ns(&now, deadline);
+    if (left_ns >= (uint64_t)max_ms * 1000000) {
+        return max_ms;
+    }
+    return (left_ns + 999999) / 1000000;
+}
+
 int tap_wait_for_testrun(struct test_run *runs, size_t n_runs,
-                         struct pollfd *fds) {
+                         struct pollfd *fds, int wake_fd,
+                         const struct timespec *deadline,
+                         struct tap_trace *trace, struct tap_stats *stats) {
     for (size_t idx = 0; idx < n_runs; idx++) {
         fds[idx] = (struct pollfd){
             .fd = runs[idx].outfd,
             .events = POLLIN,
         };
     }
+    fds[n_runs] = (struct pollfd){.fd = wake_fd, .events = POLLIN};
 
     while (true) {
         unsigned int n_exited = 0;
-        int nfds_ready;
+        size_t n_read = 0;
+        int nfds_ready, timeout_ms;
 
-        nfds_ready = poll(fds, n_runs, 1000);
+        timeout_ms = tap_poll_timeout(deadline, 1000);
+        if (timeout_ms == 0) {
+            /* Time is up, whatever is still being read */
+            return 0;
+        }
+        nfds_ready = poll(fds, n_runs + 1, timeout_ms);
+        tap_trace_wakeup(trace, nfds_ready);
+        stats->n_wakeups++;
         if (nfds_ready == -1 && errno != EINTR) {
             return errno;
+        } else if (nfds_ready == 0) {
+            /* Let the scheduler look over the running tests now and then */
+            stats->n_wasted_wakeups++;
+            return 0;
         } else if (nfds_ready < 1) {
+            stats->n_wasted_wakeups++;
             continue;
         }
 
@@ -172,6 +709,7 @@ int tap_wait_for_testrun(struct test_run *runs, size_t n_runs,
         for (size_t idx = 0; idx < n_runs; idx++) {
             struct test_run *run;
             struct pollfd *pfd;
+            struct rusage usage;
             int err;
             int res;
 
@@ -183,13 +721,18 @@ int tap_wait_for_testrun(struct test_run *runs, size_t n_runs,
 
             /* Attempt to reap the child that closed its stdout/stderr */
             run = &runs[idx];
-            res = waitpid(run->pid, &run->exitstatus, WNOHANG);
+            if (run->hup.tv_sec == 0 && run->hup.tv_nsec == 0) {
+                clock_gettime(CLOCK_MONOTONIC, &run->hup);
+            }
+            res = wait4(run->pid, &run->exitstatus, WNOHANG, &usage);
             if (res < 0) {
                 return errno;
             }
             if (res == 0) {
                 continue;
             }
+            /* In kilobytes on Linux */
+            run->max_rss = (size_t)usage.ru_maxrss * 1024;
             err = clock_gettime(CLOCK_MONOTONIC, &run->duration.t1);
             if (err != 0) {
                 tap_print_internal_error(err, &run->test,
@@ -197,12 +740,11 @@ int tap_wait_for_testrun(struct test_run *runs, size_t n_runs,
                 return err;
             }
 
-            if ((pfd->revents & POLLIN) != 0) {
-                err = tap_process_testrun_output(run);
-                if (err != 0) {
-                    tap_exit_testrun(run);
-                    return err;
-                }
+            /* Also flushes out a final line missing its newline */
+            err = tap_process_testrun_output(run, true);
+            if (err != 0) {
+                tap_exit_testrun(run);
+                return err;
             }
 
             tap_exit_testrun(run);
@@ -216,16 +758,27 @@ int tap_wait_for_testrun(struct test_run *runs, size_t n_runs,
         /* Second pass to read any data from still running processes */
         for (size_t idx = 0; idx < n_runs; idx++) {
             struct pollfd *pfd;
+            size_t n_bytes_read;
             int err;
 
             pfd = &fds[idx];
             if ((pfd->revents & POLLIN) == 0) {
                 continue;
             }
-            err = tap_process_testrun_output(&runs[idx]);
+            n_bytes_read = runs[idx].n_bytes_read;
+            err = tap_process_testrun_output(&runs[idx], false);
             if (err != 0) {
                 return err;
             }
+            n_read += runs[idx].n_bytes_read - n_bytes_read;
+        }
+        if (fds[n_runs].revents != 0) {
+            /* The scheduler may now start another test */
+            break;
+        }
+        if (n_read == 0) {
+            /* Only hung up children not yet ready to be reaped */
+            stats->n_wasted_wakeups++;
         }
     }
 
@@ -234,7 +787,10 @@ int tap_wait_for_testrun(struct test_run *runs, size_t n_runs,
 
 void tap_cleanup_testrun(struct test_run *run) {
     tap_exit_testrun(run);
-    free(run->cmd);
+    tap_arena_dtor(run->arena);
+    run->arena = NULL;
     run->cmd = NULL;
+    run->subtests = NULL;
+    run->last_subtest = NULL;
     run->test = (struct test){0};
 }
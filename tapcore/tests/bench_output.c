@@ -0,0 +1,82 @@
+/**
+ * @file bench_output.c
+ *
+ * Measures how fast the runner gets through a test's output. A single test
+ * writes a large amount of debug output with the odd assertion mixed in, the
+ * runner's own TAP output is sent to /dev/null.
+ *
+ * Usage: bench_output [MiB of output, default 256]
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tap.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_BLOCK_SIZE (64 * 1024)
+
+static size_t bench_bytes;
+static char bench_block[BENCH_BLOCK_SIZE];
+static size_t bench_block_len;
+
+static void bench_fill_block(void) {
+    const char *line = "debug output from the test under benchmark 0123456789\n";
+    const char *cmd = ":ok block written\n";
+    size_t line_len = strlen(line);
+
+    /* One assertion per block, the rest comments */
+    memcpy(bench_block, cmd, strlen(cmd));
+    bench_block_len = strlen(cmd);
+    for (; bench_block_len + line_len <= sizeof(bench_block);
+         bench_block_len += line_len) {
+        memcpy(bench_block + bench_block_len, line, line_len);
+    }
+}
+
+static int bench_chatty_test(void) {
+    for (size_t written = 0; written < bench_bytes;
+         written += bench_block_len) {
+        fwrite(bench_block, 1, bench_block_len, stdout);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    struct timespec t0, t1;
+    size_t n_written = 0;
+    double elapsed;
+    int stdout_fd;
+    int null_fd;
+
+    bench_bytes = (argc > 1 ? strtoull(argv[1], NULL, 0) : 256) << 20;
+    bench_fill_block();
+    for (; n_written < bench_bytes; n_written += bench_block_len)
+        ;
+
+    stdout_fd = dup(STDOUT_FILENO);
+    null_fd = open("/dev/null", O_WRONLY);
+    if (stdout_fd == -1 || null_fd == -1) {
+        perror("bench_output");
+        return 1;
+    }
+
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_register(NULL, bench_chatty_test, "chatty test");
+
+    fflush(stdout);
+    dup2(null_fd, STDOUT_FILENO);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    tap_runall(NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    fflush(stdout);
+    dup2(stdout_fd, STDOUT_FILENO);
+    tap_cleanup(NULL);
+
+    elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%zu bytes of test output in %.3fs: %.0f bytes/s (%.1f MiB/s)\n",
+           n_written, elapsed, n_written / elapsed,
+           n_written / elapsed / (1 << 20));
+    return 0;
+}
@@ -1,8 +1,71 @@
 #ifndef __CORE_TESTS_INTERNAL__
 #define __CORE_TESTS_INTERNAL__
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-static int pass(void) { return 0; }
+static inline int pass(void) { return 0; }
 
-static int fail(void) { return -1; }
+static inline int fail(void) { return -1; }
+
+/* Print line with every duration and percentage replaced by "***" */
+static inline void print_masked_line(const char *line) {
+    const char *pos = line;
+
+    while (*pos) {
+        size_t n_digits = strspn(pos, "0123456789.");
+        const char *unit = pos + n_digits;
+
+        if (n_digits > 0 && (pos == line || !isalnum(pos[-1]))) {
+            if (isalpha(*unit) && unit[1] == 's') {
+                unit++;
+            }
+            if (*unit == 's' || *unit == '%') {
+                fputs("***", stdout);
+                pos = unit + 1;
+                continue;
+            }
+        }
+        putchar(*pos++);
+    }
+}
+
+/* Send stdout to path until print_masked_capture(), returns the saved stdout
+ * or -1 on failure */
+static inline int capture_stdout(const char *path) {
+    int stdout_fd;
+
+    fflush(stdout);
+    stdout_fd = dup(STDOUT_FILENO);
+    if (stdout_fd == -1 || !freopen(path, "w", stdout)) {
+        return -1;
+    }
+    return stdout_fd;
+}
+
+/* Restore stdout and print what was captured, with timings masked */
+static inline void print_masked_capture(const char *path, int stdout_fd) {
+    size_t line_len = 0;
+    char *line = NULL;
+    FILE *fp;
+
+    fflush(stdout);
+    dup2(stdout_fd, STDOUT_FILENO);
+    close(stdout_fd);
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        printf("failed to open %s\n", path);
+        return;
+    }
+    for (; getline(&line, &line_len, fp) != -1;) {
+        print_masked_line(line);
+    }
+    free(line);
+    fclose(fp);
+    unlink(path);
+}
 
 #endif /* __CORE_TESTS_INTERNAL__ */
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tap.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+#define BASELINE_PATH "test_baseline.baseline.tmp"
+#define OUTPUT_PATH "test_baseline.output.tmp"
+
+static int sleeps(void) {
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = 20 * 1000 * 1000};
+
+    nanosleep(&ts, NULL);
+    return 0;
+}
+
+static int sleeps_and_fails(void) {
+    sleeps();
+    return -1;
+}
+
+static void register_tests(void) {
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_register(NULL, sleeps, "sleeps");
+    tap_register(NULL, sleeps_and_fails, "sleeps and fails");
+    tap_register(NULL, pass, "was slow");
+    tap_register(NULL, pass, NULL);
+}
+
+static void write_baseline(void) {
+    FILE *fp;
+
+    fp = fopen(BASELINE_PATH, "w");
+    if (!fp) {
+        return;
+    }
+    /* Within the noise floor of test 4, and far slower than "was slow" */
+    fputs("1 sleeps\n", fp);
+    fputs("1 sleeps and fails\n", fp);
+    fputs("1000000000 was slow\n", fp);
+    fputs("1 test 4\n", fp);
+    fclose(fp);
+}
+
+/* Tests sharing a description are told apart by their id, so only the first
+ * is slower than its own baseline */
+static void write_shared_baseline(void) {
+    FILE *fp;
+
+    fp = fopen(BASELINE_PATH, "w");
+    if (!fp) {
+        return;
+    }
+    fputs("1 same description (test 1)\n", fp);
+    fputs("1000000000 same description (test 2)\n", fp);
+    fclose(fp);
+}
+
+static void register_shared_tests(void) {
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_register(NULL, sleeps, "same description");
+    tap_register(NULL, sleeps, "same description");
+    tap_register(NULL, pass, "description with a\nnewline");
+}
+
+/* Print the keys of a saved baseline, the durations and memory vary between
+ * runs */
+static void print_baseline_keys(void) {
+    size_t line_len = 0;
+    char *line = NULL;
+    FILE *fp;
+
+    fp = fopen(BASELINE_PATH, "r");
+    if (!fp) {
+        printf("failed to open %s\n", BASELINE_PATH);
+        return;
+    }
+    for (; getline(&line, &line_len, fp) != -1;) {
+        printf("saved:%s", line + strspn(line, "0123456789/"));
+    }
+    free(line);
+    fclose(fp);
+}
+
+int main(void) {
+    int stdout_fd;
+
+    stdout_fd = capture_stdout(OUTPUT_PATH);
+    if (stdout_fd == -1) {
+        return 1;
+    }
+
+    /* Slower tests are commented on */
+    write_baseline();
+    register_tests();
+    tap_set_option(NULL, TAP_OPTION_BASELINE_FILE, BASELINE_PATH);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    printf("\n");
+
+    /* Or fail as TODO, unless they failed anyway */
+    register_tests();
+    tap_set_option(NULL, TAP_OPTION_BASELINE_FILE, BASELINE_PATH);
+    tap_set_option(NULL, TAP_OPTION_BASELINE_TODO, 1);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    printf("\n");
+
+    /* A generous threshold lets them through */
+    register_tests();
+    tap_set_option(NULL, TAP_OPTION_BASELINE_FILE, BASELINE_PATH);
+    tap_set_option(NULL, TAP_OPTION_BASELINE_THRESHOLD, 1e9);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    printf("\n");
+
+    /* A missing baseline is only a comment, and can be saved to */
+    unlink(BASELINE_PATH);
+    register_tests();
+    tap_set_option(NULL, TAP_OPTION_BASELINE_FILE, BASELINE_PATH);
+    tap_set_option(NULL, TAP_OPTION_BASELINE_SAVE_FILE, BASELINE_PATH);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    print_masked_capture(OUTPUT_PATH, stdout_fd);
+    print_baseline_keys();
+
+    /* Shared descriptions are qualified, newlines do not break the line
+     * format */
+    stdout_fd = capture_stdout(OUTPUT_PATH);
+    if (stdout_fd == -1) {
+        return 1;
+    }
+    printf("\n");
+    write_shared_baseline();
+    register_shared_tests();
+    tap_set_option(NULL, TAP_OPTION_BASELINE_FILE, BASELINE_PATH);
+    tap_set_option(NULL, TAP_OPTION_BASELINE_SAVE_FILE, BASELINE_PATH);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    print_masked_capture(OUTPUT_PATH, stdout_fd);
+    print_baseline_keys();
+    unlink(BASELINE_PATH);
+}
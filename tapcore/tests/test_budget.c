@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tap.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+#define BASELINE_PATH "test_budget.baseline.tmp"
+
+static int hangs(void) {
+    sleep(10);
+    return 0;
+}
+
+static void register_cost(test_t funct, const char *description, double cost,
+                          int priority) {
+    tap_register_ex(NULL, funct,
+                    &(struct tap_test_attrs){.description = description,
+                                             .cost = cost,
+                                             .priority = priority});
+}
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+    double t0;
+    FILE *fp;
+
+    /* Two slots of one second fit the cheapest two seconds of tests, the
+     * straggler is cancelled once the second is up */
+    fp = fopen(BASELINE_PATH, "w");
+    if (!fp) {
+        return 1;
+    }
+    fputs("5000000000 slow in the baseline\n", fp);
+    fclose(fp);
+
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 2);
+    tap_set_option(NULL, TAP_OPTION_TIME_BUDGET, 1.0);
+    tap_set_option(NULL, TAP_OPTION_BASELINE_FILE, BASELINE_PATH);
+    register_cost(pass, "large", 1.0, 0);
+    register_cost(pass, "too long", 5.0, 0);
+    register_cost(pass, "medium", 0.5, 0);
+    register_cost(pass, "another large", 1.0, 0);
+    register_cost(hangs, "mispredicted", 0.1, 0);
+    register_cost(pass, "quick", 0.1, 0);
+    tap_register(NULL, pass, "slow in the baseline");
+    tap_register(NULL, pass, "unknown");
+    t0 = now();
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+    unlink(BASELINE_PATH);
+    printf("finished within the budget: %s\n",
+           now() - t0 < 1.5 ? "yes" : "no");
+
+    printf("\n");
+
+    /* Under TAP_SCHED_PRIORITY the most priority fits */
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_set_option(NULL, TAP_OPTION_TIME_BUDGET, 0.5);
+    tap_set_option(NULL, TAP_OPTION_SCHEDULER, TAP_SCHED_PRIORITY);
+    register_cost(pass, "low", 0.2, 1);
+    register_cost(pass, "high", 0.4, 10);
+    register_cost(pass, "low again", 0.2, 1);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    printf("\n");
+
+    /* Otherwise the most tests do */
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_set_option(NULL, TAP_OPTION_TIME_BUDGET, 0.5);
+    register_cost(pass, "low", 0.2, 1);
+    register_cost(pass, "high", 0.4, 10);
+    register_cost(pass, "low again", 0.2, 1);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+    return 0;
+}
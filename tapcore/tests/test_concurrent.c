@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <tap.h>
+
+#include "internal.h"
+
+#define N_INSTANCES 4
+
+static int instance_in_range(void) {
+    tap_ok(tap_instance() < N_INSTANCES, "instance in range");
+    return 0;
+}
+
+static int one_instance_fails(void) { return tap_instance() == 2 ? 1 : 0; }
+
+static int plain_instance(void) {
+    tap_is(tap_instance(), 0, "plain tests are instance 0");
+    return 0;
+}
+
+int main(void) {
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 2);
+    tap_register_concurrent(NULL, instance_in_range, N_INSTANCES,
+                            "instances in range");
+    tap_register_concurrent(NULL, one_instance_fails, N_INSTANCES, NULL);
+    tap_register(NULL, plain_instance, NULL);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    printf("\n");
+
+    /* The threaded engine leaves concurrent tests to be forked */
+    tap_set_option(NULL, TAP_OPTION_THREADED, 1);
+    tap_register(NULL, pass, "threaded");
+    tap_register_concurrent(NULL, pass, N_INSTANCES, "forked");
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+}
@@ -0,0 +1,17 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+
+/* Runs other test programs of this directory through the driver */
+int main(void) {
+    int status;
+
+    fflush(stdout);
+    status = system("../unitestap-driver -j 2 ./test_testplan_pass_fail"
+                    " ./test_early_exit ./test_missing");
+    if (!WIFEXITED(status)) {
+        return 1;
+    }
+    printf("driver exited with %d\n", WEXITSTATUS(status));
+    return 0;
+}
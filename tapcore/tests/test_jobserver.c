@@ -0,0 +1,125 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <tap.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+#define N_TESTS 6
+
+static char dir[] = "/tmp/test_jobserver.XXXXXX";
+
+/* Count the tests running at once via a marker file each */
+static int count_running(void) {
+    struct dirent *entry;
+    char path[64];
+    int n_running = 0;
+    DIR *dirp;
+
+    snprintf(path, sizeof(path), "%s/test-%d", dir, getpid());
+    close(creat(path, 0644));
+    usleep(20 * 1000);
+
+    dirp = opendir(dir);
+    while (dirp && (entry = readdir(dirp))) {
+        n_running += strncmp(entry->d_name, "test-", 5) == 0;
+    }
+    closedir(dirp);
+    unlink(path);
+
+    tap_ok(n_running <= 2, "at most two tests at once");
+    return 0;
+}
+
+static void run_tests(void) {
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 4);
+    for (size_t idx = 0; idx < N_TESTS; idx++) {
+        tap_register(NULL, count_running, NULL);
+    }
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+}
+
+static int pass_slowly(void) {
+    usleep(20 * 1000);
+    return 0;
+}
+
+static void print_tokens_returned(int rfd) {
+    char tokens[8];
+    ssize_t n_read;
+
+    n_read = read(rfd, tokens, sizeof(tokens));
+    printf("tokens returned: %zd\n", n_read);
+}
+
+int main(void) {
+    char fifo[64], log[64], makeflags[128];
+    int pipefd[2], rfd, wfd;
+    struct stat st;
+
+    if (!mkdtemp(dir)) {
+        return 1;
+    }
+
+    /* As make -j2 would, the implicit token and one in the jobserver */
+
+    /* The fifo form of make 4.4 onwards */
+    snprintf(fifo, sizeof(fifo), "%s/jobserver", dir);
+    mkfifo(fifo, 0600);
+    rfd = open(fifo, O_RDWR | O_NONBLOCK);
+    write(rfd, "+", 1);
+    snprintf(makeflags, sizeof(makeflags), "-j2 --jobserver-auth=fifo:%s",
+             fifo);
+    setenv("MAKEFLAGS", makeflags, 1);
+    run_tests();
+    print_tokens_returned(rfd);
+    close(rfd);
+    unlink(fifo);
+
+    printf("\n");
+
+    /* The pipe form of older makes */
+    if (pipe(pipefd) != 0) {
+        return 1;
+    }
+    fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+    write(pipefd[1], "+", 1);
+    snprintf(makeflags, sizeof(makeflags), "-j2 --jobserver-auth=%d,%d",
+             pipefd[0], pipefd[1]);
+    setenv("MAKEFLAGS", makeflags, 1);
+    run_tests();
+    print_tokens_returned(pipefd[0]);
+    close(pipefd[0]);
+    close(pipefd[1]);
+
+    printf("\n");
+
+    /* Make closes the fds for recipes it doesn't know run make, but leaves the
+     * option in MAKEFLAGS. The fds may since have been reused for files */
+    snprintf(log, sizeof(log), "%s/recipe.log", dir);
+    wfd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    write(wfd, "recipe output\n", 14);
+    rfd = open(log, O_RDONLY);
+    snprintf(makeflags, sizeof(makeflags), "-j2 --jobserver-auth=%d,%d", rfd,
+             wfd);
+    setenv("MAKEFLAGS", makeflags, 1);
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 2);
+    tap_register(NULL, pass_slowly, "runs without the jobserver");
+    tap_register(NULL, pass_slowly, "runs alongside without a token");
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+    close(rfd);
+    close(wfd);
+    stat(log, &st);
+    printf("recipe log left as it was: %s\n", st.st_size == 14 ? "yes" : "no");
+    unlink(log);
+
+    unsetenv("MAKEFLAGS");
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <tap.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+#define JOURNAL_PATH "test_journal.journal.tmp"
+#define RUNS_PATH "test_journal.runs.tmp"
+#define CRASH_PATH "test_journal.crash.tmp"
+
+/* Note which tests were run, rather than replayed */
+static void ran(const char *name) {
+    FILE *fp = fopen(RUNS_PATH, "a");
+
+    if (fp) {
+        fprintf(fp, "%s ", name);
+        fclose(fp);
+    }
+}
+
+static int first(void) {
+    ran("first");
+    return 0;
+}
+
+static int failing(void) {
+    ran("failing");
+    return -1;
+}
+
+static int with_subtests(void) {
+    ran("with_subtests");
+    tap_ok(1, "one");
+    tap_ok(1, "two");
+    return 0;
+}
+
+/* Takes the runner down with it, the first time round */
+static int crashing(void) {
+    ran("crashing");
+    if (unlink(CRASH_PATH) == 0) {
+        kill(getppid(), SIGKILL);
+    }
+    return 0;
+}
+
+static int last(void) {
+    ran("last");
+    return 0;
+}
+
+static void print_runs(void) {
+    char buf[256] = "";
+    FILE *fp = fopen(RUNS_PATH, "r");
+
+    if (fp) {
+        if (!fgets(buf, sizeof(buf), fp)) {
+            buf[0] = '\0';
+        }
+        fclose(fp);
+    }
+    unlink(RUNS_PATH);
+    printf("ran: %s\n", buf);
+}
+
+static void runall(int resume) {
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_set_option(NULL, TAP_OPTION_JOURNAL_FILE, JOURNAL_PATH);
+    tap_set_option(NULL, TAP_OPTION_RESUME, resume);
+    tap_register(NULL, first, "first");
+    tap_register(NULL, failing, "failing");
+    tap_register(NULL, with_subtests, "with subtests");
+    tap_register(NULL, crashing, "crashing");
+    tap_register(NULL, last, "last");
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+    fflush(stdout);
+    print_runs();
+}
+
+/* Rewrite the journal, with the n_drop last bytes of it dropped and its
+ * first line replaced by header unless NULL */
+static void edit_journal(size_t n_drop, const char *header) {
+    char buf[4096];
+    size_t len, skip = 0;
+    FILE *fp;
+
+    fp = fopen(JOURNAL_PATH, "r");
+    if (!fp) {
+        return;
+    }
+    len = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+    len = len > n_drop ? len - n_drop : 0;
+    if (header) {
+        skip = strcspn(buf, "\n");
+    }
+    fp = fopen(JOURNAL_PATH, "w");
+    if (!fp) {
+        return;
+    }
+    if (header) {
+        fputs(header, fp);
+    }
+    fwrite(buf + skip, 1, len - skip, fp);
+    fclose(fp);
+}
+
+int main(void) {
+    pid_t pid;
+    int wstatus, fd;
+
+    unlink(JOURNAL_PATH);
+    unlink(RUNS_PATH);
+
+    /* The runner is killed by its fourth test, three are journaled by then */
+    fd = open(CRASH_PATH, O_WRONLY | O_CREAT, 0644);
+    close(fd);
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0) {
+        if (!freopen("/dev/null", "w", stdout)) {
+            _exit(1);
+        }
+        runall(0);
+        _exit(0);
+    }
+    waitpid(pid, &wstatus, 0);
+    printf("runner killed: %s\n",
+           WIFSIGNALED(wstatus) && WTERMSIG(wstatus) == SIGKILL ? "yes"
+                                                                 : "no");
+    print_runs();
+
+    printf("\n");
+
+    /* Resuming runs only the tests the journal has no result of */
+    runall(1);
+
+    printf("\n");
+
+    /* Nothing is left to run */
+    runall(1);
+
+    printf("\n");
+
+    /* A block torn by a crash while writing it is run again, and journaled
+     * in place of the torn one for the next resume */
+    edit_journal(2, NULL);
+    runall(1);
+
+    printf("\n");
+
+    runall(1);
+
+    printf("\n");
+
+    /* As is everything in the journal of another build */
+    edit_journal(0, "unitestap-journal 1 0:0:0:0.000000000 5");
+    runall(1);
+
+    printf("\n");
+
+    /* Without resuming the journal starts over */
+    runall(0);
+    unlink(JOURNAL_PATH);
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <tap.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+#define MB ((size_t)1 << 20)
+
+static char path[] = "/tmp/test_limits.XXXXXX";
+
+static int spins(void) {
+    for (volatile unsigned long n = 0;; n++)
+        ;
+    return 0;
+}
+
+static int writes(void) {
+    static char buf[8192];
+    int fd;
+
+    fd = open(path, O_WRONLY | O_TRUNC);
+    if (fd == -1) {
+        return 1;
+    }
+    /* A write up to the limit only comes up short, the next one is fatal */
+    for (size_t off = 0; off < sizeof(buf);) {
+        ssize_t n_written = write(fd, buf + off, sizeof(buf) - off);
+
+        if (n_written <= 0) {
+            break;
+        }
+        off += n_written;
+    }
+    close(fd);
+    return 0;
+}
+
+static int allocates(void) {
+    void *ptr = malloc(256 * MB);
+
+    tap_ok(ptr == NULL, "allocation past the limit fails");
+    free(ptr);
+    return 0;
+}
+
+static int core_off(void) {
+    struct rlimit rlim;
+
+    getrlimit(RLIMIT_CORE, &rlim);
+    tap_is(rlim.rlim_cur, 0, "no core dumps");
+    return 0;
+}
+
+static int core_on(void) {
+    struct rlimit rlim;
+
+    getrlimit(RLIMIT_CORE, &rlim);
+    tap_ok(rlim.rlim_cur == rlim.rlim_max, "core dumps up to the hard limit");
+    return 0;
+}
+
+int main(void) {
+    int fd;
+
+    fd = mkstemp(path);
+    if (fd == -1) {
+        return 1;
+    }
+    close(fd);
+
+    /* Each test's own limits */
+    tap_register_ex(NULL, spins,
+                    &(struct tap_test_attrs){.description = "spins",
+                                             .limits = {.cpu = 1}});
+    tap_register_ex(NULL, writes,
+                    &(struct tap_test_attrs){
+                        .description = "writes",
+                        .limits = {.file_size = 4096}});
+    tap_register_ex(NULL, allocates,
+                    &(struct tap_test_attrs){
+                        .description = "allocates",
+                        .limits = {.address_space = 128 * MB}});
+    tap_register(NULL, core_off, "core dumps by default");
+    tap_register_ex(NULL, core_on,
+                    &(struct tap_test_attrs){
+                        .description = "core dumps asked for",
+                        .limits = {.core = TAP_NO_LIMIT}});
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    printf("\n");
+
+    /* The runner's limits, which a test can lift */
+    tap_set_option(NULL, TAP_OPTION_LIMITS,
+                   &(struct tap_limits){.file_size = 4096});
+    tap_register(NULL, writes, "writes");
+    tap_register_ex(NULL, writes,
+                    &(struct tap_test_attrs){
+                        .description = "writes without a limit",
+                        .limits = {.file_size = TAP_NO_LIMIT}});
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tap.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+#define MB ((size_t)1 << 20)
+#define BASELINE_PATH "test_memory.baseline.tmp"
+
+static char dir[] = "/tmp/test_memory.XXXXXX";
+
+/* Count the big tests running alongside via marker files, like a host
+ * counting the memory in use */
+static int big_test(void) {
+    struct dirent *entry;
+    char path[64];
+    size_t n_big = 0;
+    DIR *dirp;
+
+    snprintf(path, sizeof(path), "%s/%d", dir, getpid());
+    fclose(fopen(path, "w"));
+    usleep(20 * 1000);
+
+    dirp = opendir(dir);
+    while (dirp && (entry = readdir(dirp))) {
+        n_big += entry->d_name[0] != '.';
+    }
+    closedir(dirp);
+    unlink(path);
+    tap_ok(n_big == 1, "alone within the budget");
+    return 0;
+}
+
+static void register_big(const char *description, size_t memory) {
+    tap_register_ex(NULL, big_test,
+                    &(struct tap_test_attrs){.description = description,
+                                             .memory = memory});
+}
+
+static void write_baseline(void) {
+    FILE *fp;
+
+    fp = fopen(BASELINE_PATH, "w");
+    if (!fp) {
+        return;
+    }
+    fprintf(fp, "1000000000/%zu learned\n", 60 * MB);
+    fprintf(fp, "1000000000 small\n");
+    fclose(fp);
+}
+
+/* Print which saved tests had their memory measured */
+static void print_baseline_memory(void) {
+    size_t line_len = 0;
+    char *line = NULL;
+    FILE *fp;
+
+    fp = fopen(BASELINE_PATH, "r");
+    if (!fp) {
+        printf("failed to open %s\n", BASELINE_PATH);
+        return;
+    }
+    for (; getline(&line, &line_len, fp) != -1;) {
+        printf("saved:%s %s", strchr(line, '/') ? " measured" : "",
+               strchr(line, ' ') + 1);
+    }
+    free(line);
+    fclose(fp);
+}
+
+int main(void) {
+    if (!mkdtemp(dir)) {
+        return 1;
+    }
+
+    /* Two 60M tests do not fit in 100M, small ones use the other slots */
+    write_baseline();
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 4);
+    tap_set_option(NULL, TAP_OPTION_MEMORY_BUDGET, 100 * MB);
+    tap_set_option(NULL, TAP_OPTION_BASELINE_FILE, BASELINE_PATH);
+    tap_set_option(NULL, TAP_OPTION_BASELINE_SAVE_FILE, BASELINE_PATH);
+    register_big("declared", 60 * MB);
+    register_big("declared again", 60 * MB);
+    register_big("over the budget", 200 * MB);
+    tap_register_ex(NULL, big_test,
+                    &(struct tap_test_attrs){.description = "learned"});
+    for (size_t idx = 0; idx < 3; idx++) {
+        tap_register(NULL, pass, "small");
+    }
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    print_baseline_memory();
+    unlink(BASELINE_PATH);
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <tap.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+static int repeated_lines(void) {
+    for (int idx = 0; idx < 5; idx++) {
+        printf("the same line\n");
+    }
+    printf("a different line\n");
+    printf("the same line\n");
+    printf("the same line\n");
+    return 0;
+}
+
+static int repeated_to_the_end(void) {
+    printf("first line\n");
+    for (int idx = 0; idx < 1000; idx++) {
+        printf("spinning\n");
+    }
+    return 0;
+}
+
+static int too_many_lines(void) {
+    for (int idx = 0; idx < 10; idx++) {
+        printf("line %d\n", idx);
+    }
+    /* Commands are still followed past the limit */
+    printf(":SKIP limited\n");
+    return 0;
+}
+
+static int too_many_bytes(void) {
+    printf("0123456789\n");
+    printf("0123456789\n");
+    printf("this line does not fit\n");
+    /* Nor does anything after it, though it would */
+    printf("short\n");
+    return 0;
+}
+
+static int spilling(void) {
+    printf("kept\n");
+    printf("spilled\n");
+    return 0;
+}
+
+static void print_file(const char *path) {
+    char line[256];
+    FILE *fp = fopen(path, "r");
+
+    if (!fp) {
+        printf("failed to open %s\n", path);
+        return;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        printf("%s: %s", path, line);
+    }
+    fclose(fp);
+}
+
+int main(void) {
+    int stdout_fd;
+
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_set_option(NULL, TAP_OPTION_COLLAPSE_REPEATS, 1);
+    tap_register(NULL, repeated_lines, NULL);
+    tap_register(NULL, repeated_to_the_end, NULL);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    printf("\n");
+
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_set_option(NULL, TAP_OPTION_OUTPUT_MAX_LINES, (size_t)3);
+    tap_set_option(NULL, TAP_OPTION_OUTPUT_MAX_BYTES, (size_t)25);
+    tap_register(NULL, too_many_lines, NULL);
+    tap_register(NULL, too_many_bytes, NULL);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    printf("\n");
+
+    /* Each repetition adds to the spill file, rather than replacing it */
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_set_option(NULL, TAP_OPTION_OUTPUT_MAX_LINES, (size_t)1);
+    tap_set_option(NULL, TAP_OPTION_OUTPUT_SPILL_DIR, ".");
+    tap_set_option(NULL, TAP_OPTION_REPEAT, (size_t)2);
+    tap_register(NULL, spilling, NULL);
+    stdout_fd = capture_stdout("test_output_limits.out.tmp");
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+    print_masked_capture("test_output_limits.out.tmp", stdout_fd);
+    unlink("test_output_limits.out.tmp");
+    print_file("./test-1.log");
+    unlink("./test-1.log");
+}
@@ -0,0 +1,104 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <tap.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+#define SOCKET_PATH "./test_remote.sock.tmp"
+#define CRASH_PATH "test_remote.crash.tmp"
+#define WORKER_ENV "UNITESTAP_WORKER"
+
+static int on_worker(void) { return getenv(WORKER_ENV) ? 0 : -1; }
+
+static int here(void) { return getenv(WORKER_ENV) ? -1 : 0; }
+
+static int with_subtests(void) {
+    tap_ok(getenv(WORKER_ENV) != NULL, "on a worker");
+    tap_ok(1, "still streamed back");
+    return 0;
+}
+
+/* Takes its worker down with it the first time round, after its output was
+ * streamed back */
+static int kills_worker(void) {
+    if (unlink(CRASH_PATH) == 0) {
+        printf("output of the lost lease\n");
+        fflush(stdout);
+        usleep(200000);
+        kill(getppid(), SIGKILL);
+        return -1;
+    }
+    return on_worker();
+}
+
+static void register_tests(int extra) {
+    tap_register(NULL, on_worker, "on a worker");
+    tap_register(NULL, fail, "failing on a worker");
+    tap_register(NULL, with_subtests, "with subtests");
+    tap_register(NULL, kills_worker, "kills its worker");
+    tap_register_resources(NULL, here, "port", "holding a resource");
+    if (extra) {
+        tap_register(NULL, pass, "only registered by the worker");
+    }
+}
+
+/* A worker of the runner at SOCKET_PATH, running one test at a time */
+static pid_t start_worker(int extra) {
+    pid_t pid;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0) {
+        setenv(WORKER_ENV, SOCKET_PATH, 1);
+        tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+        register_tests(extra);
+        tap_runall(NULL);
+        _exit(1);
+    }
+    return pid;
+}
+
+static void runall(double wait) {
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_set_option(NULL, TAP_OPTION_WORKER_LISTEN, SOCKET_PATH);
+    tap_set_option(NULL, TAP_OPTION_WORKER_WAIT, wait);
+    register_tests(0);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+}
+
+int main(void) {
+    pid_t workers[2];
+    int wstatus, fd;
+
+    /* The lease of the worker killed is issued again to the other one, the
+     * test holding a resource is run here */
+    fd = open(CRASH_PATH, O_WRONLY | O_CREAT, 0644);
+    close(fd);
+    workers[0] = start_worker(0);
+    workers[1] = start_worker(0);
+    runall(5.0);
+    for (size_t idx = 0; idx < 2; idx++) {
+        waitpid(workers[idx], &wstatus, 0);
+    }
+
+    printf("\n");
+
+    /* Without any worker everything is run here */
+    runall(0.2);
+
+    printf("\n");
+
+    /* As it is when the only worker has other tests */
+    workers[0] = start_worker(1);
+    runall(0.5);
+    waitpid(workers[0], &wstatus, 0);
+    printf("worker exited: %d\n",
+           WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : -1);
+    unlink(CRASH_PATH);
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <tap.h>
+
+#include "internal.h"
+
+#define OUTPUT_PATH "test_repeat.output.tmp"
+
+static int fails_assertion(void) {
+    tap_ok(true, "always passes");
+    tap_ok(false, "always fails");
+    return 0;
+}
+
+int main(void) {
+    int stdout_fd;
+
+    /* Durations vary between runs, capture the report to mask them */
+    stdout_fd = capture_stdout(OUTPUT_PATH);
+    if (stdout_fd == -1) {
+        return 1;
+    }
+
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 4);
+    tap_set_option(NULL, TAP_OPTION_REPEAT, (size_t)5);
+    tap_register(NULL, pass, "repeated pass");
+    tap_register(NULL, fails_assertion, "repeated failure");
+    tap_register(NULL, fail, NULL);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    printf("\n");
+
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 4);
+    tap_set_option(NULL, TAP_OPTION_REPEAT, (size_t)3);
+    tap_set_option(NULL, TAP_OPTION_REPEAT_FILTER, "*selected*");
+    tap_register(NULL, pass, "run once");
+    tap_register(NULL, pass, "selected for repeating");
+    tap_register(NULL, fail, NULL);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    print_masked_capture(OUTPUT_PATH, stdout_fd);
+}
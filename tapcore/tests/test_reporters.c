@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tap.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+#define JUNIT_PATH "test_reporters.junit.xml"
+#define JSONL_PATH "test_reporters.jsonl"
+
+static int pass_output(void) {
+    printf("Output with <xml> & \"json\" characters\n");
+    return 0;
+}
+
+static int pass_skipped(void) {
+    printf(":SKIP don't need this test");
+    return 0;
+}
+
+static int fail_assertions(void) {
+    tap_ok(true, "this passed");
+    tap_ok(false, "this did not");
+    return 0;
+}
+
+/* Replace the number following key with "***", in place */
+static void mask_value(char *line, const char *key) {
+    char *pos;
+    size_t n_digits;
+
+    pos = strstr(line, key);
+    if (!pos) {
+        return;
+    }
+    pos += strlen(key);
+    n_digits = strspn(pos, "0123456789.");
+    if (n_digits < 3) {
+        /* Unknown timings are null, too short to mask */
+        return;
+    }
+    memcpy(pos, "***", 3);
+    memmove(pos + 3, pos + n_digits, strlen(pos + n_digits) + 1);
+}
+
+static void print_report(const char *path, const char *const *time_keys) {
+    size_t line_len = 0;
+    char *line = NULL;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        printf("failed to open %s\n", path);
+        return;
+    }
+    for (; getline(&line, &line_len, fp) != -1;) {
+        /* Mask timings to keep the output stable between runs */
+        for (const char *const *key = time_keys; *key; key++) {
+            mask_value(line, *key);
+        }
+        printf("%s", line);
+    }
+    free(line);
+    fclose(fp);
+    unlink(path);
+}
+
+int main(void) {
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_set_option(NULL, TAP_OPTION_JUNIT_FILE, JUNIT_PATH);
+    tap_set_option(NULL, TAP_OPTION_JSONL_FILE, JSONL_PATH);
+    tap_easy_register(pass, "Test that passes");
+    tap_easy_register(fail, NULL);
+    tap_easy_register(pass_output, "Test with output");
+    tap_easy_register(pass_skipped, NULL);
+    tap_easy_register(fail_assertions, "Test with assertions");
+    tap_easy_runall_and_cleanup();
+
+    printf("\n");
+    print_report(JUNIT_PATH, (const char *[]){"time=\"", NULL});
+    printf("\n");
+    print_report(JSONL_PATH, (const char *[]){"\"duration\":", "\"cpu\":",
+                                              "\"overhead\":", NULL});
+}
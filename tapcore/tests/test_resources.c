@@ -0,0 +1,82 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tap.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+static char dir[] = "/tmp/test_resources.XXXXXX";
+
+/* Hold a resource for a while, counting who else holds it via marker files */
+static size_t hold(const char *resource) {
+    struct dirent *entry;
+    char path[96];
+    size_t n_holders = 0;
+    DIR *dirp;
+
+    snprintf(path, sizeof(path), "%s/%s-%d", dir, resource, getpid());
+    close(creat(path, 0644));
+    usleep(20 * 1000);
+
+    dirp = opendir(dir);
+    while (dirp && (entry = readdir(dirp))) {
+        n_holders += strncmp(entry->d_name, resource, strlen(resource)) == 0;
+    }
+    closedir(dirp);
+    unlink(path);
+    return n_holders;
+}
+
+static int port_test(void) {
+    tap_ok(hold("port") == 1, "port held alone");
+    return 0;
+}
+
+static int db_test(void) {
+    tap_ok(hold("db") <= 2, "db held by at most two");
+    return 0;
+}
+
+static int port_and_db_test(void) {
+    tap_ok(hold("port") == 1, "port held alone");
+    return 0;
+}
+
+int main(void) {
+    int err;
+
+    if (!mkdtemp(dir)) {
+        return 1;
+    }
+
+    tap_register_resources(NULL, pass, "port:1", NULL);
+    err = tap_register_resources(NULL, pass, "port:2", NULL);
+    printf("mismatched capacity: %s\n", strerror(err));
+    err = tap_register_resources(NULL, pass, ":1", NULL);
+    printf("no name: %s\n", strerror(err));
+    err = tap_register_resources(NULL, pass, "port:0", NULL);
+    printf("no capacity: %s\n", strerror(err));
+    err = tap_register_resources(NULL, pass, "port:1x", NULL);
+    printf("bad capacity: %s\n", strerror(err));
+    tap_cleanup(NULL);
+
+    printf("\n");
+
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 4);
+    for (size_t idx = 0; idx < 3; idx++) {
+        tap_register_resources(NULL, port_test, "port", "port");
+        tap_register_resources(NULL, db_test, "db:2", "db");
+    }
+    tap_register_resources(NULL, port_and_db_test, "port:1,db:2",
+                           "port and db");
+    tap_register(NULL, pass, "no resources");
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    rmdir(dir);
+    return 0;
+}
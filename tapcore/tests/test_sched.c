@@ -0,0 +1,136 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tap.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+static char path[] = "/tmp/test_sched.XXXXXX";
+
+/* Note which test started, the runner is alone so they start one by one */
+static int started(const char *name) {
+    FILE *fp = fopen(path, "a");
+
+    if (!fp) {
+        return 1;
+    }
+    fprintf(fp, " %s", name);
+    fclose(fp);
+    return 0;
+}
+
+static int test_a(void) { return started("a"); }
+static int test_b(void) { return started("b"); }
+static int test_c(void) { return started("c"); }
+static int test_d(void) { return started("d"); }
+
+static int test_hangs(void) {
+    sleep(10);
+    return 0;
+}
+
+static void print_start_order(void) {
+    char buf[64] = {0};
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd != -1 && read(fd, buf, sizeof(buf) - 1) > 0) {
+        printf("started:%s\n", buf);
+    }
+    close(fd);
+    truncate(path, 0);
+}
+
+/* Start the last candidate, tagged "late" ones only once nothing else is */
+static size_t pick_last(const struct tap_sched_candidate *candidates,
+                        size_t n_candidates, void *priv) {
+    size_t *n_calls = priv;
+
+    (*n_calls)++;
+    for (size_t idx = n_candidates; idx > 0; idx--) {
+        if (!candidates[idx - 1].tags ||
+            strcmp(candidates[idx - 1].tags, "late") != 0) {
+            return idx - 1;
+        }
+    }
+    return n_candidates;
+}
+
+static void register_tests(void) {
+    tap_register_ex(NULL, test_a,
+                    &(struct tap_test_attrs){
+                        .description = "a", .priority = 1, .cost = 2});
+    tap_register_ex(NULL, test_b,
+                    &(struct tap_test_attrs){.description = "b",
+                                             .priority = 3,
+                                             .cost = 0.5,
+                                             .tags = "late"});
+    tap_register_ex(NULL, test_c,
+                    &(struct tap_test_attrs){
+                        .description = "c", .priority = 2, .cost = 3});
+    tap_register_ex(NULL, test_d,
+                    &(struct tap_test_attrs){.description = "d", .cost = 1});
+}
+
+static void run(const char *name, TAP_SCHED policy) {
+    printf("%s\n", name);
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_set_option(NULL, TAP_OPTION_SCHEDULER, policy);
+    register_tests();
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+    print_start_order();
+    printf("\n");
+}
+
+int main(void) {
+    size_t n_calls = 0;
+    int fd, err;
+
+    fd = mkstemp(path);
+    if (fd == -1) {
+        return 1;
+    }
+    close(fd);
+
+    err = tap_set_option(NULL, TAP_OPTION_SCHEDULER, 42);
+    printf("unknown policy: %s\n", strerror(err));
+    err = tap_register_ex(NULL, pass,
+                          &(struct tap_test_attrs){.cost = -1});
+    printf("negative cost: %s\n", strerror(err));
+    err = tap_register_ex(NULL, pass,
+                          &(struct tap_test_attrs){.timeout = -1});
+    printf("negative timeout: %s\n", strerror(err));
+    tap_cleanup(NULL);
+    printf("\n");
+
+    run("fifo", TAP_SCHED_FIFO);
+    run("priority", TAP_SCHED_PRIORITY);
+    run("shortest first", TAP_SCHED_SHORTEST_FIRST);
+    run("longest first", TAP_SCHED_LONGEST_FIRST);
+
+    printf("custom pick\n");
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_set_option(NULL, TAP_OPTION_SCHEDULER_PICK, pick_last, &n_calls);
+    register_tests();
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+    print_start_order();
+    printf("picked %s\n", n_calls > 0 ? "by callback" : "without callback");
+    printf("\n");
+
+    tap_register_ex(NULL, test_hangs,
+                    &(struct tap_test_attrs){.description = "hangs",
+                                             .timeout = 0.1});
+    tap_register_ex(NULL, pass,
+                    &(struct tap_test_attrs){.description = "in time",
+                                             .timeout = 5});
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    unlink(path);
+    return 0;
+}
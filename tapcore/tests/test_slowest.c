@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <tap.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+#define OUTPUT_PATH "test_slowest.output.tmp"
+
+static void sleep_ms(long ms) {
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = ms * 1000 * 1000};
+
+    nanosleep(&ts, NULL);
+}
+
+static int quick(void) { return 0; }
+
+static int slow(void) {
+    sleep_ms(50);
+    return 0;
+}
+
+static int slower(void) {
+    sleep_ms(100);
+    return 0;
+}
+
+int main(void) {
+    int stdout_fd;
+
+    /* Timings vary between runs, capture the report to mask them */
+    stdout_fd = capture_stdout(OUTPUT_PATH);
+    if (stdout_fd == -1) {
+        return 1;
+    }
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_set_option(NULL, TAP_OPTION_SLOWEST, (size_t)2);
+    tap_register(NULL, quick, "quick");
+    tap_register(NULL, slower, "slower");
+    tap_register(NULL, slow, NULL);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+    print_masked_capture(OUTPUT_PATH, stdout_fd);
+}
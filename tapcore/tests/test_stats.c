@@ -0,0 +1,63 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <tap.h>
+
+#include "internal.h"
+
+static int writes_output(void) {
+    printf("twelve bytes\n");
+    printf("twelve bytes\n");
+    return 0;
+}
+
+static int writes_nothing(void) { return 0; }
+
+static int histogram_percentiles(void) {
+    struct tap_histogram hist = {0};
+    uint64_t values[] = {0, 1, 5, 6, 100, 1000};
+
+    tap_is(tap_histogram_percentile(&hist, 50), 0, "empty histogram");
+    for (size_t idx = 0; idx < sizeof(values) / sizeof(*values); idx++) {
+        hist.buckets[values[idx] ? 64 - __builtin_clzll(values[idx]) : 0]++;
+        hist.count++;
+        hist.sum += values[idx];
+        hist.max = values[idx];
+    }
+    tap_is(tap_histogram_percentile(&hist, 0), 0, "p0 is the zero bucket");
+    tap_is(tap_histogram_percentile(&hist, 33), 1, "p33 is the 1 bucket");
+    tap_is(tap_histogram_percentile(&hist, 50), 7, "p50 rounds up to 7");
+    tap_is(tap_histogram_percentile(&hist, 80), 127, "p80 rounds up");
+    tap_is(tap_histogram_percentile(&hist, 100), 1000, "p100 is the max");
+    return 0;
+}
+
+int main(void) {
+    struct tap_stats stats;
+
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_register(NULL, writes_output, NULL);
+    tap_register(NULL, writes_nothing, NULL);
+    tap_register(NULL, histogram_percentiles, NULL);
+    tap_runall(NULL);
+
+    /* Timings vary between runs, only the deterministic counts are printed */
+    tap_get_stats(NULL, &stats);
+    printf("forks %llu, reaps %llu, tests with output %llu\n",
+           (unsigned long long)stats.fork_ns.count,
+           (unsigned long long)stats.reap_delay_ns.count,
+           (unsigned long long)stats.output_bytes.count);
+    printf("wakeups at least reaps %d\n",
+           stats.n_wakeups >= stats.reap_delay_ns.count);
+    tap_cleanup(NULL);
+
+    printf("\n");
+
+    /* The block of stats ending the run, its numbers masked by test_tap */
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_set_option(NULL, TAP_OPTION_STATS, 1);
+    tap_register(NULL, writes_output, NULL);
+    tap_register(NULL, writes_nothing, NULL);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+}
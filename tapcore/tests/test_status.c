@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tap.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+#define STATUS_PATH "test_status.json"
+#define STATUS_TMP_PATH STATUS_PATH ".tmp"
+
+static int pass_skipped(void) {
+    printf(":SKIP not needed");
+    return 0;
+}
+
+/* Replace every number following key with "***", in place */
+static void mask_values(char *line, const char *key) {
+    char *pos = line;
+
+    while ((pos = strstr(pos, key))) {
+        size_t n_digits;
+
+        pos += strlen(key);
+        n_digits = strspn(pos, "0123456789.");
+        if (n_digits < 3) {
+            continue;
+        }
+        memcpy(pos, "***", 3);
+        memmove(pos + 3, pos + n_digits, strlen(pos + n_digits) + 1);
+    }
+}
+
+/* Print the snapshot in the status file, without what differs between runs.
+ * Returns false if it is missing or does not contain want */
+static bool print_status(const char *want) {
+    char snapshot[1024] = "";
+    FILE *fp;
+
+    fp = fopen(STATUS_PATH, "r");
+    if (!fp) {
+        return false;
+    }
+    fgets(snapshot, sizeof(snapshot), fp);
+    fclose(fp);
+    if (!strstr(snapshot, want)) {
+        return false;
+    }
+    mask_values(snapshot, "\"pid\":");
+    mask_values(snapshot, "\"elapsed\":");
+    printf("%s", snapshot);
+    printf("temporary file left behind: %s\n",
+           access(STATUS_TMP_PATH, F_OK) == 0 ? "yes" : "no");
+    return true;
+}
+
+/* Wait for the runner to list this test as running, snapshots are only
+ * written now and then */
+static int reads_own_status(void) {
+    for (size_t n_tries = 0; n_tries < 50; n_tries++) {
+        if (print_status("\"running\":[{\"slot\":0,\"test\":4")) {
+            return 0;
+        }
+        usleep(100 * 1000);
+    }
+    printf("never listed as running\n");
+    return -1;
+}
+
+int main(void) {
+    unlink(STATUS_PATH);
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_set_option(NULL, TAP_OPTION_STATUS_FILE, STATUS_PATH);
+    tap_register(NULL, pass, "passes");
+    tap_register(NULL, fail, "fails");
+    tap_register(NULL, pass_skipped, "skipped");
+    tap_register(NULL, reads_own_status, "reads its own status");
+    tap_register(NULL, pass, "still queued while it runs");
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    printf("\n");
+    if (!print_status("\"running\":[]")) {
+        printf("no final snapshot\n");
+    }
+    unlink(STATUS_PATH);
+    return 0;
+}
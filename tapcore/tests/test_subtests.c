@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <tap.h>
+
+#include "internal.h"
+
+static int pass_assertions(void) {
+    tap_ok(1 + 1 == 2, "one plus one is %d", 2);
+    tap_is(2 * 3, 6, "two times three is six");
+    tap_is_str("uni" "TesTap", "uniTesTap", "strings concatenate");
+    tap_cmp(1, "<", 2, NULL);
+    return 0;
+}
+
+static int fail_assertions(void) {
+    tap_ok(true, NULL);
+    tap_is(2 * 3, 5, "two times three is five");
+    tap_is_str("uni", NULL, "a string is not NULL");
+    tap_cmp(2, ">=", 3, "two is at least three");
+    tap_ok(true, "keeps running after a failure");
+    return 0;
+}
+
+static int fail_exit_with_assertions(void) {
+    tap_ok(true, "assertion before failing");
+    return 1;
+}
+
+static int skip_with_assertions(void) {
+    tap_ok(true, "assertion before skipping");
+    printf(":SKIP no need to go further\n");
+    return 0;
+}
+
+int main(void) {
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_easy_register(pass_assertions, "Passing assertions");
+    tap_easy_register(fail_assertions, "Failing assertions");
+    tap_easy_register(pass, NULL);
+    tap_easy_register(fail_exit_with_assertions, NULL);
+    tap_easy_register(skip_with_assertions, NULL);
+    tap_easy_runall_and_cleanup();
+}
@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <tap.h>
+
+#include "internal.h"
+
+static int pass_output(void) {
+    printf("Output from a thread\n");
+    fprintf(stderr, "Error output from a thread\n");
+    return 0;
+}
+
+static int pass_skipped(void) {
+    printf(":SKIP don't need this test");
+    return 0;
+}
+
+static int fail_exit_status(void) { return 256 + 1; }
+
+static int dereference_null_ptr(void) {
+    int *priv = NULL;
+    return *priv == 0;
+}
+
+static int pass_output_after_crash(void) {
+    printf("Output from a process\n");
+    return 0;
+}
+
+int main(void) {
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_set_option(NULL, TAP_OPTION_THREADED, 1);
+    tap_register(NULL, pass, NULL);
+    tap_register(NULL, fail, NULL);
+    tap_register(NULL, pass_output, NULL);
+    tap_register(NULL, pass_skipped, NULL);
+    tap_register(NULL, fail_exit_status, NULL);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    printf("\n");
+
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 1);
+    tap_set_option(NULL, TAP_OPTION_THREADED, 1);
+    tap_register(NULL, pass, NULL);
+    /* Terminates the engine, the rest re-run as processes */
+    tap_register(NULL, dereference_null_ptr, NULL);
+    tap_register(NULL, pass_output_after_crash, NULL);
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tap.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+#define TRACE_PATH "test_trace.json.tmp"
+
+/* Holds on to its slot until the other tests went through the second one */
+static int pass_slowly(void) {
+    usleep(300 * 1000);
+    return 0;
+}
+
+/* Copy the string value following key in line into buf, "" if there is none */
+static void json_value(const char *line, const char *key, char *buf,
+                       size_t size) {
+    const char *pos;
+    size_t len;
+
+    buf[0] = '\0';
+    pos = strstr(line, key);
+    if (!pos) {
+        return;
+    }
+    pos += strlen(key);
+    len = strcspn(pos, "\",}");
+    if (len >= size) {
+        len = size - 1;
+    }
+    memcpy(buf, pos, len);
+    buf[len] = '\0';
+}
+
+/* Print each event of the trace by name and track, without its times. The
+ * scheduler's wakeups depend on timing and are only counted */
+static void print_trace(const char *path) {
+    char name[64], tid[16], test[16], track[64];
+    size_t line_len = 0, n_wakeups = 0;
+    char *line = NULL;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        printf("no trace written\n");
+        return;
+    }
+    for (; getline(&line, &line_len, fp) != -1;) {
+        json_value(line, "{\"name\":\"", name, sizeof(name));
+        json_value(line, "\"tid\":", tid, sizeof(tid));
+        json_value(line, "\"test\":", test, sizeof(test));
+        if (strcmp(name, "wakeup") == 0) {
+            n_wakeups++;
+        } else if (strcmp(name, "process_name") == 0) {
+            json_value(line, "\"args\":{\"name\":\"", track, sizeof(track));
+            printf("process: %s\n", track);
+        } else if (strcmp(name, "thread_name") == 0) {
+            json_value(line, "\"args\":{\"name\":\"", track, sizeof(track));
+            printf("track %s: %s\n", tid, track);
+        } else if (*test) {
+            printf("test %s: %s on track %s\n", test, name, tid);
+        } else {
+            printf("%s", line);
+        }
+    }
+    printf("wakeups: %s\n", n_wakeups > 0 ? "some" : "none");
+    free(line);
+    fclose(fp);
+    unlink(path);
+}
+
+int main(void) {
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 2);
+    tap_set_option(NULL, TAP_OPTION_TRACE_FILE, TRACE_PATH);
+    tap_register(NULL, pass_slowly, "holds slot 0");
+    tap_register(NULL, pass, "runs in slot 1");
+    tap_register(NULL, fail, "runs in slot 1 after");
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+
+    printf("\n");
+    print_trace(TRACE_PATH);
+    return 0;
+}
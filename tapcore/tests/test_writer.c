@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tap.h>
+
+#include "internal.h"
+
+#define PLAIN_PATH "test_writer.plain.tmp"
+#define WRITER_PATH "test_writer.writer.tmp"
+
+/* Enough output to go through the writer's chunks many times over */
+static int chatty(void) {
+    for (int idx = 0; idx < 2000; idx++) {
+        printf("line %d of a test with plenty to say\n", idx);
+    }
+    return 0;
+}
+
+static void run(size_t writer_size) {
+    tap_set_option(NULL, TAP_OPTION_N_RUNNERS, 4);
+    tap_set_option(NULL, TAP_OPTION_WRITER_THREAD, writer_size);
+    for (size_t idx = 0; idx < 8; idx++) {
+        tap_register(NULL, chatty, "chatty");
+    }
+    tap_register(NULL, fail, "fails");
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+}
+
+static int line_cmp(const void *lhs, const void *rhs) {
+    return strcmp(*(char *const *)lhs, *(char *const *)rhs);
+}
+
+/* The lines of path, without the durations of the test lines */
+static char **read_lines(const char *path, size_t *d_n_lines) {
+    size_t n_lines = 0, line_size = 0;
+    char **lines = NULL, *line = NULL;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    while (fp && getline(&line, &line_size, fp) != -1) {
+        if (strncmp(line, "ok", 2) == 0 || strncmp(line, "not ok", 6) == 0) {
+            *strrchr(line, '(') = '\0';
+        }
+        lines = realloc(lines, (n_lines + 1) * sizeof(*lines));
+        lines[n_lines++] = line;
+        line = NULL;
+    }
+    free(line);
+    if (fp) {
+        fclose(fp);
+    }
+    *d_n_lines = n_lines;
+    return lines;
+}
+
+/* Tests run side by side, so the output of one is only in order with itself.
+ * Print how the two outputs compare once sorted */
+static void compare(const char *lhs_path, const char *rhs_path) {
+    size_t n_lhs, n_rhs, n_differ = 0;
+    char **lhs, **rhs;
+
+    lhs = read_lines(lhs_path, &n_lhs);
+    rhs = read_lines(rhs_path, &n_rhs);
+    printf("first lines: %s", n_lhs > 0 ? lhs[0] : "\n");
+    printf("first lines %s\n",
+           n_lhs > 0 && n_rhs > 0 && strcmp(lhs[0], rhs[0]) == 0 ? "match"
+                                                                : "differ");
+    qsort(lhs, n_lhs, sizeof(*lhs), line_cmp);
+    qsort(rhs, n_rhs, sizeof(*rhs), line_cmp);
+    for (size_t idx = 0; idx < n_lhs && idx < n_rhs; idx++) {
+        n_differ += strcmp(lhs[idx], rhs[idx]) != 0;
+    }
+    printf("%zu and %zu lines, %zu differ\n", n_lhs, n_rhs, n_differ);
+
+    for (size_t idx = 0; idx < n_lhs; idx++) {
+        free(lhs[idx]);
+    }
+    for (size_t idx = 0; idx < n_rhs; idx++) {
+        free(rhs[idx]);
+    }
+    free(lhs);
+    free(rhs);
+}
+
+int main(void) {
+    int stdout_fd;
+
+    /* Output written by the runner, then by a writer with the least room */
+    stdout_fd = capture_stdout(PLAIN_PATH);
+    if (stdout_fd == -1) {
+        return 1;
+    }
+    printf("printed before\n");
+    run(0);
+    fflush(stdout);
+    freopen(WRITER_PATH, "w", stdout);
+    printf("printed before\n");
+    run(1);
+    fflush(stdout);
+    dup2(stdout_fd, STDOUT_FILENO);
+    close(stdout_fd);
+
+    compare(PLAIN_PATH, WRITER_PATH);
+    unlink(PLAIN_PATH);
+    unlink(WRITER_PATH);
+    printf("\n");
+
+    /* The writer is stopped again once the run is reported */
+    tap_set_option(NULL, TAP_OPTION_WRITER_THREAD, (size_t)1 << 20);
+    tap_register(NULL, pass, "passes");
+    tap_register(NULL, fail, "fails");
+    tap_runall(NULL);
+    tap_cleanup(NULL);
+    printf("printed after\n");
+    return 0;
+}
@@ -0,0 +1,358 @@
+/**
+ * @file threadrun.c
+ *
+ * Runs tests as threads inside a single forked engine process. Results are
+ * streamed back to the runner, tests the engine did not report on (e.g. the
+ * engine was terminated by a signal) are left for the per process runner.
+ */
+#define _GNU_SOURCE /* fopencookie() */
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <tap.h>
+#include <tapio.h>
+#include <tapstruct.h>
+#include <taptest.h>
+#include <taputil.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "internal.h"
+
+struct tap_thread_record {
+    size_t id;
+    int retval;
+    struct tap_duration duration;
+    struct tap_duration cpu;
+    size_t out_len;
+};
+
+struct tap_thread_result {
+    struct tap_thread_result *next;
+    struct tap_thread_record record;
+    char *out;
+};
+
+struct tap_engine {
+    struct test *tests;
+    size_t n_tests;
+    /* Index of the next test to be claimed by a worker thread */
+    size_t next_idx;
+    /* Lock-free stack of finished tests, drained by the engine thread */
+    struct tap_thread_result *finished;
+    sem_t n_finished;
+};
+
+/* Captured stdout and stderr of the test running on this thread */
+static __thread FILE *capture = NULL;
+
+static ssize_t tap_capture_write(void *cookie, const char *buf, size_t size) {
+    if (!capture) {
+        /* Output from outside of a test, keep it out of the TAP stream */
+        return write(STDERR_FILENO, buf, size);
+    }
+    return fwrite(buf, 1, size, capture);
+}
+
+static int tap_write_full(int fd, const void *buf, size_t len) {
+    const char *pos = buf;
+
+    while (len > 0) {
+        ssize_t n_written;
+
+        n_written = write(fd, pos, len);
+        if (n_written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        pos += n_written;
+        len -= n_written;
+    }
+    return 0;
+}
+
+static int tap_read_full(int fd, void *buf, size_t len) {
+    char *pos = buf;
+
+    while (len > 0) {
+        ssize_t n_read;
+
+        n_read = read(fd, pos, len);
+        if (n_read == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        if (n_read == 0) {
+            /* Engine closed the pipe mid-record or between records */
+            return EPIPE;
+        }
+        pos += n_read;
+        len -= n_read;
+    }
+    return 0;
+}
+
+static void tap_engine_push(struct tap_engine *engine,
+                            struct tap_thread_result *res) {
+    struct tap_thread_result *head;
+
+    head = __atomic_load_n(&engine->finished, __ATOMIC_RELAXED);
+    do {
+        res->next = head;
+    } while (!__atomic_compare_exchange_n(&engine->finished, &head, res, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    sem_post(&engine->n_finished);
+}
+
+static void tap_engine_run_test(struct test *test,
+                                struct tap_thread_result *res) {
+    struct tap_thread_record *record = &res->record;
+
+    capture = open_memstream(&res->out, &record->out_len);
+    if (!capture) {
+        /* Give up on the engine, the runner will fork the tests instead */
+        _exit(errno);
+    }
+
+    record->id = test->id;
+    clock_gettime(CLOCK_MONOTONIC, &record->duration.t0);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &record->cpu.t0);
+    record->retval = test->funct();
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &record->cpu.t1);
+    clock_gettime(CLOCK_MONOTONIC, &record->duration.t1);
+
+    /* Closing the stream finalises res->out and record->out_len */
+    fclose(capture);
+    capture = NULL;
+}
+
+/* Concurrent tests need processes of their own, tests holding resources or
+ * memory must wait on them and a thread cannot be cut short by a timeout. All
+ * are left to be forked */
+static bool tap_engine_skips(struct test *test) {
+    return test->n_instances > 1 || test->resources != 0 ||
+           test->timeout > 0 || test->memory > 0 ||
+           tap_limits_set(&test->limits);
+}
+
+static void *tap_engine_worker(void *arg) {
+    struct tap_engine *engine = arg;
+
+    while (true) {
+        struct tap_thread_result *res;
+        size_t idx;
+
+        idx = __atomic_fetch_add(&engine->next_idx, 1, __ATOMIC_RELAXED);
+        if (idx >= engine->n_tests) {
+            break;
+        }
+        if (tap_engine_skips(&engine->tests[idx])) {
+            continue;
+        }
+
+        res = calloc(1, sizeof(*res));
+        if (!res) {
+            _exit(ENOMEM);
+        }
+        tap_engine_run_test(&engine->tests[idx], res);
+        tap_engine_push(engine, res);
+    }
+    return NULL;
+}
+
+static int tap_engine_send(struct tap_engine *engine, int resfd) {
+    struct tap_thread_result *res, *ordered = NULL;
+    int n_sent = 0;
+
+    res = __atomic_exchange_n(&engine->finished, NULL, __ATOMIC_ACQUIRE);
+
+    /* Reverse the stack to send results in the order they finished */
+    while (res) {
+        struct tap_thread_result *next = res->next;
+
+        res->next = ordered;
+        ordered = res;
+        res = next;
+    }
+
+    while (ordered) {
+        struct tap_thread_result *next = ordered->next;
+        int err;
+
+        err = tap_write_full(resfd, &ordered->record, sizeof(ordered->record));
+        if (err == 0) {
+            err = tap_write_full(resfd, ordered->out,
+                                 ordered->record.out_len);
+        }
+        if (err != 0) {
+            _exit(err);
+        }
+        free(ordered->out);
+        free(ordered);
+        ordered = next;
+        n_sent++;
+    }
+    return n_sent;
+}
+
+static void tap_engine_main(struct test *tests, size_t n_tests,
+                            unsigned int n_threads, int resfd) {
+    struct tap_engine engine = {
+        .tests = tests,
+        .n_tests = n_tests,
+    };
+    pthread_t *threads;
+    size_t n_sent = 0, n_run = 0;
+    FILE *stream;
+    int err;
+
+    for (size_t idx = 0; idx < n_tests; idx++) {
+        n_run += !tap_engine_skips(&tests[idx]);
+    }
+
+    /* Unbuffered so each write reaches the cookie on the writing thread */
+    stream = fopencookie(NULL, "w",
+                         (cookie_io_functions_t){.write = tap_capture_write});
+    if (!stream) {
+        _exit(errno);
+    }
+    setvbuf(stream, NULL, _IONBF, 0);
+    stdout = stream;
+    stderr = stream;
+
+    threads = calloc(n_threads, sizeof(*threads));
+    if (!threads || sem_init(&engine.n_finished, 0, 0) != 0) {
+        _exit(ENOMEM);
+    }
+    for (unsigned int idx = 0; idx < n_threads; idx++) {
+        err = pthread_create(&threads[idx], NULL, tap_engine_worker, &engine);
+        if (err != 0) {
+            _exit(err);
+        }
+    }
+
+    while (n_sent < n_run) {
+        if (sem_wait(&engine.n_finished) != 0) {
+            continue;
+        }
+        n_sent += tap_engine_send(&engine, resfd);
+    }
+
+    for (unsigned int idx = 0; idx < n_threads; idx++) {
+        pthread_join(threads[idx], NULL);
+    }
+    _exit(0);
+}
+
+static int tap_collect_threaded(struct test *tests, size_t n_tests, int resfd,
+                                struct tap_reporter *reporters,
+                                const struct tap_output_opts *output_opts,
+                                struct test_run *runs) {
+    while (true) {
+        struct tap_thread_record record;
+        struct test_run *run;
+        char *out;
+        int err;
+
+        /* Anything unreported when the engine goes away gets forked */
+        if (tap_read_full(resfd, &record, sizeof(record)) != 0) {
+            return 0;
+        }
+        if (record.id == 0 || record.id > n_tests) {
+            return EPROTO;
+        }
+        out = malloc(record.out_len + 1);
+        if (!out) {
+            return errno;
+        }
+        if (tap_read_full(resfd, out, record.out_len) != 0) {
+            free(out);
+            return 0;
+        }
+        out[record.out_len] = '\0';
+
+        run = &runs[record.id - 1];
+        *run = (struct test_run){
+            .test = tests[record.id - 1],
+            .reporters = reporters,
+            .output_opts = output_opts,
+            .outfd = -1,
+            .pid = -1,
+            .exitstatus = record.retval,
+            .duration = record.duration,
+            .n_bytes_read = record.out_len,
+            .timed = true,
+            .test_wall = record.duration,
+            .test_cpu = record.cpu,
+            .inprocess = true,
+        };
+        err = tap_process_testrun_buffer(run, out, record.out_len);
+        free(out);
+        if (err != 0) {
+            return err;
+        }
+        run->exited = true;
+        if (tap_cmd_is_bailed(run->cmd)) {
+            return 0;
+        }
+    }
+}
+
+int tap_run_threaded(struct test *tests, size_t n_tests,
+                     unsigned int n_threads, const struct tap_limits *limits,
+                     struct tap_reporter *reporters,
+                     const struct tap_output_opts *output_opts,
+                     struct test_run *runs) {
+    int pipefd[2] = {-1, -1};
+    pid_t engine;
+    int err;
+
+    err = tap_pipe_setup(pipefd);
+    if (err != 0) {
+        tap_print_internal_error(err, NULL, "failed to create pipe");
+        return err;
+    }
+
+    /* Flush stdout and stderr to avoid the engine duplicating output */
+    tap_out_flush();
+    fflush(NULL);
+    engine = fork();
+    if (engine == 0) {
+        close(pipefd[TAP_PIPE_RX]);
+        /* Writes straight to the stdout fd must not corrupt the TAP stream */
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+        tap_limits_apply(limits);
+        tap_engine_main(tests, n_tests, n_threads, pipefd[TAP_PIPE_TX]);
+        /* Engine should have already exited */
+        _exit(EINVAL);
+    }
+    if (engine == -1) {
+        err = errno;
+        close(pipefd[TAP_PIPE_RX]);
+        close(pipefd[TAP_PIPE_TX]);
+        tap_print_internal_error(err, NULL, "failed to fork engine process");
+        return err;
+    }
+    close(pipefd[TAP_PIPE_TX]);
+
+    err = tap_collect_threaded(tests, n_tests, pipefd[TAP_PIPE_RX], reporters,
+                               output_opts, runs);
+    close(pipefd[TAP_PIPE_RX]);
+
+    /* A no-op if the engine exited, otherwise it stopped being useful */
+    kill(engine, SIGKILL);
+    waitpid(engine, NULL, 0);
+    return err;
+}
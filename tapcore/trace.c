@@ -0,0 +1,188 @@
+/**
+ * @file trace.c
+ *
+ * Writes the schedule of a test run in the Chrome trace event format, as read
+ * by Perfetto and chrome://tracing. Track 0 is the scheduler, each runner slot
+ * gets the track after it. Tests run by the threaded engine overlap, so are
+ * written as async events on a track of their own. Tests that ran in neither,
+ * such as ones replayed from a journal, are only reported on the scheduler's.
+ */
+#define _GNU_SOURCE /* program_invocation_short_name */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <tapio.h>
+#include <tapstruct.h>
+#include <taptest.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "internal.h"
+
+#define TAP_TRACE_SCHEDULER_TID 0
+#define TAP_TRACE_ENGINE_TID 1000
+
+struct tap_trace {
+    FILE *fp;
+    struct timespec start;
+    long pid;
+};
+
+/* Microseconds since the trace started, as the format expects */
+static double tap_trace_us(struct tap_trace *trace, struct timespec *ts) {
+    struct tap_duration d = {.t0 = trace->start, .t1 = *ts};
+
+    return tap_duration_to_double(&d) * 1e6;
+}
+
+static void tap_trace_thread_name(struct tap_trace *trace, int tid,
+                                  const char *name) {
+    fprintf(trace->fp,
+            ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%d"
+            ",\"args\":{\"name\":\"%s\"}}",
+            trace->pid, tid, name);
+}
+
+int tap_trace_ctor(const char *path, size_t n_slots,
+                   struct tap_trace **d_trace) {
+    struct tap_trace *trace;
+
+    trace = calloc(1, sizeof(*trace));
+    if (!trace) {
+        return errno;
+    }
+    trace->fp = fopen(path, "w");
+    if (!trace->fp) {
+        int err = errno;
+
+        free(trace);
+        return err;
+    }
+    trace->pid = getpid();
+    clock_gettime(CLOCK_MONOTONIC, &trace->start);
+
+    fprintf(trace->fp,
+            "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":0"
+            ",\"args\":{\"name\":",
+            trace->pid);
+    tap_json_string(trace->fp, program_invocation_short_name);
+    fputs("}}", trace->fp);
+    tap_trace_thread_name(trace, TAP_TRACE_SCHEDULER_TID, "scheduler");
+    for (size_t slot = 0; slot < n_slots; slot++) {
+        char name[32];
+
+        snprintf(name, sizeof(name), "slot %zu", slot);
+        tap_trace_thread_name(trace, slot + 1, name);
+    }
+    tap_trace_thread_name(trace, TAP_TRACE_ENGINE_TID, "threaded engine");
+
+    *d_trace = trace;
+    return 0;
+}
+
+static void tap_trace_event_start(struct tap_trace *trace, const char *name,
+                                  size_t id, const char *ph, int tid,
+                                  struct timespec *ts) {
+    fprintf(trace->fp,
+            ",\n{\"name\":\"%s\",\"cat\":\"test\",\"ph\":\"%s\",\"pid\":%ld"
+            ",\"tid\":%d,\"ts\":%.3f",
+            name, ph, trace->pid, tid, tap_trace_us(trace, ts));
+    if (id != 0) {
+        fprintf(trace->fp, ",\"args\":{\"test\":%zu}", id);
+    }
+}
+
+static void tap_trace_complete(struct tap_trace *trace, const char *name,
+                               size_t id, int tid, struct timespec *t0,
+                               struct timespec *t1) {
+    struct tap_duration d = {.t0 = *t0, .t1 = *t1};
+
+    tap_trace_event_start(trace, name, id, "X", tid, t0);
+    fprintf(trace->fp, ",\"dur\":%.3f}", tap_duration_to_double(&d) * 1e6);
+}
+
+static void tap_trace_instant(struct tap_trace *trace, const char *name,
+                              size_t id, int tid, struct timespec *ts) {
+    tap_trace_event_start(trace, name, id, "i", tid, ts);
+    fputs(",\"s\":\"t\"}", trace->fp);
+}
+
+void tap_trace_wakeup(struct tap_trace *trace, int n_ready) {
+    struct timespec now;
+
+    if (!trace) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    fprintf(trace->fp,
+            ",\n{\"name\":\"wakeup\",\"cat\":\"scheduler\",\"ph\":\"i\""
+            ",\"s\":\"t\",\"pid\":%ld,\"tid\":%d,\"ts\":%.3f"
+            ",\"args\":{\"ready\":%d}}",
+            trace->pid, TAP_TRACE_SCHEDULER_TID, tap_trace_us(trace, &now),
+            n_ready);
+}
+
+void tap_trace_testrun(struct tap_trace *trace, struct test_run *run) {
+    size_t id = run->test.id;
+    int tid = run->slot;
+
+    if (!trace) {
+        return;
+    }
+    tap_trace_complete(trace, "fork", id, tid, &run->duration.t0,
+                       &run->forked);
+    tap_trace_complete(trace, "run", id, tid, &run->forked,
+                       &run->duration.t1);
+    if (run->timed) {
+        tap_trace_complete(trace, "test", id, tid, &run->test_wall.t0,
+                           &run->test_wall.t1);
+    }
+    tap_trace_instant(trace, "exit detected", id, tid, &run->duration.t1);
+}
+
+void tap_trace_threaded(struct tap_trace *trace, struct test_run *run) {
+    size_t id = run->test.id;
+
+    if (!trace) {
+        return;
+    }
+    /* Async events pair up by id, so they may overlap on the one track */
+    tap_trace_event_start(trace, "run", id, "b", TAP_TRACE_ENGINE_TID,
+                          &run->duration.t0);
+    fprintf(trace->fp, ",\"id\":%zu}", id);
+    tap_trace_event_start(trace, "run", id, "e", TAP_TRACE_ENGINE_TID,
+                          &run->duration.t1);
+    fprintf(trace->fp, ",\"id\":%zu}", id);
+}
+
+void tap_trace_reported(struct tap_trace *trace, struct test_run *run) {
+    struct timespec now;
+    int tid = run->inprocess ? TAP_TRACE_ENGINE_TID : run->slot;
+
+    if (!trace) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    /* On the track the test ran on, the scheduler's if it ran on none */
+    tap_trace_instant(trace, "reported", run->test.id, tid, &now);
+}
+
+int tap_trace_dtor(struct tap_trace *trace) {
+    int err = 0;
+
+    if (!trace) {
+        return 0;
+    }
+    fputs("\n]}\n", trace->fp);
+    if (ferror(trace->fp)) {
+        err = EIO;
+    }
+    if (fclose(trace->fp) != 0 && err == 0) {
+        err = errno;
+    }
+    free(trace);
+    return err;
+}
@@ -0,0 +1,146 @@
+/**
+ * @file tap_jsonl.c
+ *
+ * Reporter writing one JSON object per line for every test run event.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <tapio.h>
+#include <tapstruct.h>
+#include <taptest.h>
+#include <taputil.h>
+
+#include "config.h"
+
+void tap_json_string(FILE *fp, const char *str) {
+    if (!str) {
+        fputs("null", fp);
+        return;
+    }
+
+    fputc('"', fp);
+    for (; *str; str++) {
+        unsigned char c = *str;
+
+        if (c == '"' || c == '\\') {
+            fprintf(fp, "\\%c", c);
+        } else if (c == '\n') {
+            fputs("\\n", fp);
+        } else if (c == '\t') {
+            fputs("\\t", fp);
+        } else if (c < 0x20) {
+            fprintf(fp, "\\u%04x", c);
+        } else {
+            fputc(c, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+static int tap_jsonl_end(FILE *fp) {
+    fputs("}\n", fp);
+    return ferror(fp) ? EIO : 0;
+}
+
+/* Write ,"name":seconds or ,"name":null if d is unknown */
+static void tap_jsonl_duration(FILE *fp, const char *name,
+                               struct tap_duration *d) {
+    if (d) {
+        fprintf(fp, ",\"%s\":%.9f", name, tap_duration_to_double(d));
+    } else {
+        fprintf(fp, ",\"%s\":null", name);
+    }
+}
+
+static int tap_jsonl_plan(void *priv, size_t n_tests) {
+    FILE *fp = priv;
+
+    fprintf(fp, "{\"event\":\"plan\",\"tests\":%zu", n_tests);
+    return tap_jsonl_end(fp);
+}
+
+static int tap_jsonl_testpoint(void *priv, struct tap_testpoint *point) {
+    struct test *test = point->test;
+    FILE *fp = priv;
+
+    fprintf(fp, "{\"event\":\"testpoint\",\"test\":%zu,\"ok\":%s", test->id,
+            point->success ? "true" : "false");
+    fputs(",\"description\":", fp);
+    tap_json_string(fp, test->description);
+    fputs(",\"tags\":", fp);
+    tap_json_string(fp, test->tags);
+    fprintf(fp, ",\"duration\":%.9f", tap_duration_to_double(point->duration));
+    tap_jsonl_duration(fp, "cpu", point->cpu);
+    tap_jsonl_duration(fp, "overhead", point->overhead);
+    fputs(",\"directive\":", fp);
+    tap_json_string(fp, point->directive);
+    fputs(",\"subtests\":[", fp);
+    for (tap_cmd_t *cmd = point->subtests; cmd; cmd = cmd->next) {
+        fprintf(fp, "{\"ok\":%s,\"description\":",
+                cmd->type == tap_cmd_type_ok ? "true" : "false");
+        tap_json_string(fp, cmd->str);
+        fputs(cmd->next ? "}," : "}", fp);
+    }
+    fputc(']', fp);
+    return tap_jsonl_end(fp);
+}
+
+static int tap_jsonl_comment(void *priv, struct test *test, const char *line) {
+    FILE *fp = priv;
+
+    fputs("{\"event\":\"comment\",\"test\":", fp);
+    if (test) {
+        fprintf(fp, "%zu", test->id);
+    } else {
+        fputs("null", fp);
+    }
+    fputs(",\"line\":", fp);
+    tap_json_string(fp, line);
+    return tap_jsonl_end(fp);
+}
+
+static int tap_jsonl_bailout(void *priv, const char *reason) {
+    FILE *fp = priv;
+
+    fputs("{\"event\":\"bailout\",\"reason\":", fp);
+    tap_json_string(fp, reason);
+    return tap_jsonl_end(fp);
+}
+
+static int tap_jsonl_finish(void *priv) {
+    FILE *fp = priv;
+
+    return fflush(fp) == 0 ? 0 : errno;
+}
+
+static void tap_jsonl_dtor(void *priv) {
+    FILE *fp = priv;
+
+    fclose(fp);
+}
+
+static const struct tap_reporter_ops tap_jsonl_ops = {
+    .plan = tap_jsonl_plan,
+    .testpoint = tap_jsonl_testpoint,
+    .comment = tap_jsonl_comment,
+    .bailout = tap_jsonl_bailout,
+    .finish = tap_jsonl_finish,
+    .dtor = tap_jsonl_dtor,
+};
+
+int tap_reporter_jsonl_ctor(const char *path,
+                            struct tap_reporter **d_reporter) {
+    FILE *fp;
+    int err;
+
+    fp = fopen(path, "w");
+    if (!fp) {
+        return errno;
+    }
+    err = tap_reporter_ctor(&tap_jsonl_ops, fp, d_reporter);
+    if (err != 0) {
+        fclose(fp);
+    }
+    return err;
+}
@@ -0,0 +1,332 @@
+/**
+ * @file tap_junit.c
+ *
+ * Reporter writing a JUnit XML document. The testsuite element leads with the
+ * counts of the whole run, so testcases are spooled to a temporary file and
+ * copied across on finish.
+ */
+#define _GNU_SOURCE /* program_invocation_short_name */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tapio.h>
+#include <tapstruct.h>
+#include <taptest.h>
+#include <taputil.h>
+
+#include "config.h"
+
+struct tap_junit {
+    FILE *fp;
+    /* testcase elements in the order they were reported */
+    FILE *testcases;
+    /* The testcase element being formatted */
+    tap_string_t *testcase;
+    /* Comments of each test not reported yet, indexed by test id - 1 */
+    tap_string_t **output;
+    size_t n_output;
+    /* Comments and bail outs not belonging to a test */
+    tap_string_t *suite_output;
+    size_t n_tests;
+    size_t n_failures;
+    size_t n_skipped;
+};
+
+static int tap_junit_escape(tap_string_t *tstr, const char *str) {
+    int err = 0;
+
+    for (; *str && err == 0; str++) {
+        unsigned char c = *str;
+        char raw[2] = {c, '\0'};
+
+        switch (c) {
+            case '&':
+                err = tap_string_concat(tstr, "&amp;");
+                break;
+            case '<':
+                err = tap_string_concat(tstr, "&lt;");
+                break;
+            case '>':
+                err = tap_string_concat(tstr, "&gt;");
+                break;
+            case '"':
+                err = tap_string_concat(tstr, "&quot;");
+                break;
+            case '\'':
+                err = tap_string_concat(tstr, "&apos;");
+                break;
+            default:
+                /* Control characters other than whitespace are not XML */
+                if (c < 0x20 && c != '\t' && c != '\n') {
+                    break;
+                }
+                err = tap_string_concat(tstr, raw);
+                break;
+        }
+    }
+    return err;
+}
+
+static int tap_junit_test_output(struct tap_junit *junit, struct test *test,
+                                 tap_string_t **d_output) {
+    if (test->id > junit->n_output) {
+        tap_string_t **output;
+        size_t n_output;
+
+        n_output = junit->n_output ? junit->n_output * 2 : 64;
+        if (n_output < test->id) {
+            n_output = test->id;
+        }
+        output = realloc(junit->output, n_output * sizeof(*output));
+        if (!output) {
+            return errno;
+        }
+        memset(output + junit->n_output, 0,
+               (n_output - junit->n_output) * sizeof(*output));
+        junit->output = output;
+        junit->n_output = n_output;
+    }
+
+    if (!junit->output[test->id - 1]) {
+        int err;
+
+        err = tap_string_ctor(&junit->output[test->id - 1], NULL);
+        if (err != 0) {
+            return err;
+        }
+    }
+    *d_output = junit->output[test->id - 1];
+    return 0;
+}
+
+static int tap_junit_testcase(struct tap_junit *junit,
+                              struct tap_testpoint *point) {
+    tap_string_t *tstr = junit->testcase;
+    struct test *test = point->test;
+    tap_string_t *output = NULL;
+    int err;
+
+    tap_string_clear(tstr);
+    err = tap_string_concat(tstr, "    <testcase classname=\"");
+    if (err == 0) {
+        err = tap_junit_escape(tstr, program_invocation_short_name);
+    }
+    if (err == 0 && test->description) {
+        err = tap_string_concat(tstr, "\" name=\"");
+        if (err == 0) {
+            err = tap_junit_escape(tstr, test->description);
+        }
+    } else if (err == 0) {
+        err = tap_string_concat_printf(tstr, "\" name=\"test %zu", test->id);
+    }
+    if (err == 0) {
+        err = tap_string_concat_printf(
+            tstr, "\" time=\"%.6f\">\n",
+            tap_duration_to_double(point->duration));
+    }
+    if (err != 0) {
+        return err;
+    }
+
+    if (point->directive) {
+        /* TODO failures are expected, report both directives as skipped */
+        junit->n_skipped++;
+        err = tap_string_concat(tstr, "      <skipped message=\"");
+        if (err == 0) {
+            err = tap_junit_escape(tstr, point->directive);
+        }
+        if (err == 0) {
+            err = tap_string_concat(tstr, "\"/>\n");
+        }
+    } else if (!point->success) {
+        junit->n_failures++;
+        err = tap_string_concat(tstr, "      <failure message=\"not ok\">");
+        for (tap_cmd_t *cmd = point->subtests; cmd && err == 0;
+             cmd = cmd->next) {
+            if (cmd->type != tap_cmd_type_not_ok) {
+                continue;
+            }
+            err = tap_string_concat(tstr, "not ok - ");
+            if (err == 0) {
+                err = tap_junit_escape(tstr, cmd->str);
+            }
+            if (err == 0) {
+                err = tap_string_concat(tstr, "\n");
+            }
+        }
+        if (err == 0) {
+            err = tap_string_concat(tstr, "</failure>\n");
+        }
+    }
+    if (err != 0) {
+        return err;
+    }
+
+    /* The output is not needed once it is part of the testcase */
+    if (test->id <= junit->n_output) {
+        output = junit->output[test->id - 1];
+        junit->output[test->id - 1] = NULL;
+    }
+    if (output) {
+        err = tap_string_concat(tstr, "      <system-out>");
+        if (err == 0) {
+            err = tap_string_concat(tstr, tap_string_borrow(output));
+        }
+        if (err == 0) {
+            err = tap_string_concat(tstr, "</system-out>\n");
+        }
+        tap_string_dtor(output);
+        if (err != 0) {
+            return err;
+        }
+    }
+
+    err = tap_string_concat(tstr, "    </testcase>\n");
+    if (err != 0) {
+        return err;
+    }
+    fputs(tap_string_borrow(tstr), junit->testcases);
+    return ferror(junit->testcases) ? EIO : 0;
+}
+
+static int tap_junit_testpoint(void *priv, struct tap_testpoint *point) {
+    struct tap_junit *junit = priv;
+
+    junit->n_tests++;
+    return tap_junit_testcase(junit, point);
+}
+
+static int tap_junit_comment(void *priv, struct test *test, const char *line) {
+    struct tap_junit *junit = priv;
+    tap_string_t *output = NULL;
+    int err;
+
+    if (test) {
+        err = tap_junit_test_output(junit, test, &output);
+        if (err != 0) {
+            return err;
+        }
+    } else {
+        output = junit->suite_output;
+    }
+
+    err = tap_junit_escape(output, line);
+    if (err != 0) {
+        return err;
+    }
+    return tap_string_concat(output, "\n");
+}
+
+static int tap_junit_bailout(void *priv, const char *reason) {
+    struct tap_junit *junit = priv;
+    int err;
+
+    err = tap_string_concat(junit->suite_output, TAP_BAILOUT " ");
+    if (err != 0) {
+        return err;
+    }
+    err = tap_junit_escape(junit->suite_output, reason);
+    if (err != 0) {
+        return err;
+    }
+    return tap_string_concat(junit->suite_output, "\n");
+}
+
+static int tap_junit_finish(void *priv) {
+    struct tap_junit *junit = priv;
+    const char *suite_output;
+    FILE *fp = junit->fp;
+    char buf[BUFSIZ];
+    size_t n_read;
+
+    suite_output = tap_string_borrow(junit->suite_output);
+
+    fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    fprintf(fp, "<testsuites>\n");
+    fprintf(fp,
+            "  <testsuite name=\"%s\" tests=\"%zu\" failures=\"%zu\""
+            " errors=\"0\" skipped=\"%zu\">\n",
+            program_invocation_short_name, junit->n_tests, junit->n_failures,
+            junit->n_skipped);
+    rewind(junit->testcases);
+    while ((n_read = fread(buf, 1, sizeof(buf), junit->testcases)) > 0) {
+        fwrite(buf, 1, n_read, fp);
+    }
+    if (ferror(junit->testcases)) {
+        return EIO;
+    }
+    if (suite_output && *suite_output) {
+        fprintf(fp, "    <system-err>%s</system-err>\n", suite_output);
+    }
+    fprintf(fp, "  </testsuite>\n");
+    fprintf(fp, "</testsuites>\n");
+    return fflush(fp) == 0 ? 0 : errno;
+}
+
+static void tap_junit_dtor(void *priv) {
+    struct tap_junit *junit = priv;
+
+    for (size_t idx = 0; idx < junit->n_output; idx++) {
+        tap_string_dtor(junit->output[idx]);
+    }
+    free(junit->output);
+    tap_string_dtor(junit->testcase);
+    tap_string_dtor(junit->suite_output);
+    if (junit->testcases) {
+        fclose(junit->testcases);
+    }
+    if (junit->fp) {
+        fclose(junit->fp);
+    }
+    free(junit);
+}
+
+static const struct tap_reporter_ops tap_junit_ops = {
+    .testpoint = tap_junit_testpoint,
+    .comment = tap_junit_comment,
+    .bailout = tap_junit_bailout,
+    .finish = tap_junit_finish,
+    .dtor = tap_junit_dtor,
+};
+
+int tap_reporter_junit_ctor(const char *path,
+                            struct tap_reporter **d_reporter) {
+    struct tap_junit *junit;
+    int err;
+
+    junit = calloc(1, sizeof(*junit));
+    if (!junit) {
+        return errno;
+    }
+
+    err = tap_string_ctor(&junit->testcase, NULL);
+    if (err == 0) {
+        err = tap_string_ctor(&junit->suite_output, NULL);
+    }
+    if (err != 0) {
+        goto failed;
+    }
+
+    junit->testcases = tmpfile();
+    if (!junit->testcases) {
+        err = errno;
+        goto failed;
+    }
+
+    junit->fp = fopen(path, "w");
+    if (!junit->fp) {
+        err = errno;
+        goto failed;
+    }
+
+    err = tap_reporter_ctor(&tap_junit_ops, junit, d_reporter);
+    if (err != 0) {
+        goto failed;
+    }
+    return 0;
+
+failed:
+    tap_junit_dtor(junit);
+    return err;
+}
@@ -0,0 +1,604 @@
+/**
+ * @file tap_out.c
+ *
+ * Runner-wide stdout buffer. Output is formatted straight into reusable
+ * chunks that are written with a single writev() per flush.
+ *
+ * With a writer thread, a flush instead hands the filled chunks over through
+ * a single-producer ring and the runner carries on formatting into spare
+ * chunks. The writer hands chunks back through a second ring once they are
+ * written. A partly filled chunk is only handed over while another chunk is
+ * left to fill, so the runner waits on a slow stdout once every chunk it may
+ * allocate is filled, not after as many small flushes.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdio_ext.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <tapio.h>
+#include <taputil.h>
+#include <unistd.h>
+
+#include "config.h"
+
+#define TAP_OUT_CHUNK_SIZE (64 * 1024)
+#define TAP_OUT_MAX_CHUNKS 16
+
+struct tap_out_chunk {
+    size_t len;
+    char data[TAP_OUT_CHUNK_SIZE];
+};
+
+/* Chunks passed one way between the runner and the writer. Each index is only
+ * moved by one side, the semaphore counts the chunks in between and orders
+ * their writes with their reads */
+struct tap_out_ring {
+    struct tap_out_chunk **slots;
+    size_t head;
+    size_t tail;
+    sem_t n_used;
+};
+
+struct tap_out_writer {
+    pthread_t thread;
+    bool running;
+    /* Filled chunks, to be written. A NULL chunk stops the writer */
+    struct tap_out_ring queued;
+    /* Written chunks, to be filled again */
+    struct tap_out_ring spare;
+    /* Either ring holds every chunk, and the stop marker */
+    size_t n_slots;
+    size_t max_chunks;
+    size_t n_chunks;
+    /* Chunks handed to the writer and not taken back yet */
+    size_t n_outstanding;
+    /* First write error of the writer, reported by the next flush */
+    int err;
+};
+
+struct tap_out {
+    struct tap_out_chunk *chunks[TAP_OUT_MAX_CHUNKS];
+    /* Index of the chunk currently being filled */
+    size_t cur;
+    int fd;
+    struct tap_out_writer writer;
+};
+
+static struct tap_out out = {.fd = STDOUT_FILENO};
+
+static void tap_out_ring_push(struct tap_out_ring *ring, size_t n_slots,
+                              struct tap_out_chunk *chunk) {
+    ring->slots[ring->head++ % n_slots] = chunk;
+    sem_post(&ring->n_used);
+}
+
+static struct tap_out_chunk *tap_out_ring_pop(struct tap_out_ring *ring,
+                                              size_t n_slots) {
+    return ring->slots[ring->tail++ % n_slots];
+}
+
+/* Wait for a chunk, unless block is unset. Returns false if there was none */
+static bool tap_out_ring_wait(struct tap_out_ring *ring, bool block) {
+    int res;
+
+    do {
+        res = block ? sem_wait(&ring->n_used) : sem_trywait(&ring->n_used);
+    } while (res == -1 && errno == EINTR);
+    return res == 0;
+}
+
+static int tap_out_writev(struct iovec *iov, int n_iov) {
+    while (n_iov > 0) {
+        ssize_t n_written;
+
+        n_written = writev(out.fd, iov, n_iov);
+        if (n_written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+
+        /* Step over everything that was written */
+        for (; n_iov > 0 && (size_t)n_written >= iov->iov_len; iov++, n_iov--) {
+            n_written -= iov->iov_len;
+        }
+        if (n_iov > 0) {
+            iov->iov_base = (char *)iov->iov_base + n_written;
+            iov->iov_len -= n_written;
+        }
+    }
+    return 0;
+}
+
+static void *tap_out_writer_main(void *arg) {
+    struct tap_out_writer *writer = arg;
+    struct tap_out_chunk *chunks[TAP_OUT_MAX_CHUNKS];
+    struct iovec iov[TAP_OUT_MAX_CHUNKS];
+    bool stopping = false;
+
+    while (!stopping) {
+        size_t n_chunks = 0;
+        int err;
+
+        /* Write out everything queued by now in one go */
+        tap_out_ring_wait(&writer->queued, true);
+        do {
+            chunks[n_chunks] = tap_out_ring_pop(&writer->queued,
+                                                writer->n_slots);
+            if (!chunks[n_chunks]) {
+                stopping = true;
+                break;
+            }
+            iov[n_chunks] = (struct iovec){
+                .iov_base = chunks[n_chunks]->data,
+                .iov_len = chunks[n_chunks]->len,
+            };
+            n_chunks++;
+        } while (n_chunks < TAP_OUT_MAX_CHUNKS &&
+                 tap_out_ring_wait(&writer->queued, false));
+
+        /* Output after a failed write would only be garbled */
+        err = __atomic_load_n(&writer->err, __ATOMIC_RELAXED);
+        if (err == 0 && n_chunks > 0) {
+            err = tap_out_writev(iov, n_chunks);
+            __atomic_store_n(&writer->err, err, __ATOMIC_RELAXED);
+        }
+        for (size_t idx = 0; idx < n_chunks; idx++) {
+            tap_out_ring_push(&writer->spare, writer->n_slots, chunks[idx]);
+        }
+    }
+    return NULL;
+}
+
+/* Take back a chunk the writer is done with, waiting for one if block */
+static struct tap_out_chunk *tap_out_reclaim(bool block) {
+    struct tap_out_writer *writer = &out.writer;
+
+    if (writer->n_outstanding == 0 ||
+        !tap_out_ring_wait(&writer->spare, block)) {
+        return NULL;
+    }
+    writer->n_outstanding--;
+    return tap_out_ring_pop(&writer->spare, writer->n_slots);
+}
+
+/* Wait until everything handed to the writer has been written */
+static void tap_out_drain(void) {
+    while (out.writer.n_outstanding > 0) {
+        free(tap_out_reclaim(true));
+        out.writer.n_chunks--;
+    }
+}
+
+/* Whether the writer has another chunk to write, besides the one being filled
+ * by the runner */
+static bool tap_out_writer_has_room(void) {
+    struct tap_out_writer *writer = &out.writer;
+    int n_written;
+
+    sem_getvalue(&writer->spare.n_used, &n_written);
+    return writer->n_outstanding - (size_t)n_written + 1 < writer->max_chunks;
+}
+
+/* Queue the filled chunks for the writer, filling spare ones meanwhile. The
+ * chunk being filled is kept back if partial, unless queueing it still leaves
+ * a chunk to fill */
+static int tap_out_hand_over(bool partial) {
+    struct tap_out_writer *writer = &out.writer;
+    struct tap_out_chunk *tail = NULL;
+    int err;
+
+    /* Anything the program printed through stdio must not overtake the
+     * chunks already queued */
+    if (__fpending(stdout) > 0) {
+        tap_out_drain();
+        fflush(stdout);
+        partial = true;
+    }
+    if (!partial && out.cur < TAP_OUT_MAX_CHUNKS && out.chunks[out.cur] &&
+        !tap_out_writer_has_room()) {
+        tail = out.chunks[out.cur];
+        out.chunks[out.cur] = NULL;
+    }
+    for (size_t idx = 0; idx <= out.cur && idx < TAP_OUT_MAX_CHUNKS; idx++) {
+        struct tap_out_chunk *chunk = out.chunks[idx];
+
+        if (!chunk || chunk->len == 0) {
+            continue;
+        }
+        tap_out_ring_push(&writer->queued, writer->n_slots, chunk);
+        writer->n_outstanding++;
+        out.chunks[idx] = NULL;
+    }
+    out.cur = 0;
+    if (tail) {
+        out.chunks[0] = tail;
+    }
+
+    err = __atomic_load_n(&writer->err, __ATOMIC_RELAXED);
+    return err;
+}
+
+/* A forked child has no writer, and must not wait on one. Output held back
+ * from the writer is the parent's to write */
+static void tap_out_atfork_child(void) {
+    if (out.writer.running && out.chunks[out.cur]) {
+        out.chunks[out.cur]->len = 0;
+    }
+    out.writer.running = false;
+}
+
+int tap_out_start_writer(size_t size) {
+    static bool atfork_registered = false;
+    struct tap_out_writer *writer = &out.writer;
+    int err;
+
+    if (writer->running) {
+        return EBUSY;
+    }
+    err = tap_out_flush();
+    if (err != 0) {
+        return err;
+    }
+    if (!atfork_registered) {
+        err = pthread_atfork(NULL, NULL, tap_out_atfork_child);
+        if (err != 0) {
+            return err;
+        }
+        atfork_registered = true;
+    }
+
+    /* One chunk being filled and one being written, at the very least */
+    *writer = (struct tap_out_writer){0};
+    writer->max_chunks = (size + TAP_OUT_CHUNK_SIZE - 1) / TAP_OUT_CHUNK_SIZE;
+    if (writer->max_chunks < 2) {
+        writer->max_chunks = 2;
+    }
+    /* The chunks being filled are allocated by tap_out_reserve() already */
+    for (size_t idx = 0; idx < TAP_OUT_MAX_CHUNKS; idx++) {
+        writer->n_chunks += !!out.chunks[idx];
+    }
+    if (writer->max_chunks < writer->n_chunks) {
+        writer->max_chunks = writer->n_chunks;
+    }
+    writer->n_slots = writer->max_chunks + 1;
+    writer->queued.slots = calloc(writer->n_slots, sizeof(void *));
+    writer->spare.slots = calloc(writer->n_slots, sizeof(void *));
+    if (!writer->queued.slots || !writer->spare.slots) {
+        err = ENOMEM;
+        goto failed;
+    }
+    sem_init(&writer->queued.n_used, 0, 0);
+    sem_init(&writer->spare.n_used, 0, 0);
+
+    err = pthread_create(&writer->thread, NULL, tap_out_writer_main, writer);
+    if (err != 0) {
+        sem_destroy(&writer->queued.n_used);
+        sem_destroy(&writer->spare.n_used);
+        goto failed;
+    }
+    writer->running = true;
+    return 0;
+
+failed:
+    free(writer->queued.slots);
+    free(writer->spare.slots);
+    *writer = (struct tap_out_writer){0};
+    return err;
+}
+
+int tap_out_stop_writer(void) {
+    struct tap_out_writer *writer = &out.writer;
+    int err;
+
+    if (!writer->running) {
+        return 0;
+    }
+    err = tap_out_hand_over(true);
+    tap_out_ring_push(&writer->queued, writer->n_slots, NULL);
+    pthread_join(writer->thread, NULL);
+    tap_out_drain();
+    if (err == 0) {
+        err = writer->err;
+    }
+
+    sem_destroy(&writer->queued.n_used);
+    sem_destroy(&writer->spare.n_used);
+    free(writer->queued.slots);
+    free(writer->spare.slots);
+    *writer = (struct tap_out_writer){0};
+    return err;
+}
+
+int tap_out_set_fd(int fd) {
+    int err;
+
+    if (out.writer.running) {
+        err = tap_out_hand_over(true);
+        tap_out_drain();
+    } else {
+        err = tap_out_flush();
+    }
+    out.fd = fd;
+    return err;
+}
+
+int tap_out_flush(void) {
+    struct iovec iov[TAP_OUT_MAX_CHUNKS];
+    int n_iov = 0;
+    int err;
+
+    if (out.writer.running) {
+        return tap_out_hand_over(false);
+    }
+    for (size_t idx = 0; idx <= out.cur && idx < TAP_OUT_MAX_CHUNKS; idx++) {
+        struct tap_out_chunk *chunk = out.chunks[idx];
+
+        if (!chunk || chunk->len == 0) {
+            continue;
+        }
+        iov[n_iov++] = (struct iovec){
+            .iov_base = chunk->data,
+            .iov_len = chunk->len,
+        };
+        chunk->len = 0;
+    }
+    out.cur = 0;
+    if (n_iov == 0) {
+        return 0;
+    }
+
+    /* Anything the program printed through stdio comes first */
+    fflush(stdout);
+    err = tap_out_writev(iov, n_iov);
+    return err;
+}
+
+static struct tap_out_chunk *tap_out_new_chunk(void) {
+    struct tap_out_writer *writer = &out.writer;
+    struct tap_out_chunk *chunk;
+
+    if (!writer->running) {
+        return malloc(sizeof(struct tap_out_chunk));
+    }
+    /* Only wait on the writer once the buffer is used up */
+    chunk = tap_out_reclaim(false);
+    if (!chunk && writer->n_chunks < writer->max_chunks) {
+        chunk = malloc(sizeof(*chunk));
+        writer->n_chunks += !!chunk;
+    }
+    if (!chunk) {
+        chunk = tap_out_reclaim(true);
+    }
+    if (!chunk) {
+        errno = ENOMEM;
+    }
+    return chunk;
+}
+
+/* Make sure the current chunk has at least n bytes free, n <= chunk size */
+static int tap_out_reserve(size_t n, char **d_pos) {
+    struct tap_out_chunk *chunk = out.chunks[out.cur];
+
+    if (chunk && TAP_OUT_CHUNK_SIZE - chunk->len >= n) {
+        *d_pos = chunk->data + chunk->len;
+        return 0;
+    }
+
+    if (chunk && out.writer.running) {
+        /* Full chunks go straight to the writer */
+        int err;
+
+        err = tap_out_hand_over(true);
+        if (err != 0) {
+            return err;
+        }
+    } else if (chunk) {
+        out.cur++;
+    }
+    if (out.cur == TAP_OUT_MAX_CHUNKS) {
+        int err;
+
+        err = tap_out_flush();
+        if (err != 0) {
+            return err;
+        }
+    }
+
+    chunk = out.chunks[out.cur];
+    if (!chunk) {
+        chunk = tap_out_new_chunk();
+        if (!chunk) {
+            return errno;
+        }
+        chunk->len = 0;
+        out.chunks[out.cur] = chunk;
+    }
+    *d_pos = chunk->data + chunk->len;
+    return 0;
+}
+
+static void tap_out_commit(size_t n) { out.chunks[out.cur]->len += n; }
+
+int tap_out_write(const char *data, size_t len) {
+    while (len > 0) {
+        size_t n_copy;
+        char *pos;
+        int err;
+
+        n_copy = len < TAP_OUT_CHUNK_SIZE ? len : TAP_OUT_CHUNK_SIZE;
+        err = tap_out_reserve(n_copy, &pos);
+        if (err != 0) {
+            return err;
+        }
+        memcpy(pos, data, n_copy);
+        tap_out_commit(n_copy);
+        data += n_copy;
+        len -= n_copy;
+    }
+    return 0;
+}
+
+int tap_out_str(const char *str) { return tap_out_write(str, strlen(str)); }
+
+int tap_out_span(const char *str) {
+    return tap_out_write(str, strcspn(str, "\n"));
+}
+
+int tap_out_char(char c) { return tap_out_write(&c, 1); }
+
+int tap_out_prefixed_line(const char *prefix, size_t prefix_len,
+                          const char *line, size_t line_len) {
+    size_t total_len = prefix_len + line_len + 1;
+    char *pos;
+    int err;
+
+    if (total_len > TAP_OUT_CHUNK_SIZE) {
+        err = tap_out_write(prefix, prefix_len);
+        if (err == 0) {
+            err = tap_out_write(line, line_len);
+        }
+        if (err == 0) {
+            err = tap_out_char('\n');
+        }
+        return err;
+    }
+
+    /* Copy the whole line into the chunk in one go */
+    err = tap_out_reserve(total_len, &pos);
+    if (err != 0) {
+        return err;
+    }
+    memcpy(pos, prefix, prefix_len);
+    memcpy(pos + prefix_len, line, line_len);
+    pos[prefix_len + line_len] = '\n';
+    tap_out_commit(total_len);
+    return 0;
+}
+
+size_t tap_uint_format(size_t n, char *buf) {
+    char digits[TAP_UINT_FMT_LEN];
+    size_t len = 0;
+
+    do {
+        digits[len++] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+
+    for (size_t idx = 0; idx < len; idx++) {
+        buf[idx] = digits[len - idx - 1];
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+int tap_out_uint(size_t n) {
+    char *pos;
+    int err;
+
+    err = tap_out_reserve(TAP_UINT_FMT_LEN, &pos);
+    if (err != 0) {
+        return err;
+    }
+    tap_out_commit(tap_uint_format(n, pos));
+    return 0;
+}
+
+int tap_out_duration(struct tap_duration *d) {
+    char *pos;
+    int err;
+
+    err = tap_out_reserve(TAP_DURATION_FMT_LEN, &pos);
+    if (err != 0) {
+        return err;
+    }
+    tap_out_commit(tap_duration_format(d, pos));
+    return 0;
+}
+
+/* Shorten formatted output to end at the first newline, if one_line */
+static size_t tap_out_line_len(const char *str, size_t len, bool one_line) {
+    const char *newline;
+
+    if (!one_line) {
+        return len;
+    }
+    newline = memchr(str, '\n', len);
+    return newline ? (size_t)(newline - str) : len;
+}
+
+static int tap_out_vformat(bool one_line, const char *fmt, va_list ap) {
+    char *pos, *formatted;
+    size_t n_free;
+    va_list ap_copy;
+    int n_written;
+    int err;
+
+    /* Optimistically format into whatever is left of the current chunk */
+    err = tap_out_reserve(1, &pos);
+    if (err != 0) {
+        return err;
+    }
+    n_free = TAP_OUT_CHUNK_SIZE - out.chunks[out.cur]->len;
+    va_copy(ap_copy, ap);
+    n_written = vsnprintf(pos, n_free, fmt, ap_copy);
+    va_end(ap_copy);
+    if (n_written < 0) {
+        return EIO;
+    }
+
+    if ((size_t)n_written >= n_free && n_written < TAP_OUT_CHUNK_SIZE) {
+        /* Fits in a fresh chunk */
+        err = tap_out_reserve(n_written + 1, &pos);
+        if (err != 0) {
+            return err;
+        }
+        vsnprintf(pos, n_written + 1, fmt, ap);
+    } else if ((size_t)n_written >= n_free) {
+        /* Too large for any chunk, format on the heap and copy across */
+        formatted = malloc(n_written + 1);
+        if (!formatted) {
+            return errno;
+        }
+        vsnprintf(formatted, n_written + 1, fmt, ap);
+        err = tap_out_write(formatted,
+                            tap_out_line_len(formatted, n_written, one_line));
+        free(formatted);
+        return err;
+    }
+
+    tap_out_commit(tap_out_line_len(pos, n_written, one_line));
+    return 0;
+}
+
+int tap_out_vprintf(const char *fmt, va_list ap) {
+    return tap_out_vformat(false, fmt, ap);
+}
+
+int tap_out_printf(const char *fmt, ...) {
+    va_list ap;
+    int err;
+
+    va_start(ap, fmt);
+    err = tap_out_vformat(false, fmt, ap);
+    va_end(ap);
+    return err;
+}
+
+int tap_out_vprintf_line(const char *fmt, va_list ap) {
+    int err;
+
+    err = tap_out_vformat(true, fmt, ap);
+    if (err != 0) {
+        return err;
+    }
+    return tap_out_char('\n');
+}
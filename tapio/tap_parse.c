@@ -13,6 +13,11 @@
 
 #define STARTSWITH_CMD(line, cmd) (strncasecmp(":" cmd, line, sizeof(cmd)) == 0)
 
+/* Assertions must be followed by whitespace to not match words like ":okay" */
+#define STARTSWITH_ASSERT(line, cmd) \
+    (STARTSWITH_CMD(line, cmd) &&    \
+     (line[sizeof(cmd)] == '\0' || isspace(line[sizeof(cmd)])))
+
 static enum tap_cmd_type line_to_cmd_type(const char *line) {
     enum tap_cmd_type ctype;
 
@@ -23,33 +28,68 @@ static enum tap_cmd_type line_to_cmd_type(const char *line) {
         ctype = tap_cmd_type_todo;
     } else if (STARTSWITH_CMD(line, TAP_BAILOUT)) {
         ctype = tap_cmd_type_bail;
+    } else if (STARTSWITH_ASSERT(line, TAP_ASSERT_OK)) {
+        ctype = tap_cmd_type_ok;
+    } else if (STARTSWITH_ASSERT(line, TAP_ASSERT_NOT_OK)) {
+        ctype = tap_cmd_type_not_ok;
+    } else if (STARTSWITH_ASSERT(line, TAP_CMD_TIMING)) {
+        ctype = tap_cmd_type_timing;
     }
     return ctype;
 }
 
-int tap_parse_cmd(const char *line, struct tap_cmd **d_cmd) {
+/* Find the part of in between any leading and trailing whitespace */
+static const char *tap_trim_span(const char *in, size_t *d_len) {
+    size_t trim_len;
+
+    /* Skip over preceding whitespace */
+    for (; isspace(*in); in++)
+        ;
+
+    /* Skip over trailing whitespace */
+    trim_len = strlen(in);
+    for (; trim_len > 0 && isspace(in[trim_len - 1]); trim_len--)
+        ;
+
+    *d_len = trim_len;
+    return in;
+}
+
+int tap_parse_cmd(tap_arena_t *arena, const char *line,
+                  struct tap_cmd **d_cmd) {
     struct tap_cmd *cmd = NULL;
     enum tap_cmd_type ctype;
-    char *formatted_line;
+    const char *trimmed;
+    size_t skip_len;
+    size_t trim_len;
     int err;
 
     ctype = line_to_cmd_type(line);
-    if (ctype == tap_cmd_type_unknown) {
-        return 0;
-    }
-
-    err = tap_trim_string(line + 1, &formatted_line);
-    if (err != 0) {
-        return err;
+    switch (ctype) {
+        case tap_cmd_type_unknown:
+            return 0;
+        case tap_cmd_type_ok:
+            /* Only keep the description of assertions */
+            skip_len = sizeof(":" TAP_ASSERT_OK) - 1;
+            break;
+        case tap_cmd_type_not_ok:
+            skip_len = sizeof(":" TAP_ASSERT_NOT_OK) - 1;
+            break;
+        case tap_cmd_type_timing:
+            skip_len = sizeof(":" TAP_CMD_TIMING) - 1;
+            break;
+        default:
+            /* Skip past the ':' */
+            skip_len = 1;
+            break;
     }
-    tap_replace_string(formatted_line, '\n', ' ');
 
-    /* Skip past the ':' */
-    err = tap_cmd_strndup(ctype, formatted_line, strlen(formatted_line), &cmd);
-    free(formatted_line);
+    trimmed = tap_trim_span(line + skip_len, &trim_len);
+    err = tap_cmd_strndup(arena, ctype, trimmed, trim_len, &cmd);
     if (err != 0) {
         return err;
     }
+    tap_replace_string(cmd->str, '\n', ' ');
 
     /* Overwrite TAP command to be the most broadly supported version */
     switch (ctype) {
@@ -76,15 +116,7 @@ int tap_trim_string(const char *in, char **d_out) {
     size_t trim_len;
     char *out;
 
-    /* Skip over preceding whitespace */
-    for (; isspace(*in); in++)
-        ;
-
-    /* Skip over trailing whitespace */
-    trim_len = strlen(in);
-    for (; isspace(in[trim_len - 1]); trim_len--)
-        ;
-
+    in = tap_trim_span(in, &trim_len);
     out = strndup(in, trim_len);
     if (!out) {
         return errno;
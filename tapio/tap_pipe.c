@@ -19,7 +19,7 @@ static int add_fdflags(int fd, int add_flags) {
     }
 
     fd_flags |= add_flags;
-    if (fcntl(F_SETFL, fd_flags) == -1) {
+    if (fcntl(fd, F_SETFL, fd_flags) == -1) {
         return errno;
     }
     return 0;
@@ -51,3 +51,5 @@ failed:
     close(fds[TAP_PIPE_TX]);
     return err;
 }
+
+int tap_pipe_nonblock(int fd) { return add_fdflags(fd, O_NONBLOCK); }
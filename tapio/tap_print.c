@@ -11,84 +11,166 @@
 #include "config.h"
 
 int tap_print_line(const char *line) {
-    char *newline;
-    int width;
+    int err;
 
     /* Always print one newline, but never more */
-    newline = strchr(line, '\n');
-    if (newline) {
-        width = newline - line;
-    } else {
-        width = strlen(line);
-    }
-    if (printf("%.*s\n", width, line) < 0) {
-        return EIO;
-    };
-    return 0;
+    err = tap_out_span(line);
+    if (err != 0) {
+        return err;
+    }
+    return tap_out_char('\n');
 }
 
 int tap_printf_line(const char *fmt, ...) {
-    tap_string_t *tstr;
     va_list ap;
     int err;
 
-    err = tap_string_ctor(&tstr, NULL);
-    if (err != 0) {
-        return err;
-    }
     va_start(ap, fmt);
-    err = tap_string_concat_vprintf(tstr, fmt, ap);
+    err = tap_out_vprintf_line(fmt, ap);
     va_end(ap);
-    if (err != 0) {
-        return err;
+    return err;
+}
+
+/* Write "<ok> <id>", the start of every testpoint line */
+static int tap_print_ok_id(const char *ok, size_t id) {
+    int err;
+
+    err = tap_out_str(ok);
+    if (err == 0) {
+        err = tap_out_char(' ');
+    }
+    if (err == 0) {
+        err = tap_out_uint(id);
     }
-    err = tap_print_line(tap_string_borrow(tstr));
-    tap_string_dtor(tstr);
     return err;
 }
 
-int tap_print_testpoint(bool success, struct test *test,
-                        struct tap_duration *duration, const char *directive) {
-    struct tap_seconds secs;
-    tap_string_t *tstr;
-    const char *ok;
+static int tap_print_subtests(struct test *test, tap_cmd_t *subtests) {
+    size_t n_subtests = 0;
+    size_t subtest_id = 1;
     int err;
 
-    ok = success ? "ok" : "not ok";
-    err = tap_string_ctor(&tstr, "%s %zu - ", ok, test->id);
+    for (tap_cmd_t *cmd = subtests; cmd; cmd = cmd->next) {
+        n_subtests++;
+    }
+
+    err = tap_out_str("# Subtest: ");
+    if (err == 0 && test->description) {
+        err = tap_out_span(test->description);
+    } else if (err == 0) {
+        err = tap_out_str("test ");
+        if (err == 0) {
+            err = tap_out_uint(test->id);
+        }
+    }
+    if (err == 0) {
+        err = tap_out_str("\n" TAP_SUBTEST_INDENT "1..");
+    }
+    if (err == 0) {
+        err = tap_out_uint(n_subtests);
+    }
+    if (err == 0) {
+        err = tap_out_char('\n');
+    }
     if (err != 0) {
-        goto done;
+        return err;
     }
 
-    if (test->description) {
-        err = tap_string_concat_printf(tstr, "%s ", test->description);
+    for (tap_cmd_t *cmd = subtests; cmd; cmd = cmd->next, subtest_id++) {
+        const char *ok;
+
+        ok = cmd->type == tap_cmd_type_ok ? TAP_ASSERT_OK : TAP_ASSERT_NOT_OK;
+        err = tap_out_str(TAP_SUBTEST_INDENT);
+        if (err == 0) {
+            err = tap_print_ok_id(ok, subtest_id);
+        }
+        if (err == 0 && *cmd->str) {
+            err = tap_out_str(" - ");
+            if (err == 0) {
+                err = tap_out_span(cmd->str);
+            }
+        }
+        if (err == 0) {
+            err = tap_out_char('\n');
+        }
         if (err != 0) {
-            goto done;
+            return err;
         }
     }
+    return 0;
+}
 
-    secs = tap_duration_to_secs(duration);
-    if (secs.mprefix != 0) {
-        err = tap_string_concat_printf(tstr, "(%.3g%cs)", secs.secs,
-                                       secs.mprefix);
-    } else {
-        err = tap_string_concat_printf(tstr, "(%.3gs)", secs.secs);
+/* Write ", <name> <duration>" for the optional timings of a testpoint */
+static int tap_print_timing(const char *name, struct tap_duration *d) {
+    int err;
+
+    if (!d) {
+        return 0;
     }
-    if (err != 0) {
-        goto done;
+    err = tap_out_str(", ");
+    if (err == 0) {
+        err = tap_out_str(name);
+    }
+    if (err == 0) {
+        err = tap_out_char(' ');
     }
+    if (err == 0) {
+        err = tap_out_duration(d);
+    }
+    return err;
+}
+
+int tap_print_testpoint(bool success, struct test *test,
+                        struct tap_duration *duration,
+                        struct tap_duration *cpu,
+                        struct tap_duration *overhead, const char *directive,
+                        tap_cmd_t *subtests) {
+    const char *ok;
+    int err;
 
-    if (directive) {
-        err = tap_string_concat_printf(tstr, " # %s", directive);
+    if (subtests) {
+        err = tap_print_subtests(test, subtests);
         if (err != 0) {
-            goto done;
+            return err;
         }
     }
 
-    err = tap_print_line(tap_string_borrow(tstr));
-done:
-    tap_string_dtor(tstr);
-    return err;
+    ok = success ? TAP_ASSERT_OK : TAP_ASSERT_NOT_OK;
+    err = tap_print_ok_id(ok, test->id);
+    if (err == 0) {
+        err = tap_out_str(" - ");
+    }
+    if (err == 0 && test->description) {
+        err = tap_out_span(test->description);
+        if (err == 0) {
+            err = tap_out_char(' ');
+        }
+    }
+    if (err == 0) {
+        err = tap_out_char('(');
+    }
+    if (err == 0) {
+        err = tap_out_duration(duration);
+    }
+    if (err == 0) {
+        err = tap_print_timing("cpu", cpu);
+    }
+    if (err == 0) {
+        err = tap_print_timing("overhead", overhead);
+    }
+    if (err == 0) {
+        err = tap_out_char(')');
+    }
+    if (err == 0 && directive) {
+        err = tap_out_str(" # ");
+        if (err == 0) {
+            err = tap_out_span(directive);
+        }
+    }
+    if (err != 0) {
+        return err;
+    }
+    return tap_out_char('\n');
 }
 
 int tap_print_internal_error(int internal_err, struct test *test,
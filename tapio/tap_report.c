@@ -0,0 +1,272 @@
+/**
+ * @file tap_report.c
+ *
+ * Dispatches test run events to a list of reporters, and implements the TAP
+ * reporter writing to stdout.
+ */
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tapio.h>
+#include <tapstruct.h>
+#include <taptest.h>
+#include <taputil.h>
+
+#include "config.h"
+
+/* Call hook on every reporter that has it, returning the first error */
+#define TAP_REPORT_EACH(reporters, hook, ...)                           \
+    do {                                                                \
+        int first_err = 0;                                              \
+        for (struct tap_reporter *r = (reporters); r; r = r->next) {    \
+            int hook_err;                                               \
+            if (!r->ops->hook) {                                        \
+                continue;                                               \
+            }                                                           \
+            hook_err = r->ops->hook(r->priv, ##__VA_ARGS__);            \
+            if (first_err == 0) {                                       \
+                first_err = hook_err;                                   \
+            }                                                           \
+        }                                                               \
+        return first_err;                                               \
+    } while (0)
+
+static int tap_reporter_tap_plan(void *priv, size_t n_tests) {
+    return tap_printf_line("1..%zu", n_tests);
+}
+
+static int tap_reporter_tap_testpoint(void *priv,
+                                      struct tap_testpoint *point) {
+    return tap_print_testpoint(point->success, point->test, point->duration,
+                               point->cpu, point->overhead, point->directive,
+                               point->subtests);
+}
+
+static int tap_reporter_tap_comment(void *priv, struct test *test,
+                                    const char *line) {
+    int err;
+
+    if (!test) {
+        err = tap_out_str("# ");
+    } else {
+        err = tap_out_str("# test ");
+        if (err == 0) {
+            err = tap_out_uint(test->id);
+        }
+        if (err == 0) {
+            err = tap_out_str(": ");
+        }
+    }
+    if (err != 0) {
+        return err;
+    }
+    return tap_print_line(line);
+}
+
+static int tap_reporter_tap_comment_lines(void *priv, struct test *test,
+                                          const char *lines, size_t len) {
+    const char *end = lines + len;
+    char prefix[sizeof("# test : ") + TAP_UINT_FMT_LEN];
+    size_t prefix_len;
+
+    /* Every line of the block shares the same prefix */
+    if (!test) {
+        memcpy(prefix, "# ", 2);
+        prefix_len = 2;
+    } else {
+        memcpy(prefix, "# test ", 7);
+        prefix_len = 7 + tap_uint_format(test->id, prefix + 7);
+        memcpy(prefix + prefix_len, ": ", 2);
+        prefix_len += 2;
+    }
+
+    while (lines < end) {
+        const char *newline;
+        size_t line_len;
+        int err;
+
+        newline = memchr(lines, '\n', end - lines);
+        line_len = newline ? (size_t)(newline - lines) : (size_t)(end - lines);
+        if (line_len > 0) {
+            err = tap_out_prefixed_line(prefix, prefix_len, lines, line_len);
+            if (err != 0) {
+                return err;
+            }
+        }
+        lines += line_len + 1;
+    }
+    return 0;
+}
+
+static int tap_reporter_tap_bailout(void *priv, const char *reason) {
+    if (*reason == '\0') {
+        return tap_print_line(TAP_BAILOUT);
+    }
+    return tap_printf_line(TAP_BAILOUT " %s", reason);
+}
+
+static int tap_reporter_tap_finish(void *priv) { return tap_out_flush(); }
+
+static const struct tap_reporter_ops tap_reporter_tap_ops = {
+    .plan = tap_reporter_tap_plan,
+    .testpoint = tap_reporter_tap_testpoint,
+    .comment = tap_reporter_tap_comment,
+    .comment_lines = tap_reporter_tap_comment_lines,
+    .bailout = tap_reporter_tap_bailout,
+    .finish = tap_reporter_tap_finish,
+};
+
+int tap_reporter_ctor(const struct tap_reporter_ops *ops, void *priv,
+                      struct tap_reporter **d_reporter) {
+    struct tap_reporter *reporter;
+
+    reporter = calloc(1, sizeof(*reporter));
+    if (!reporter) {
+        return errno;
+    }
+    reporter->ops = ops;
+    reporter->priv = priv;
+    *d_reporter = reporter;
+    return 0;
+}
+
+int tap_reporter_tap_ctor(struct tap_reporter **d_reporter) {
+    return tap_reporter_ctor(&tap_reporter_tap_ops, NULL, d_reporter);
+}
+
+void tap_reporters_dtor(struct tap_reporter *reporters) {
+    while (reporters) {
+        struct tap_reporter *next = reporters->next;
+
+        if (reporters->ops->dtor) {
+            reporters->ops->dtor(reporters->priv);
+        }
+        free(reporters);
+        reporters = next;
+    }
+}
+
+int tap_report_plan(struct tap_reporter *reporters, size_t n_tests) {
+    TAP_REPORT_EACH(reporters, plan, n_tests);
+}
+
+int tap_report_testpoint(struct tap_reporter *reporters,
+                         struct tap_testpoint *point) {
+    TAP_REPORT_EACH(reporters, testpoint, point);
+}
+
+static int tap_report_vformat(tap_string_t *tstr, const char *fmt,
+                              va_list ap) {
+    char *newline;
+    int err;
+
+    err = tap_string_concat_vprintf(tstr, fmt, ap);
+    if (err != 0) {
+        return err;
+    }
+
+    /* Every event is a single line, drop anything past the first newline */
+    newline = strchr(tstr->data, '\n');
+    if (newline) {
+        *newline = '\0';
+    }
+    return 0;
+}
+
+int tap_report_comment_line(struct tap_reporter *reporters, struct test *test,
+                            const char *line) {
+    TAP_REPORT_EACH(reporters, comment, test, line);
+}
+
+/* Feed a block of lines through a reporter's single line comment hook */
+static int tap_report_split_lines(struct tap_reporter *reporter,
+                                  struct test *test, const char *lines,
+                                  size_t len) {
+    const char *end = lines + len;
+    tap_string_t tstr;
+    int err = 0;
+
+    tap_string_init(&tstr);
+    while (lines < end && err == 0) {
+        const char *newline;
+        size_t line_len;
+
+        newline = memchr(lines, '\n', end - lines);
+        line_len = newline ? (size_t)(newline - lines) : (size_t)(end - lines);
+        if (line_len > 0) {
+            tap_string_clear(&tstr);
+            err = tap_string_concat_len(&tstr, lines, line_len);
+            if (err == 0) {
+                err = reporter->ops->comment(reporter->priv, test,
+                                             tap_string_borrow(&tstr));
+            }
+        }
+        lines += line_len + 1;
+    }
+    tap_string_fini(&tstr);
+    return err;
+}
+
+int tap_report_comment_lines(struct tap_reporter *reporters, struct test *test,
+                             const char *lines, size_t len) {
+    int first_err = 0;
+
+    for (struct tap_reporter *r = reporters; r; r = r->next) {
+        int err = 0;
+
+        if (r->ops->comment_lines) {
+            err = r->ops->comment_lines(r->priv, test, lines, len);
+        } else if (r->ops->comment) {
+            err = tap_report_split_lines(r, test, lines, len);
+        }
+        if (first_err == 0) {
+            first_err = err;
+        }
+    }
+    return first_err;
+}
+
+int tap_report_comment(struct tap_reporter *reporters, struct test *test,
+                       const char *fmt, ...) {
+    tap_string_t tstr;
+    va_list ap;
+    int err;
+
+    tap_string_init(&tstr);
+    va_start(ap, fmt);
+    err = tap_report_vformat(&tstr, fmt, ap);
+    va_end(ap);
+    if (err == 0) {
+        err = tap_report_comment_line(reporters, test,
+                                      tap_string_borrow(&tstr));
+    }
+    tap_string_fini(&tstr);
+    return err;
+}
+
+static int tap_report_bailout_line(struct tap_reporter *reporters,
+                                   const char *reason) {
+    TAP_REPORT_EACH(reporters, bailout, reason);
+}
+
+int tap_report_bailout(struct tap_reporter *reporters, const char *fmt, ...) {
+    tap_string_t tstr;
+    va_list ap;
+    int err;
+
+    tap_string_init(&tstr);
+    va_start(ap, fmt);
+    err = tap_report_vformat(&tstr, fmt, ap);
+    va_end(ap);
+    if (err == 0) {
+        err = tap_report_bailout_line(reporters, tap_string_borrow(&tstr));
+    }
+    tap_string_fini(&tstr);
+    return err;
+}
+
+int tap_report_finish(struct tap_reporter *reporters) {
+    TAP_REPORT_EACH(reporters, finish);
+}
@@ -1,7 +1,10 @@
 #include <errno.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <tapio.h>
+#include <taputil.h>
 #include <time.h>
 
 #include "config.h"
@@ -10,6 +13,10 @@ static double diff_timespec(struct timespec *t1, struct timespec *t0) {
     return (t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec) / 1e9;
 }
 
+double tap_duration_to_double(struct tap_duration *d) {
+    return diff_timespec(&d->t1, &d->t0);
+}
+
 struct tap_seconds tap_duration_to_secs(struct tap_duration *d) {
     char mprefix = 0;
     int exponent = 0;
@@ -46,3 +53,92 @@ done:
         .mprefix = mprefix,
     };
 }
+
+struct tap_duration tap_duration_from_ns(uint64_t ns) {
+    return (struct tap_duration){
+        .t1 = {.tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000},
+    };
+}
+
+size_t tap_duration_format(struct tap_duration *d, char *buf) {
+    /* Nanoseconds in one unit of each prefix, matching tap_duration_to_secs */
+    static const struct {
+        uint64_t ns;
+        char mprefix;
+    } units[] = {
+        {1ull, 'n'},
+        {1000ull, 'u'},
+        {1000ull * 1000, 'm'},
+        {1000ull * 1000 * 1000, 0},
+        {1000ull * 1000 * 1000 * 1000, 'k'},
+        {1000ull * 1000 * 1000 * 1000 * 1000, 'M'},
+        {1000ull * 1000 * 1000 * 1000 * 1000 * 1000, 'G'},
+    };
+    char digits[TAP_UINT_FMT_LEN];
+    uint64_t ns, unit, scale, value;
+    size_t len = 0, uidx = 0;
+    size_t n_digits;
+    int64_t signed_ns;
+    int n_decimals;
+
+    signed_ns = (int64_t)(d->t1.tv_sec - d->t0.tv_sec) * 1000000000 +
+                (d->t1.tv_nsec - d->t0.tv_nsec);
+    if (signed_ns < 0) {
+        buf[len++] = '-';
+        ns = -(uint64_t)signed_ns;
+    } else {
+        ns = signed_ns;
+    }
+    if (ns == 0) {
+        memcpy(buf, "0s", 3);
+        return 2;
+    }
+
+    /* Smallest prefix that keeps the value below 999.5 */
+    for (; uidx + 1 < ARRAY_LEN(units) &&
+           ns >= units[uidx].ns * 999 + (units[uidx].ns + 1) / 2;
+         uidx++)
+        ;
+    unit = units[uidx].ns;
+
+    /* Three significant digits, as with %.3g */
+    if (ns >= 100 * unit) {
+        n_decimals = 0;
+    } else if (ns >= 10 * unit) {
+        n_decimals = 1;
+    } else {
+        n_decimals = 2;
+    }
+    scale = unit;
+    for (int idx = 0; idx < n_decimals; idx++) {
+        scale /= 10;
+    }
+    if (scale == 0) {
+        /* Nanoseconds have no fraction to round */
+        value = ns;
+        for (int idx = 0; idx < n_decimals; idx++) {
+            value *= 10;
+        }
+    } else {
+        value = (ns + scale / 2) / scale;
+    }
+
+    /* Trailing zeros of the fraction are dropped, as with %g */
+    for (; n_decimals > 0 && value % 10 == 0; value /= 10, n_decimals--)
+        ;
+    n_digits = tap_uint_format(value, digits);
+    memcpy(buf + len, digits, n_digits - n_decimals);
+    len += n_digits - n_decimals;
+    if (n_decimals > 0) {
+        buf[len++] = '.';
+        memcpy(buf + len, digits + n_digits - n_decimals, n_decimals);
+        len += n_decimals;
+    }
+
+    if (units[uidx].mprefix) {
+        buf[len++] = units[uidx].mprefix;
+    }
+    buf[len++] = 's';
+    buf[len] = '\0';
+    return len;
+}
@@ -91,6 +91,36 @@ void positive_tests(void) {
             .output_type = tap_cmd_type_skip,
             .output_str = "SKIP lEt's sKip dowN  to the next tesT",
         },
+        {
+            .name = "Ok assertion with no description",
+            .input_line = ":ok",
+            .output_type = tap_cmd_type_ok,
+            .output_str = "",
+        },
+        {
+            .name = "Not ok assertion with no description",
+            .input_line = ":not ok\n",
+            .output_type = tap_cmd_type_not_ok,
+            .output_str = "",
+        },
+        {
+            .name = "Ok assertion with description",
+            .input_line = ":ok   one plus one is two\n",
+            .output_type = tap_cmd_type_ok,
+            .output_str = "one plus one is two",
+        },
+        {
+            .name = "Not ok mixed-case assertion with description",
+            .input_line = ":NoT Ok one plus one is three",
+            .output_type = tap_cmd_type_not_ok,
+            .output_str = "one plus one is three",
+        },
+        {
+            .name = "Timing sent by the runner's child",
+            .input_line = ":timing 1000 2000 500\n",
+            .output_type = tap_cmd_type_timing,
+            .output_str = "1000 2000 500",
+        },
     };
 
     for (size_t idx = 0; idx < ARRAY_LEN(testcases); idx++) {
@@ -98,7 +128,7 @@ void positive_tests(void) {
         size_t test_id = idx + test_counter;
         int err;
 
-        err = tap_parse_cmd(testcases[idx].input_line, &cmd);
+        err = tap_parse_cmd(NULL, testcases[idx].input_line, &cmd);
         if (err != 0) {
             printf("not ok %zu - %s failed due to retcode (%d != 0)\n", test_id,
                    testcases[idx].name, err);
@@ -174,6 +204,10 @@ void negative_tests(void) {
             .name = "Prefix of command",
             .input_line = ":SKI",
         },
+        {
+            .name = "Assertion prefix of a word",
+            .input_line = ":okay then",
+        },
         {
             .name = "Prefix of command with description",
             .input_line = ":SKI is a narrow strip of semi-rigid material worn "
@@ -186,7 +220,7 @@ void negative_tests(void) {
         size_t test_id = idx + test_counter;
         int err;
 
-        err = tap_parse_cmd(testcases[idx].input_line, &cmd);
+        err = tap_parse_cmd(NULL, testcases[idx].input_line, &cmd);
         if (err != 0) {
             printf("not ok %zu - %s failed due to retcode (%d != 0)\n", test_id,
                    testcases[idx].name, err);
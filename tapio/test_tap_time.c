@@ -154,11 +154,80 @@ void positive_tests(void) {
 
         printf("ok %zu - %s\n", test_id, testcases[idx].name);
     }
+    test_counter += ARRAY_LEN(testcases);
+
+    /* The integer formatter must agree with the floating point one */
+    for (size_t idx = 0; idx < ARRAY_LEN(testcases); idx++) {
+        size_t test_id = idx + test_counter;
+        char expected[128] = {0};
+        char dest[TAP_DURATION_FMT_LEN] = {0};
+        size_t len;
+
+        snprintf(expected, ARRAY_LEN(expected), "%ss", testcases[idx].out);
+        len = tap_duration_format(&testcases[idx].in, dest);
+        if (strcmp(expected, dest) != 0 || len != strlen(expected)) {
+            printf("not ok %zu - format %s %s != %s\n", test_id,
+                   testcases[idx].name, dest, expected);
+            continue;
+        }
+
+        printf("ok %zu - format %s\n", test_id, testcases[idx].name);
+    }
+    test_counter += ARRAY_LEN(testcases);
+}
+
+void format_edge_tests(void) {
+    struct {
+        const char *name;
+        struct tap_duration in;
+        const char *out;
+    } testcases[] = {
+        {
+            .name = "999n stays in nanoseconds",
+            .in = {.t1 = {.tv_nsec = 999}, .t0 = {0}},
+            .out = "999ns",
+        },
+        {
+            .name = "999.5u rounds up to the next prefix",
+            .in = {.t1 = {.tv_nsec = 999500}, .t0 = {0}},
+            .out = "1ms",
+        },
+        {
+            .name = "9.996m rounds up a digit",
+            .in = {.t1 = {.tv_nsec = 9996000}, .t0 = {0}},
+            .out = "10ms",
+        },
+        {
+            .name = "1.5 drops trailing zeros",
+            .in = {.t1 = {.tv_sec = 1, .tv_nsec = 500000000}, .t0 = {0}},
+            .out = "1.5s",
+        },
+        {
+            .name = "negative durations keep their sign",
+            .in = {.t1 = {0}, .t0 = {.tv_nsec = 37100000}},
+            .out = "-37.1ms",
+        },
+    };
+
+    for (size_t idx = 0; idx < ARRAY_LEN(testcases); idx++) {
+        size_t test_id = idx + test_counter;
+        char dest[TAP_DURATION_FMT_LEN] = {0};
+
+        tap_duration_format(&testcases[idx].in, dest);
+        if (strcmp(testcases[idx].out, dest) != 0) {
+            printf("not ok %zu - %s %s != %s\n", test_id, testcases[idx].name,
+                   dest, testcases[idx].out);
+            continue;
+        }
+
+        printf("ok %zu - %s\n", test_id, testcases[idx].name);
+    }
 
     test_counter += ARRAY_LEN(testcases);
 }
 
 int main(void) {
     positive_tests();
+    format_edge_tests();
     printf("1..%zu\n", test_counter - 1);
 }
@@ -0,0 +1,92 @@
+/**
+ * @file tap_arena.c
+ *
+ * Implements a bump allocator. Allocations are never freed individually, the
+ * whole arena is released at once when its owner is done with it.
+ */
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <tapstruct.h>
+
+#include "config.h"
+
+#define TAP_ARENA_BLOCK_SIZE 4096
+#define TAP_ARENA_ALIGN (sizeof(max_align_t))
+
+struct tap_arena_block {
+    struct tap_arena_block *next;
+    max_align_t data[];
+};
+
+struct tap_arena {
+    struct tap_arena_block *blocks;
+    /* Unused space of the newest block */
+    char *pos;
+    size_t n_free;
+};
+
+int tap_arena_ctor(tap_arena_t **d_arena) {
+    tap_arena_t *arena;
+
+    arena = calloc(1, sizeof(*arena));
+    if (!arena) {
+        return errno;
+    }
+    *d_arena = arena;
+    return 0;
+}
+
+static int tap_arena_add_block(tap_arena_t *arena, size_t size) {
+    struct tap_arena_block *block;
+
+    if (size < TAP_ARENA_BLOCK_SIZE) {
+        size = TAP_ARENA_BLOCK_SIZE;
+    }
+    block = malloc(sizeof(*block) + size);
+    if (!block) {
+        return errno;
+    }
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->pos = (char *)block->data;
+    arena->n_free = size;
+    return 0;
+}
+
+int tap_arena_alloc(tap_arena_t *arena, size_t size, void **d_ptr) {
+    size_t aligned;
+
+    aligned = (size + TAP_ARENA_ALIGN - 1) & ~(TAP_ARENA_ALIGN - 1);
+    if (aligned < size) {
+        return ENOMEM;
+    }
+    if (aligned > arena->n_free) {
+        int err;
+
+        err = tap_arena_add_block(arena, aligned);
+        if (err != 0) {
+            return err;
+        }
+    }
+
+    *d_ptr = arena->pos;
+    arena->pos += aligned;
+    arena->n_free -= aligned;
+    return 0;
+}
+
+void tap_arena_dtor(tap_arena_t *arena) {
+    if (!arena) {
+        return;
+    }
+    while (arena->blocks) {
+        struct tap_arena_block *next = arena->blocks->next;
+
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+    free(arena);
+}
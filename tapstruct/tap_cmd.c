@@ -6,16 +6,31 @@
 
 #include "config.h"
 
-int tap_cmd_strndup(enum tap_cmd_type ctype, const char *line, size_t n_copy,
-                    struct tap_cmd **d_cmd) {
+int tap_cmd_strndup(tap_arena_t *arena, enum tap_cmd_type ctype,
+                    const char *line, size_t n_copy, struct tap_cmd **d_cmd) {
     struct tap_cmd *cmd;
+    size_t size;
 
-    cmd = calloc(1, sizeof(*cmd) + n_copy + 1);
-    if (!cmd) {
-        return errno;
+    size = sizeof(*cmd) + n_copy + 1;
+    if (arena) {
+        void *ptr;
+        int err;
+
+        err = tap_arena_alloc(arena, size, &ptr);
+        if (err != 0) {
+            return err;
+        }
+        cmd = ptr;
+    } else {
+        cmd = malloc(size);
+        if (!cmd) {
+            return errno;
+        }
     }
     cmd->type = ctype;
+    cmd->next = NULL;
     memcpy(cmd->str, line, n_copy);
+    cmd->str[n_copy] = '\0';
     *d_cmd = cmd;
     return 0;
 }
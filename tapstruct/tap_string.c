@@ -16,12 +16,6 @@
 
 #include "config.h"
 
-struct tap_string {
-    size_t allocated;
-    size_t len;
-    char *data;
-};
-
 static size_t tap_ceil_power_two(size_t n) {
     /* Bit twiddling
      * See https://graphics.stanford.edu/~seander/bithacks.html#RoundUpPowerOf2
@@ -56,9 +50,18 @@ static int tap_string_grow(tap_string_t *tstr, size_t new_len) {
     char *new_data;
 
     alloc_len = tap_next_alloc_size(new_len + 1);
-    new_data = realloc(tstr->data, alloc_len);
-    if (!new_data) {
-        return errno;
+    if (tstr->data == tstr->inline_data) {
+        /* Moving out of the inline storage */
+        new_data = malloc(alloc_len);
+        if (!new_data) {
+            return errno;
+        }
+        memcpy(new_data, tstr->data, tstr->len + 1);
+    } else {
+        new_data = realloc(tstr->data, alloc_len);
+        if (!new_data) {
+            return errno;
+        }
     }
     tstr->data = new_data;
     tstr->allocated = alloc_len;
@@ -80,19 +83,27 @@ static void tap_string_concat_danger(tap_string_t *tstr, const char *str,
     char *tstr_end;
 
     tstr_end = tstr->data + tstr->len;
-    strcpy(tstr_end, str);
+    memcpy(tstr_end, str, str_len + 1);
     tstr->len += str_len;
 }
 
+void tap_string_init(tap_string_t *tstr) {
+    tstr->data = tstr->inline_data;
+    tstr->allocated = ARRAY_LEN(tstr->inline_data);
+    tstr->len = 0;
+    tstr->data[0] = '\0';
+}
+
 int tap_string_ctor(tap_string_t **d_tstr, const char *fmt, ...) {
     tap_string_t *tstr;
     va_list ap;
     int err;
 
-    tstr = calloc(1, sizeof(*tstr));
+    tstr = malloc(sizeof(*tstr));
     if (!tstr) {
         return errno;
     }
+    tap_string_init(tstr);
     if (!fmt) {
         *d_tstr = tstr;
         return 0;
@@ -101,6 +112,7 @@ int tap_string_ctor(tap_string_t **d_tstr, const char *fmt, ...) {
     err = tap_string_concat_vprintf(tstr, fmt, ap);
     va_end(ap);
     if (err != 0) {
+        tap_string_dtor(tstr);
         return err;
     }
     *d_tstr = tstr;
@@ -121,35 +133,57 @@ int tap_string_concat(tap_string_t *tstr, const char *str) {
     return 0;
 }
 
+int tap_string_concat_len(tap_string_t *tstr, const char *str, size_t len) {
+    int err;
+
+    err = tap_string_grow_to_fit(tstr, len);
+    if (err != 0) {
+        return err;
+    }
+    memcpy(tstr->data + tstr->len, str, len);
+    tstr->len += len;
+    tstr->data[tstr->len] = '\0';
+    return 0;
+}
+
+void tap_string_clear(tap_string_t *tstr) {
+    tstr->len = 0;
+    tstr->data[0] = '\0';
+}
+
 int tap_string_concat_vprintf(tap_string_t *tstr, const char *fmt, va_list ap) {
-    char buf[256] = {0};
     va_list ap_copy;
+    size_t n_free;
     int n_written;
     int err;
 
-    /* Copy ap for later if buf doesn't fit the resultant string */
+    /* Format in place, ap is kept for a second go if the space is short */
+    n_free = tstr->allocated - tstr->len;
     va_copy(ap_copy, ap);
-    n_written = vsnprintf(buf, ARRAY_LEN(buf), fmt, ap_copy);
+    n_written = vsnprintf(tstr->data + tstr->len, n_free, fmt, ap_copy);
     va_end(ap_copy);
     if (n_written < 0) {
+        tstr->data[tstr->len] = '\0';
         return EIO;
     }
-    /* n_written excludes the space needed for the null byte */
-    n_written++;
+    if ((size_t)n_written < n_free) {
+        tstr->len += n_written;
+        return 0;
+    }
 
     err = tap_string_grow_to_fit(tstr, n_written);
     if (err != 0) {
+        tstr->data[tstr->len] = '\0';
         return err;
     }
-
-    if (n_written <= ARRAY_LEN(buf)) {
-        tap_string_concat_danger(tstr, buf, n_written - 1);
-        return 0;
-    }
-
     n_written =
         vsnprintf(tstr->data + tstr->len, tstr->allocated - tstr->len, fmt, ap);
-    return n_written < 0 ? EIO : 0;
+    if (n_written < 0) {
+        tstr->data[tstr->len] = '\0';
+        return EIO;
+    }
+    tstr->len += n_written;
+    return 0;
 }
 
 int tap_string_concat_printf(tap_string_t *tstr, const char *fmt, ...) {
@@ -162,10 +196,17 @@ int tap_string_concat_printf(tap_string_t *tstr, const char *fmt, ...) {
     return err;
 }
 
+void tap_string_fini(tap_string_t *tstr) {
+    if (tstr->data != tstr->inline_data) {
+        free(tstr->data);
+    }
+    tap_string_init(tstr);
+}
+
 void tap_string_dtor(tap_string_t *tstr) {
     if (!tstr) {
         return;
     }
-    free(tstr->data);
+    tap_string_fini(tstr);
     free(tstr);
 }